@@ -0,0 +1,475 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <vector>
+#include <cstdlib>
+#include <cstdint>
+#include <new>
+#include "art.h"
+#include "test-check.h"
+
+using namespace std;
+
+// every allocation in this driver goes through here, so the checks can see
+// how many blocks are live and make the nth allocation from now fail
+static long liveAllocations = 0;
+static long failAfter = -1;     // -1 never fails
+
+void* operator new(size_t size)
+{
+    if(failAfter == 0) {
+        failAfter = -1;
+        throw std::bad_alloc();
+    }
+    if(failAfter > 0) {
+        --failAfter;
+    }
+    void* memory = malloc(size == 0 ? 1 : size);
+    if(memory == nullptr) {
+        throw std::bad_alloc();
+    }
+    ++liveAllocations;
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    if(memory != nullptr) {
+        --liveAllocations;
+        free(memory);
+    }
+}
+
+// walks the inner nodes so the checks can see which sizes are in use and
+// that every node is in the shape the tree promises
+template<class Key, class Value>
+struct ArtPeek : public ArtTree<Key, Value>
+{
+    typedef ArtTree<Key, Value> Base;
+    typedef typename Base::ArtNode ArtNode;
+    typedef typename Base::Inner Inner;
+    typedef typename Base::Leaf Leaf;
+
+    // how many inner nodes of each size (index 1..4 = NODE4..NODE256)
+    vector<int> census() const
+    {
+        vector<int> counts(5, 0);
+        walk(this->root_, 0, counts, nullptr);
+        return counts;
+    }
+
+    // every node keeps its kids in order, has a sensible count for its size,
+    // and every leaf sits where its bytes say it should; the leaf chain
+    // has the same leaves, in order
+    bool wellFormed() const
+    {
+        vector<int> counts(5, 0);
+        vector<Leaf*> leaves;
+        if(!walk(this->root_, 0, counts, &leaves)) {
+            return false;
+        }
+        Leaf* chained = this->head_;
+        for(size_t i = 0; i < leaves.size(); ++i, chained = chained->next) {
+            if(chained != leaves[i] || (i > 0 && !(leaves[i - 1]->bytes < leaves[i]->bytes))) {
+                return false;
+            }
+        }
+        return chained == nullptr && leaves.size() == this->size_ &&
+               (leaves.empty() ? this->tail_ == nullptr : this->tail_ == leaves.back());
+    }
+
+    // what sameAs() checks first: well formed, and find() lands on every leaf
+    bool validate() const
+    {
+        if(!wellFormed()) {
+            return false;
+        }
+        for(Leaf* leaf = this->head_; leaf != nullptr; leaf = leaf->next) {
+            typename Base::iterator at = this->find(leaf->item.first);
+            if(at == this->end() || &*at != &leaf->item) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // the kids of an inner node in byte order
+    static vector<pair<int, ArtNode*> > kids(Inner* inner)
+    {
+        vector<pair<int, ArtNode*> > out;
+        if(inner->type == Base::ART_NODE4 || inner->type == Base::ART_NODE16) {
+            const uint8_t* keys = (inner->type == Base::ART_NODE4) ? static_cast<typename Base::Node4*>(inner)->keys
+                                                                   : static_cast<typename Base::Node16*>(inner)->keys;
+            ArtNode* const* children = (inner->type == Base::ART_NODE4) ? static_cast<typename Base::Node4*>(inner)->children
+                                                                        : static_cast<typename Base::Node16*>(inner)->children;
+            for(int i = 0; i < inner->count; ++i) {
+                out.push_back(make_pair((int)keys[i], children[i]));
+            }
+        }
+        else if(inner->type == Base::ART_NODE48) {
+            typename Base::Node48* n = static_cast<typename Base::Node48*>(inner);
+            for(int b = 0; b < 256; ++b) {
+                if(n->index[b] != 0) {
+                    out.push_back(make_pair(b, n->children[n->index[b] - 1]));
+                }
+            }
+        }
+        else {
+            typename Base::Node256* n = static_cast<typename Base::Node256*>(inner);
+            for(int b = 0; b < 256; ++b) {
+                if(n->children[b] != nullptr) {
+                    out.push_back(make_pair(b, n->children[b]));
+                }
+            }
+        }
+        return out;
+    }
+
+    // leaves (if given) collects the leaves in key order
+    static bool walk(ArtNode* node, size_t depth, vector<int>& counts, vector<Leaf*>* leaves)
+    {
+        if(node == nullptr) {
+            return true;
+        }
+        if(node->type == Base::ART_LEAF) {
+            if(leaves != nullptr) {
+                leaves->push_back(static_cast<Leaf*>(node));
+            }
+            return true;
+        }
+        Inner* inner = static_cast<Inner*>(node);
+        ++counts[inner->type];
+
+        vector<pair<int, ArtNode*> > below = kids(inner);
+        if((int)below.size() != inner->count) {
+            return false;
+        }
+        int least[] = { 0, 1, 4, 13, 38 };  // shrink moves a node down before it gets any emptier
+        if(inner->count < least[inner->type] || (inner->count == 1 && inner->terminal == nullptr)) {
+            return false;
+        }
+        for(size_t i = 1; i < below.size(); ++i) {
+            if(below[i - 1].first >= below[i].first) {
+                return false;
+            }
+        }
+
+        // the stored prefix has to match the keys under it
+        const string& some = Base::minLeaf(inner)->bytes;
+        uint32_t stored = (inner->prefixLen < Base::MAX_PREFIX) ? inner->prefixLen : Base::MAX_PREFIX;
+        for(uint32_t i = 0; i < stored; ++i) {
+            if(depth + i >= some.size() || inner->prefix[i] != (uint8_t)some[depth + i]) {
+                return false;
+            }
+        }
+        size_t at = depth + inner->prefixLen;
+        if(inner->terminal != nullptr) {
+            if(inner->terminal->bytes.size() != at) {
+                return false;
+            }
+            if(leaves != nullptr) {
+                leaves->push_back(inner->terminal);
+            }
+        }
+        for(size_t i = 0; i < below.size(); ++i) {
+            Leaf* first = Base::minLeaf(below[i].second);
+            if(first->bytes.size() <= at || (uint8_t)first->bytes[at] != below[i].first ||
+               first->bytes.compare(0, at, some, 0, at) != 0) {
+                return false;
+            }
+            if(!walk(below[i].second, at + 1, counts, leaves)) {
+                return false;
+            }
+        }
+        return true;
+    }
+};
+
+// node sizes go 4 -> 16 -> 48 -> 256 as kids are added and back down as they go
+void testGrowShrink()
+{
+    cout << "node grow/shrink" << endl;
+    ArtPeek<uint64_t, int> tree;
+    map<uint64_t, int> model;
+    // 0..255 all share the first 7 bytes, so they hang off one node
+    int sizes[] = { 4, 16, 48, 256 };
+    int next = 0;
+    for(int s = 0; s < 4; ++s) {
+        for(; next < sizes[s]; ++next) {
+            tree.insert(make_pair((uint64_t)next, next));
+            model[next] = next;
+        }
+        vector<int> counts = tree.census();
+        CHECK(counts[1 + s] == 1);
+        CHECK(counts[1] + counts[2] + counts[3] + counts[4] == 1);
+        CHECK(sameAs(tree, model));
+        // one more moves it up a size
+        if(s < 3) {
+            tree.insert(make_pair((uint64_t)next, next));
+            model[next] = next;
+            ++next;
+            CHECK(tree.census()[2 + s] == 1);
+        }
+    }
+
+    // and back down, a step past each threshold
+    int shrinkTo[] = { 37, 12, 3 };
+    for(int s = 0; s < 3; ++s) {
+        while((int)model.size() > shrinkTo[s]) {
+            uint64_t key = model.rbegin()->first;
+            tree.remove(key);
+            model.erase(key);
+        }
+        CHECK(tree.census()[3 - s] == 1);
+        CHECK(sameAs(tree, model));
+    }
+
+    // the last one going away leaves a single leaf, then nothing
+    while(model.size() > 1) {
+        tree.remove(model.begin()->first);
+        model.erase(model.begin());
+    }
+    vector<int> counts = tree.census();
+    CHECK(counts[1] + counts[2] + counts[3] + counts[4] == 0);
+    CHECK(sameAs(tree, model));
+    tree.remove(model.begin()->first);
+    model.clear();
+    CHECK(tree.empty() && tree.begin() == tree.end() && sameAs(tree, model));
+}
+
+// shared runs longer than MAX_PREFIX only keep their first bytes in the
+// node, keys leaving the run past that point still have to split it right
+void testLongPrefixes()
+{
+    cout << "path compression past MAX_PREFIX" << endl;
+    ArtPeek<string, int> tree;
+    map<string, int> model;
+    string run(20, 'x');
+    const char* tails[] = { "a", "b", "ca", "cb", "" };
+    for(int i = 0; i < 5; ++i) {
+        tree.insert(make_pair(run + tails[i], i));
+        model[run + tails[i]] = i;
+    }
+    CHECK(sameAs(tree, model));
+
+    // differs at byte 12, inside the run but past the stored prefix
+    string early = run;
+    early[12] = 'a';
+    string late = run;
+    late[12] = 'z';
+    tree.insert(make_pair(early, 10));
+    tree.insert(make_pair(late, 11));
+    model[early] = 10;
+    model[late] = 11;
+    CHECK(sameAs(tree, model));
+
+    // almost matching keys that aren't there
+    string near = run;
+    near[15] = 'q';
+    CHECK(tree.find(near) == tree.end());
+    CHECK(tree.find(run.substr(0, 15)) == tree.end());
+    CHECK(tree.find(run + "c") == tree.end());
+    CHECK(tree.lowerBound(near) != tree.end() && tree.lowerBound(near)->first == model.lower_bound(near)->first);
+    CHECK(tree.lowerBound(run.substr(0, 15))->first == model.lower_bound(run.substr(0, 15))->first);
+
+    // taking the splitters out again folds the nodes back together
+    tree.remove(early);
+    tree.remove(late);
+    model.erase(early);
+    model.erase(late);
+    CHECK(sameAs(tree, model));
+    tree.remove(run + "ca");
+    tree.remove(run + "cb");
+    model.erase(run + "ca");
+    model.erase(run + "cb");
+    CHECK(sameAs(tree, model));
+    CHECK(tree.find(run + "a") != tree.end() && tree[run + "b"] == 1);
+}
+
+// keys that are prefixes of other keys end at an inner node
+void testPrefixKeys()
+{
+    cout << "prefix keys" << endl;
+    ArtPeek<string, int> tree;
+    map<string, int> model;
+    const char* keys[] = { "abcd", "a", "abc", "", "ab", "abd", "b" };
+    for(int i = 0; i < 7; ++i) {
+        tree.insert(make_pair(string(keys[i]), i));
+        model[keys[i]] = i;
+        CHECK(sameAs(tree, model));
+    }
+    CHECK(tree.begin()->first == "" && tree.lowerBound("abca")->first == "abcd");
+    CHECK(tree.lowerBound("abce")->first == "abd");
+    CHECK(tree.lowerBound("c") == tree.end());
+
+    tree.insert(make_pair(string("ab"), 100));
+    model["ab"] = 100;
+    for(int i = 0; i < 7; ++i) {
+        tree.remove(keys[i]);
+        model.erase(keys[i]);
+        CHECK(sameAs(tree, model));
+    }
+    CHECK(tree.empty());
+}
+
+// random keys against std::map, with lowerBound, copies and moves
+template<class Key>
+void testRandom(const char* name, Key (*makeKey)(int))
+{
+    cout << "random (" << name << ")" << endl;
+    srand(43);
+    ArtPeek<Key, int> tree;
+    map<Key, int> model;
+    for(int step = 0; step < 20000; ++step) {
+        Key key = makeKey(rand());
+        if(rand() % 3 == 0) {
+            tree.remove(key);
+            model.erase(key);
+        }
+        else {
+            tree.insert(make_pair(key, step));
+            model[key] = step;
+        }
+        if(step % 1000 == 0) {
+            CHECK(sameAs(tree, model));
+            Key probe = makeKey(rand());
+            typename map<Key, int>::iterator want = model.lower_bound(probe);
+            typename ArtTree<Key, int>::iterator got = tree.lowerBound(probe);
+            CHECK(want == model.end() ? got == tree.end() : (got != tree.end() && got->first == want->first));
+        }
+    }
+    CHECK(sameAs(tree, model));
+
+    ArtPeek<Key, int> copy;
+    static_cast<ArtTree<Key, int>&>(copy) = tree;
+    CHECK(sameAs(copy, model));
+    ArtPeek<Key, int> moved;
+    static_cast<ArtTree<Key, int>&>(moved) = std::move(static_cast<ArtTree<Key, int>&>(copy));
+    CHECK(sameAs(moved, model) && copy.empty());
+    moved.clear();
+    CHECK(moved.empty() && moved.begin() == moved.end());
+}
+
+// inserts (key, value) with the nth allocation from now failing, for n = 0, 1, ...
+// until it goes through. false if a failed try left anything allocated
+template<class Key>
+bool insertFailing(ArtPeek<Key, int>& tree, const Key& key, int value)
+{
+    pair<const Key, int> item(key, value);
+    bool clean = true;
+    for(long n = 0; ; ++n) {
+        long before = liveAllocations;
+        failAfter = n;
+        try {
+            tree.insert(item);
+            failAfter = -1;
+            return clean;
+        }
+        catch(std::bad_alloc&) {
+            clean = clean && liveAllocations == before;
+        }
+    }
+}
+
+// running out of memory part way through an insert (the leaf, a Node4 for
+// a split, or a bigger node to grow into) or a copy leaks nothing and
+// leaves the tree as it was
+void testAllocationFailure()
+{
+    cout << "allocation failures" << endl;
+    ArtPeek<string, int> tree;
+    map<string, int> model;
+    // scratch_ grows to the longest key once and stays, so do that up front
+    string longest(40, 'z');
+    tree.insert(make_pair(longest, 0));
+    tree.remove(longest);
+
+    // one shared byte grows a node through every size, then splits inside
+    // a long prefix, inside a short one, and at a leaf; then prefix keys
+    vector<string> keys;
+    for(int b = 0; b < 256; ++b) {
+        keys.push_back(string(20, 'p') + (char)b);
+    }
+    keys.push_back(string(12, 'p') + "q");
+    keys.push_back(string(20, 'p'));
+    keys.push_back("ab");
+    keys.push_back("ac");
+    keys.push_back("a");
+    keys.push_back("abcdef");
+    keys.push_back("abcdeg");
+    bool clean = true;
+    for(size_t i = 0; i < keys.size(); ++i) {
+        clean = insertFailing(tree, keys[i], (int)i) && clean;
+        model[keys[i]] = (int)i;
+        if(i % 32 == 0 || i >= 256) {
+            CHECK(sameAs(tree, model));
+        }
+    }
+    CHECK(clean && sameAs(tree, model));
+    CHECK(tree.census()[4] == 1);
+
+    // overwriting allocates nothing
+    pair<const string, int> overwrite(keys[5], -5);
+    long before = liveAllocations;
+    failAfter = 0;
+    tree.insert(overwrite);
+    failAfter = -1;
+    model[keys[5]] = -5;
+    CHECK(liveAllocations == before && sameAs(tree, model));
+
+    // a copy that fails part way cleans up everything it made
+    clean = true;
+    for(long n = 0; ; ++n) {
+        before = liveAllocations;
+        failAfter = n;
+        try {
+            ArtPeek<string, int> copy(tree);
+            failAfter = -1;
+            CHECK(sameAs(copy, model));
+            break;
+        }
+        catch(std::bad_alloc&) {
+            clean = clean && liveAllocations == before;
+        }
+    }
+    CHECK(clean && sameAs(tree, model));
+
+    tree.clear();
+    model.clear();
+    CHECK(sameAs(tree, model));
+}
+
+// spread over the whole range, with runs of nearby values mixed in
+uint64_t wideKey(int r)
+{
+    return (r % 2) ? (uint64_t)r * 0x9e3779b97f4a7c15ull : (uint64_t)(r % 5000);
+}
+
+int32_t signedKey(int r)
+{
+    return (r % 2) ? (int32_t)(r % 100000) - 50000 : (int32_t)((unsigned)r * 2654435761u);
+}
+
+// short strings on a small alphabet, so lots of shared prefixes and prefix keys
+string stringKey(int r)
+{
+    string key;
+    int len = r % 7;
+    for(int i = 0; i < len; ++i) {
+        r /= 3;
+        key += (char)('a' + r % 3);
+    }
+    return key;
+}
+
+int main()
+{
+    testGrowShrink();
+    testLongPrefixes();
+    testPrefixKeys();
+    testAllocationFailure();
+    testRandom<uint64_t>("uint64_t", wideKey);
+    testRandom<int32_t>("int32_t", signedKey);
+    testRandom<string>("std::string", stringKey);
+    return checkResult();
+}
@@ -0,0 +1,1185 @@
+#ifndef ART_H
+#define ART_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+/*
+  How ArtTree turns a key into bytes. The bytes have to sort (as unsigned
+  chars, shorter first on a tie) the same way the keys do with <, so
+  integers go in big endian with the sign bit flipped for signed types.
+  Specialize this for any other key type:
+    static void encode(const Key& key, std::string& out);
+*/
+template<typename Key>
+struct ArtKeyBytes;
+
+template<>
+struct ArtKeyBytes<uint64_t>
+{
+    static void encode(uint64_t key, std::string& out)
+    {
+        out.resize(8);
+        for(int i = 7; i >= 0; --i) {
+            out[i] = (char)(key & 0xff);
+            key >>= 8;
+        }
+    }
+};
+
+template<>
+struct ArtKeyBytes<uint32_t>
+{
+    static void encode(uint32_t key, std::string& out)
+    {
+        out.resize(4);
+        for(int i = 3; i >= 0; --i) {
+            out[i] = (char)(key & 0xff);
+            key >>= 8;
+        }
+    }
+};
+
+template<>
+struct ArtKeyBytes<int64_t>
+{
+    static void encode(int64_t key, std::string& out)
+    {
+        ArtKeyBytes<uint64_t>::encode((uint64_t)key ^ (1ull << 63), out);
+    }
+};
+
+template<>
+struct ArtKeyBytes<int32_t>
+{
+    static void encode(int32_t key, std::string& out)
+    {
+        ArtKeyBytes<uint32_t>::encode((uint32_t)key ^ (1u << 31), out);
+    }
+};
+
+// std::string already compares bytewise as unsigned chars
+template<>
+struct ArtKeyBytes<std::string>
+{
+    static void encode(const std::string& key, std::string& out)
+    {
+        out = key;
+    }
+};
+
+/**
+* An ordered map on an adaptive radix tree: keys get turned into bytes (see
+* ArtKeyBytes) and each inner node branches on one byte, so a lookup costs
+* O(key length) byte steps instead of O(log n) full key comparisons, and the
+* top levels are wide enough to stay in cache.
+* Inner nodes come in four sizes (up to 4, 16, 48 and 256 kids) and grow
+* and shrink as kids come and go. Runs of bytes with no branching get
+* squashed into the node below (path compression, the first MAX_PREFIX
+* bytes are kept in the node and the rest checked against a leaf). A key
+* that's a prefix of another one hangs off the inner node where it ends.
+* Leaves are also chained in key order, so iterating is just following
+* the chain. Same insert/remove/find/iterator interface as BinarySearchTree.
+*/
+template <class Key, class Value>
+class ArtTree
+{
+protected:
+    struct Leaf;
+
+public:
+    ArtTree();
+    ArtTree(const ArtTree& other);
+    ArtTree(ArtTree&& other) noexcept;
+    ArtTree& operator=(const ArtTree& other);
+    ArtTree& operator=(ArtTree&& other) noexcept;
+    ~ArtTree();
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+
+    class iterator
+    {
+    public:
+        iterator();
+
+        std::pair<const Key, Value>& operator*() const;
+        std::pair<const Key, Value>* operator->() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class ArtTree<Key, Value>;
+        iterator(Leaf* leaf);
+
+        Leaf* current_;
+    };
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    static const uint32_t MAX_PREFIX = 8;
+    enum NodeType { ART_LEAF, ART_NODE4, ART_NODE16, ART_NODE48, ART_NODE256 };
+
+    struct ArtNode
+    {
+        explicit ArtNode(uint8_t type) : type(type) {}
+        uint8_t type;
+    };
+
+    struct Leaf : ArtNode
+    {
+        Leaf(const std::pair<const Key, Value>& item, const std::string& bytes) :
+            ArtNode(ART_LEAF), item(item), bytes(bytes), prev(nullptr), next(nullptr) {}
+        std::pair<const Key, Value> item;
+        std::string bytes;  // the encoded key
+        Leaf* prev;
+        Leaf* next;
+    };
+
+    // what all the inner nodes share. terminal is the key (if any) that ends right after the prefix
+    struct Inner : ArtNode
+    {
+        explicit Inner(uint8_t type) : ArtNode(type), count(0), prefixLen(0), terminal(nullptr) {}
+        uint16_t count;
+        uint32_t prefixLen;
+        uint8_t prefix[MAX_PREFIX];
+        Leaf* terminal;
+    };
+
+    // 4 and 16 keep their bytes sorted, 48 maps a byte to a slot (+1, 0 is empty), 256 indexes directly
+    struct Node4 : Inner
+    {
+        Node4() : Inner(ART_NODE4) {}
+        uint8_t keys[4];
+        ArtNode* children[4];
+    };
+
+    struct Node16 : Inner
+    {
+        Node16() : Inner(ART_NODE16) {}
+        uint8_t keys[16];
+        ArtNode* children[16];
+    };
+
+    struct Node48 : Inner
+    {
+        Node48() : Inner(ART_NODE48)
+        {
+            memset(index, 0, sizeof(index));
+            memset(children, 0, sizeof(children));
+        }
+        uint8_t index[256];
+        ArtNode* children[48];
+    };
+
+    struct Node256 : Inner
+    {
+        Node256() : Inner(ART_NODE256)
+        {
+            memset(children, 0, sizeof(children));
+        }
+        ArtNode* children[256];
+    };
+
+    Leaf* findLeaf(const std::string& bytes) const;
+    Leaf* lowerBoundLeaf(const std::string& bytes) const;
+    void insertLeaf(const std::pair<const Key, Value>& item, const std::string& bytes);
+    void unlinkLeaf(Leaf* leaf);
+
+    static ArtNode** findChild(Inner* node, uint8_t byte);
+    static ArtNode* childAfter(Inner* node, uint8_t byte);
+    static ArtNode* firstChild(Inner* node);
+    static ArtNode* lastChild(Inner* node);
+    static Leaf* minLeaf(ArtNode* node);
+    static Leaf* maxLeaf(ArtNode* node);
+    static uint32_t prefixMismatch(Inner* node, const std::string& bytes, size_t depth);
+    static void copyHeader(Inner* to, const Inner* from);
+    static void addChild(ArtNode** ref, uint8_t byte, ArtNode* child);
+    static void removeChild(ArtNode** ref, uint8_t byte);
+    static void shrink(ArtNode** ref);
+    static void deleteNode(ArtNode* node);
+
+    ArtNode* root_;
+    Leaf* head_;    // smallest key, the chain runs from here
+    Leaf* tail_;    // largest key
+    size_t size_;
+    std::string scratch_;   // reused for encoding keys in the non-const calls
+};
+
+/*
+---------------------------------------------------------
+Begin implementations for the ArtTree::iterator class.
+---------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ArtTree<Key, Value>::iterator::iterator() : current_(nullptr)
+{
+
+}
+
+template<class Key, class Value>
+ArtTree<Key, Value>::iterator::iterator(Leaf* leaf) : current_(leaf)
+{
+
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>& ArtTree<Key, Value>::iterator::operator*() const
+{
+    return current_->item;
+}
+
+template<class Key, class Value>
+std::pair<const Key, Value>* ArtTree<Key, Value>::iterator::operator->() const
+{
+    return &(current_->item);
+}
+
+template<class Key, class Value>
+bool ArtTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return current_ == rhs.current_;
+}
+
+template<class Key, class Value>
+bool ArtTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return current_ != rhs.current_;
+}
+
+template<class Key, class Value>
+typename ArtTree<Key, Value>::iterator& ArtTree<Key, Value>::iterator::operator++()
+{
+    current_ = current_->next;
+    return *this;
+}
+
+/*
+-------------------------------------------------------
+End implementations for the ArtTree::iterator class.
+-------------------------------------------------------
+*/
+
+template<class Key, class Value>
+ArtTree<Key, Value>::ArtTree() : root_(nullptr), head_(nullptr), tail_(nullptr), size_(0)
+{
+
+}
+
+/**
+* Copies by inserting other's items in order (every structure choice in an
+* ART comes from the keys, so this gives the same tree).
+*/
+template<class Key, class Value>
+ArtTree<Key, Value>::ArtTree(const ArtTree& other) : root_(nullptr), head_(nullptr), tail_(nullptr), size_(0)
+{
+    try {
+        for(Leaf* leaf = other.head_; leaf != nullptr; leaf = leaf->next) {
+            insertLeaf(leaf->item, leaf->bytes);
+        }
+    }
+    catch(...) {
+        clear();
+        throw;
+    }
+}
+
+template<class Key, class Value>
+ArtTree<Key, Value>::ArtTree(ArtTree&& other) noexcept :
+    root_(other.root_), head_(other.head_), tail_(other.tail_), size_(other.size_)
+{
+    other.root_ = nullptr;
+    other.head_ = nullptr;
+    other.tail_ = nullptr;
+    other.size_ = 0;
+}
+
+template<class Key, class Value>
+ArtTree<Key, Value>& ArtTree<Key, Value>::operator=(const ArtTree& other)
+{
+    if(this != &other) {
+        ArtTree copy(other);
+        *this = std::move(copy);
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+ArtTree<Key, Value>& ArtTree<Key, Value>::operator=(ArtTree&& other) noexcept
+{
+    if(this != &other) {
+        clear();
+        root_ = other.root_;
+        head_ = other.head_;
+        tail_ = other.tail_;
+        size_ = other.size_;
+        other.root_ = nullptr;
+        other.head_ = nullptr;
+        other.tail_ = nullptr;
+        other.size_ = 0;
+    }
+    return *this;
+}
+
+template<class Key, class Value>
+ArtTree<Key, Value>::~ArtTree()
+{
+    clear();
+}
+
+/**
+* Adds the item, or overwrites the value if the key is already there.
+*/
+template<class Key, class Value>
+void ArtTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    ArtKeyBytes<Key>::encode(keyValuePair.first, scratch_);
+    insertLeaf(keyValuePair, scratch_);
+}
+
+/**
+* Removes the key if it's there.
+*/
+template<class Key, class Value>
+void ArtTree<Key, Value>::remove(const Key& key)
+{
+    ArtKeyBytes<Key>::encode(key, scratch_);
+    const std::string& bytes = scratch_;
+
+    ArtNode** ref = &root_;
+    ArtNode** parentRef = nullptr;
+    uint8_t parentByte = 0;
+    size_t depth = 0;
+    while(*ref != nullptr) {
+        ArtNode* node = *ref;
+        if(node->type == ART_LEAF) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            if(leaf->bytes != bytes) {
+                return;
+            }
+            if(parentRef == nullptr) {
+                root_ = nullptr;
+            }
+            else {
+                removeChild(parentRef, parentByte);
+            }
+            unlinkLeaf(leaf);
+            delete leaf;
+            return;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        if(prefixMismatch(inner, bytes, depth) != inner->prefixLen) {
+            return;
+        }
+        depth += inner->prefixLen;
+        if(depth == bytes.size()) {
+            Leaf* leaf = inner->terminal;
+            if(leaf == nullptr) {
+                return;
+            }
+            inner->terminal = nullptr;
+            shrink(ref);
+            unlinkLeaf(leaf);
+            delete leaf;
+            return;
+        }
+
+        parentRef = ref;
+        parentByte = (uint8_t)bytes[depth];
+        ref = findChild(inner, parentByte);
+        if(ref == nullptr) {
+            return;
+        }
+        ++depth;
+    }
+}
+
+/**
+* Deletes everything. Leaves go by walking the chain, inner nodes with an
+* explicit stack.
+*/
+template<class Key, class Value>
+void ArtTree<Key, Value>::clear()
+{
+    std::vector<ArtNode*> stack;
+    if(root_ != nullptr && root_->type != ART_LEAF) {
+        stack.push_back(root_);
+    }
+    while(!stack.empty()) {
+        Inner* inner = static_cast<Inner*>(stack.back());
+        stack.pop_back();
+        switch(inner->type) {
+        case ART_NODE4: {
+            Node4* n = static_cast<Node4*>(inner);
+            for(int i = 0; i < n->count; ++i) {
+                if(n->children[i]->type != ART_LEAF) stack.push_back(n->children[i]);
+            }
+            break;
+        }
+        case ART_NODE16: {
+            Node16* n = static_cast<Node16*>(inner);
+            for(int i = 0; i < n->count; ++i) {
+                if(n->children[i]->type != ART_LEAF) stack.push_back(n->children[i]);
+            }
+            break;
+        }
+        case ART_NODE48: {
+            Node48* n = static_cast<Node48*>(inner);
+            for(int i = 0; i < 48; ++i) {
+                if(n->children[i] != nullptr && n->children[i]->type != ART_LEAF) stack.push_back(n->children[i]);
+            }
+            break;
+        }
+        default: {
+            Node256* n = static_cast<Node256*>(inner);
+            for(int i = 0; i < 256; ++i) {
+                if(n->children[i] != nullptr && n->children[i]->type != ART_LEAF) stack.push_back(n->children[i]);
+            }
+            break;
+        }
+        }
+        deleteNode(inner);
+    }
+
+    Leaf* leaf = head_;
+    while(leaf != nullptr) {
+        Leaf* next = leaf->next;
+        delete leaf;
+        leaf = next;
+    }
+    root_ = nullptr;
+    head_ = nullptr;
+    tail_ = nullptr;
+    size_ = 0;
+}
+
+template<class Key, class Value>
+bool ArtTree<Key, Value>::empty() const
+{
+    return size_ == 0;
+}
+
+template<class Key, class Value>
+typename ArtTree<Key, Value>::iterator ArtTree<Key, Value>::begin() const
+{
+    return iterator(head_);
+}
+
+template<class Key, class Value>
+typename ArtTree<Key, Value>::iterator ArtTree<Key, Value>::end() const
+{
+    return iterator(nullptr);
+}
+
+/**
+* Finds key in O(key length), or returns end().
+*/
+template<class Key, class Value>
+typename ArtTree<Key, Value>::iterator ArtTree<Key, Value>::find(const Key& key) const
+{
+    std::string bytes;
+    ArtKeyBytes<Key>::encode(key, bytes);
+    return iterator(findLeaf(bytes));
+}
+
+/**
+* The first item with a key >= key (end() if there isn't one).
+*/
+template<class Key, class Value>
+typename ArtTree<Key, Value>::iterator ArtTree<Key, Value>::lowerBound(const Key& key) const
+{
+    std::string bytes;
+    ArtKeyBytes<Key>::encode(key, bytes);
+    return iterator(lowerBoundLeaf(bytes));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& ArtTree<Key, Value>::operator[](const Key& key)
+{
+    ArtKeyBytes<Key>::encode(key, scratch_);
+    Leaf* leaf = findLeaf(scratch_);
+    if(leaf == nullptr) throw std::out_of_range("Invalid key");
+    return leaf->item.second;
+}
+
+template<class Key, class Value>
+Value const & ArtTree<Key, Value>::operator[](const Key& key) const
+{
+    iterator it = find(key);
+    if(it == end()) throw std::out_of_range("Invalid key");
+    return it->second;
+}
+
+// walks down byte by byte. prefixes longer than MAX_PREFIX only get their
+// stored part checked on the way, the leaf compare at the bottom covers the rest
+template<class Key, class Value>
+typename ArtTree<Key, Value>::Leaf* ArtTree<Key, Value>::findLeaf(const std::string& bytes) const
+{
+    ArtNode* node = root_;
+    size_t depth = 0;
+    while(node != nullptr) {
+        if(node->type == ART_LEAF) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            return (leaf->bytes == bytes) ? leaf : nullptr;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        if(depth + inner->prefixLen > bytes.size()) {
+            return nullptr;
+        }
+        uint32_t stored = (inner->prefixLen < MAX_PREFIX) ? inner->prefixLen : MAX_PREFIX;
+        for(uint32_t i = 0; i < stored; ++i) {
+            if(inner->prefix[i] != (uint8_t)bytes[depth + i]) {
+                return nullptr;
+            }
+        }
+        depth += inner->prefixLen;
+        if(depth == bytes.size()) {
+            Leaf* leaf = inner->terminal;
+            return (leaf != nullptr && leaf->bytes == bytes) ? leaf : nullptr;
+        }
+
+        ArtNode** child = findChild(inner, (uint8_t)bytes[depth]);
+        node = (child == nullptr) ? nullptr : *child;
+        ++depth;
+    }
+    return nullptr;
+}
+
+// first leaf >= bytes. on the way down, remembers the closest subtree that's
+// entirely bigger (the next kid after the byte taken), that's the answer as
+// soon as the rest of the path turns out to be entirely smaller
+template<class Key, class Value>
+typename ArtTree<Key, Value>::Leaf* ArtTree<Key, Value>::lowerBoundLeaf(const std::string& bytes) const
+{
+    ArtNode* bigger = nullptr;
+    ArtNode* node = root_;
+    size_t depth = 0;
+    while(node != nullptr) {
+        if(node->type == ART_LEAF) {
+            Leaf* leaf = static_cast<Leaf*>(node);
+            if(!(leaf->bytes < bytes)) {
+                return leaf;
+            }
+            break;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        const std::string* full = nullptr;  // a leaf's bytes, for prefix bytes past MAX_PREFIX
+        bool smaller = false;
+        for(uint32_t i = 0; i < inner->prefixLen; ++i) {
+            if(depth + i == bytes.size()) {
+                return minLeaf(inner);  // bytes ran out, everything here is longer
+            }
+            if(i >= MAX_PREFIX && full == nullptr) {
+                full = &minLeaf(inner)->bytes;
+            }
+            uint8_t have = (i < MAX_PREFIX) ? inner->prefix[i] : (uint8_t)(*full)[depth + i];
+            uint8_t want = (uint8_t)bytes[depth + i];
+            if(have != want) {
+                if(have > want) {
+                    return minLeaf(inner);
+                }
+                smaller = true;
+                break;
+            }
+        }
+        if(smaller) {
+            break;
+        }
+        depth += inner->prefixLen;
+        if(depth == bytes.size()) {
+            return minLeaf(inner);  // the terminal (== bytes) if there is one, else bigger anyway
+        }
+
+        uint8_t byte = (uint8_t)bytes[depth];
+        ArtNode* after = childAfter(inner, byte);
+        if(after != nullptr) {
+            bigger = after;
+        }
+        ArtNode** child = findChild(inner, byte);
+        node = (child == nullptr) ? nullptr : *child;
+        ++depth;
+    }
+    return (bigger == nullptr) ? nullptr : minLeaf(bigger);
+}
+
+// one walk down: overwrites the value if bytes is already in the tree, otherwise
+// hangs a new leaf in and gets its place in the chain from wherever it landed
+// (the first leaf after it is either right there or the one after a subtree
+// it sorts past). the leaf is held in a unique_ptr until it's linked in, so
+// a split or grow that throws doesn't leak it
+template<class Key, class Value>
+void ArtTree<Key, Value>::insertLeaf(const std::pair<const Key, Value>& item, const std::string& bytes)
+{
+    std::unique_ptr<Leaf> leaf;
+    Leaf* next = nullptr;   // the first bigger leaf, NULL if the new one is the biggest
+
+    ArtNode** ref = &root_;
+    size_t depth = 0;
+    while(true) {
+        ArtNode* node = *ref;
+        if(node == nullptr) {
+            leaf.reset(new Leaf(item, bytes));
+            *ref = leaf.get();
+            break;
+        }
+
+        if(node->type == ART_LEAF) {
+            Leaf* other = static_cast<Leaf*>(node);
+            if(other->bytes == bytes) {
+                other->item.second = item.second;
+                return;
+            }
+            next = (bytes < other->bytes) ? other : other->next;
+
+            // two keys where there was one, a Node4 on their common bytes splits them
+            size_t common = 0;
+            while(depth + common < bytes.size() && depth + common < other->bytes.size()
+                  && bytes[depth + common] == other->bytes[depth + common]) {
+                ++common;
+            }
+            leaf.reset(new Leaf(item, bytes));
+            Node4* split = new Node4();
+            ArtNode* top = split;
+            split->prefixLen = (uint32_t)common;
+            memcpy(split->prefix, bytes.data() + depth, (common < MAX_PREFIX) ? common : MAX_PREFIX);
+            size_t at = depth + common;
+            Leaf* both[2] = { other, leaf.get() };
+            for(int i = 0; i < 2; ++i) {
+                if(both[i]->bytes.size() == at) {
+                    split->terminal = both[i];
+                }
+                else {
+                    addChild(&top, (uint8_t)both[i]->bytes[at], both[i]);
+                }
+            }
+            *ref = top;
+            break;
+        }
+
+        Inner* inner = static_cast<Inner*>(node);
+        uint32_t mismatch = prefixMismatch(inner, bytes, depth);
+        if(mismatch < inner->prefixLen) {
+            // the new key leaves the prefix part way, a Node4 goes in above at that point
+            const std::string* full = (inner->prefixLen > MAX_PREFIX) ? &minLeaf(inner)->bytes : nullptr;
+            uint8_t branch = (full == nullptr) ? inner->prefix[mismatch] : (uint8_t)(*full)[depth + mismatch];
+            bool before = (depth + mismatch == bytes.size()) || (uint8_t)bytes[depth + mismatch] < branch;
+            next = before ? minLeaf(inner) : maxLeaf(inner)->next;
+
+            leaf.reset(new Leaf(item, bytes));
+            Node4* split = new Node4();
+            ArtNode* top = split;
+            split->prefixLen = mismatch;
+            memcpy(split->prefix, inner->prefix, (mismatch < MAX_PREFIX) ? mismatch : MAX_PREFIX);
+
+            uint32_t rest = inner->prefixLen - mismatch - 1;
+            uint32_t keep = (rest < MAX_PREFIX) ? rest : MAX_PREFIX;
+            if(full == nullptr) {
+                memmove(inner->prefix, inner->prefix + mismatch + 1, keep);
+            }
+            else {
+                memcpy(inner->prefix, full->data() + depth + mismatch + 1, keep);
+            }
+            inner->prefixLen = rest;
+
+            addChild(&top, branch, inner);
+            if(depth + mismatch == bytes.size()) {
+                split->terminal = leaf.get();
+            }
+            else {
+                addChild(&top, (uint8_t)bytes[depth + mismatch], leaf.get());
+            }
+            *ref = top;
+            break;
+        }
+
+        depth += inner->prefixLen;
+        if(depth == bytes.size()) {
+            if(inner->terminal != nullptr) {
+                inner->terminal->item.second = item.second;
+                return;
+            }
+            next = minLeaf(inner);  // a terminal sorts before everything under it
+            leaf.reset(new Leaf(item, bytes));
+            inner->terminal = leaf.get();
+            break;
+        }
+        uint8_t byte = (uint8_t)bytes[depth];
+        ArtNode** child = findChild(inner, byte);
+        if(child == nullptr) {
+            ArtNode* after = childAfter(inner, byte);
+            next = (after != nullptr) ? minLeaf(after) : maxLeaf(inner)->next;
+            leaf.reset(new Leaf(item, bytes));
+            addChild(ref, byte, leaf.get());
+            break;
+        }
+        ref = child;
+        ++depth;
+    }
+
+    Leaf* added = leaf.release();
+    Leaf* prev = (next == nullptr) ? tail_ : next->prev;
+    added->prev = prev;
+    added->next = next;
+    if(prev == nullptr) {
+        head_ = added;
+    }
+    else {
+        prev->next = added;
+    }
+    if(next == nullptr) {
+        tail_ = added;
+    }
+    else {
+        next->prev = added;
+    }
+    ++size_;
+}
+
+template<class Key, class Value>
+void ArtTree<Key, Value>::unlinkLeaf(Leaf* leaf)
+{
+    if(leaf->prev == nullptr) {
+        head_ = leaf->next;
+    }
+    else {
+        leaf->prev->next = leaf->next;
+    }
+    if(leaf->next == nullptr) {
+        tail_ = leaf->prev;
+    }
+    else {
+        leaf->next->prev = leaf->prev;
+    }
+    --size_;
+}
+
+// the slot holding the kid for byte, or NULL
+template<class Key, class Value>
+typename ArtTree<Key, Value>::ArtNode** ArtTree<Key, Value>::findChild(Inner* node, uint8_t byte)
+{
+    switch(node->type) {
+    case ART_NODE4: {
+        Node4* n = static_cast<Node4*>(node);
+        for(int i = 0; i < n->count; ++i) {
+            if(n->keys[i] == byte) return &n->children[i];
+        }
+        return nullptr;
+    }
+    case ART_NODE16: {
+        // sorted, so a miss can stop early
+        Node16* n = static_cast<Node16*>(node);
+        for(int i = 0; i < n->count && n->keys[i] <= byte; ++i) {
+            if(n->keys[i] == byte) return &n->children[i];
+        }
+        return nullptr;
+    }
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        return (n->index[byte] == 0) ? nullptr : &n->children[n->index[byte] - 1];
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        return (n->children[byte] == nullptr) ? nullptr : &n->children[byte];
+    }
+    }
+}
+
+// the kid with the smallest byte > byte, or NULL
+template<class Key, class Value>
+typename ArtTree<Key, Value>::ArtNode* ArtTree<Key, Value>::childAfter(Inner* node, uint8_t byte)
+{
+    switch(node->type) {
+    case ART_NODE4: {
+        Node4* n = static_cast<Node4*>(node);
+        for(int i = 0; i < n->count; ++i) {
+            if(n->keys[i] > byte) return n->children[i];
+        }
+        return nullptr;
+    }
+    case ART_NODE16: {
+        Node16* n = static_cast<Node16*>(node);
+        for(int i = 0; i < n->count; ++i) {
+            if(n->keys[i] > byte) return n->children[i];
+        }
+        return nullptr;
+    }
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        for(int b = byte + 1; b < 256; ++b) {
+            if(n->index[b] != 0) return n->children[n->index[b] - 1];
+        }
+        return nullptr;
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        for(int b = byte + 1; b < 256; ++b) {
+            if(n->children[b] != nullptr) return n->children[b];
+        }
+        return nullptr;
+    }
+    }
+}
+
+// the kid with the smallest byte, or NULL
+template<class Key, class Value>
+typename ArtTree<Key, Value>::ArtNode* ArtTree<Key, Value>::firstChild(Inner* node)
+{
+    switch(node->type) {
+    case ART_NODE4:
+        return (node->count == 0) ? nullptr : static_cast<Node4*>(node)->children[0];
+    case ART_NODE16:
+        return (node->count == 0) ? nullptr : static_cast<Node16*>(node)->children[0];
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        for(int b = 0; b < 256; ++b) {
+            if(n->index[b] != 0) return n->children[n->index[b] - 1];
+        }
+        return nullptr;
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        for(int b = 0; b < 256; ++b) {
+            if(n->children[b] != nullptr) return n->children[b];
+        }
+        return nullptr;
+    }
+    }
+}
+
+// the kid with the biggest byte, or NULL
+template<class Key, class Value>
+typename ArtTree<Key, Value>::ArtNode* ArtTree<Key, Value>::lastChild(Inner* node)
+{
+    switch(node->type) {
+    case ART_NODE4:
+        return (node->count == 0) ? nullptr : static_cast<Node4*>(node)->children[node->count - 1];
+    case ART_NODE16:
+        return (node->count == 0) ? nullptr : static_cast<Node16*>(node)->children[node->count - 1];
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        for(int b = 255; b >= 0; --b) {
+            if(n->index[b] != 0) return n->children[n->index[b] - 1];
+        }
+        return nullptr;
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        for(int b = 255; b >= 0; --b) {
+            if(n->children[b] != nullptr) return n->children[b];
+        }
+        return nullptr;
+    }
+    }
+}
+
+// smallest key under node. a terminal is shorter than everything below it, so it comes first
+template<class Key, class Value>
+typename ArtTree<Key, Value>::Leaf* ArtTree<Key, Value>::minLeaf(ArtNode* node)
+{
+    while(node->type != ART_LEAF) {
+        Inner* inner = static_cast<Inner*>(node);
+        if(inner->terminal != nullptr) {
+            return inner->terminal;
+        }
+        node = firstChild(inner);
+    }
+    return static_cast<Leaf*>(node);
+}
+
+// biggest key under node, down the last kids (the terminal only if there aren't any)
+template<class Key, class Value>
+typename ArtTree<Key, Value>::Leaf* ArtTree<Key, Value>::maxLeaf(ArtNode* node)
+{
+    while(node->type != ART_LEAF) {
+        Inner* inner = static_cast<Inner*>(node);
+        ArtNode* last = lastChild(inner);
+        if(last == nullptr) {
+            return inner->terminal;
+        }
+        node = last;
+    }
+    return static_cast<Leaf*>(node);
+}
+
+// how many of node's prefix bytes match bytes from depth on (running out of bytes is a mismatch)
+template<class Key, class Value>
+uint32_t ArtTree<Key, Value>::prefixMismatch(Inner* node, const std::string& bytes, size_t depth)
+{
+    const std::string* full = nullptr;
+    for(uint32_t i = 0; i < node->prefixLen; ++i) {
+        if(depth + i >= bytes.size()) {
+            return i;
+        }
+        if(i >= MAX_PREFIX && full == nullptr) {
+            full = &minLeaf(node)->bytes;
+        }
+        uint8_t have = (i < MAX_PREFIX) ? node->prefix[i] : (uint8_t)(*full)[depth + i];
+        if(have != (uint8_t)bytes[depth + i]) {
+            return i;
+        }
+    }
+    return node->prefixLen;
+}
+
+template<class Key, class Value>
+void ArtTree<Key, Value>::copyHeader(Inner* to, const Inner* from)
+{
+    to->count = from->count;
+    to->prefixLen = from->prefixLen;
+    memcpy(to->prefix, from->prefix, MAX_PREFIX);
+    to->terminal = from->terminal;
+}
+
+// adds child under byte to the inner node at *ref, moving it to the next size up when it's full
+template<class Key, class Value>
+void ArtTree<Key, Value>::addChild(ArtNode** ref, uint8_t byte, ArtNode* child)
+{
+    Inner* node = static_cast<Inner*>(*ref);
+    switch(node->type) {
+    case ART_NODE4: {
+        Node4* n = static_cast<Node4*>(node);
+        if(n->count < 4) {
+            int i = n->count;
+            while(i > 0 && n->keys[i - 1] > byte) {
+                n->keys[i] = n->keys[i - 1];
+                n->children[i] = n->children[i - 1];
+                --i;
+            }
+            n->keys[i] = byte;
+            n->children[i] = child;
+            ++n->count;
+            return;
+        }
+        Node16* bigger = new Node16();
+        copyHeader(bigger, n);
+        memcpy(bigger->keys, n->keys, sizeof(n->keys));
+        memcpy(bigger->children, n->children, sizeof(n->children));
+        *ref = bigger;
+        delete n;
+        addChild(ref, byte, child);
+        return;
+    }
+    case ART_NODE16: {
+        Node16* n = static_cast<Node16*>(node);
+        if(n->count < 16) {
+            int i = n->count;
+            while(i > 0 && n->keys[i - 1] > byte) {
+                n->keys[i] = n->keys[i - 1];
+                n->children[i] = n->children[i - 1];
+                --i;
+            }
+            n->keys[i] = byte;
+            n->children[i] = child;
+            ++n->count;
+            return;
+        }
+        Node48* bigger = new Node48();
+        copyHeader(bigger, n);
+        for(int i = 0; i < 16; ++i) {
+            bigger->index[n->keys[i]] = (uint8_t)(i + 1);
+            bigger->children[i] = n->children[i];
+        }
+        *ref = bigger;
+        delete n;
+        addChild(ref, byte, child);
+        return;
+    }
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        if(n->count < 48) {
+            int slot = 0;
+            while(n->children[slot] != nullptr) {
+                ++slot;
+            }
+            n->index[byte] = (uint8_t)(slot + 1);
+            n->children[slot] = child;
+            ++n->count;
+            return;
+        }
+        Node256* bigger = new Node256();
+        copyHeader(bigger, n);
+        for(int b = 0; b < 256; ++b) {
+            if(n->index[b] != 0) {
+                bigger->children[b] = n->children[n->index[b] - 1];
+            }
+        }
+        *ref = bigger;
+        delete n;
+        addChild(ref, byte, child);
+        return;
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        n->children[byte] = child;
+        ++n->count;
+        return;
+    }
+    }
+}
+
+// takes the kid under byte out of the inner node at *ref, then lets shrink tidy up
+template<class Key, class Value>
+void ArtTree<Key, Value>::removeChild(ArtNode** ref, uint8_t byte)
+{
+    Inner* node = static_cast<Inner*>(*ref);
+    switch(node->type) {
+    case ART_NODE4:
+    case ART_NODE16: {
+        uint8_t* keys = (node->type == ART_NODE4) ? static_cast<Node4*>(node)->keys : static_cast<Node16*>(node)->keys;
+        ArtNode** children = (node->type == ART_NODE4) ? static_cast<Node4*>(node)->children : static_cast<Node16*>(node)->children;
+        int i = 0;
+        while(keys[i] != byte) {
+            ++i;
+        }
+        for(; i + 1 < node->count; ++i) {
+            keys[i] = keys[i + 1];
+            children[i] = children[i + 1];
+        }
+        break;
+    }
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        n->children[n->index[byte] - 1] = nullptr;
+        n->index[byte] = 0;
+        break;
+    }
+    default:
+        static_cast<Node256*>(node)->children[byte] = nullptr;
+        break;
+    }
+    --node->count;
+    shrink(ref);
+}
+
+// moves the inner node at *ref down a size once it's well under the smaller
+// one's capacity (not right at it, so a key going in and out doesn't flip it
+// back and forth), and folds a Node4 into what's under it once it stops branching
+template<class Key, class Value>
+void ArtTree<Key, Value>::shrink(ArtNode** ref)
+{
+    Inner* node = static_cast<Inner*>(*ref);
+    switch(node->type) {
+    case ART_NODE4: {
+        Node4* n = static_cast<Node4*>(node);
+        if(n->count == 0) {
+            *ref = n->terminal;
+            delete n;
+        }
+        else if(n->count == 1 && n->terminal == nullptr) {
+            ArtNode* child = n->children[0];
+            if(child->type != ART_LEAF) {
+                // child's prefix becomes n's prefix + the byte + child's prefix
+                Inner* below = static_cast<Inner*>(child);
+                uint8_t joined[MAX_PREFIX];
+                uint32_t len = (n->prefixLen < MAX_PREFIX) ? n->prefixLen : MAX_PREFIX;
+                memcpy(joined, n->prefix, len);
+                if(len < MAX_PREFIX) {
+                    joined[len++] = n->keys[0];
+                }
+                uint32_t fromBelow = MAX_PREFIX - len;
+                if(fromBelow > below->prefixLen) {
+                    fromBelow = below->prefixLen;
+                }
+                memcpy(joined + len, below->prefix, fromBelow);
+                memcpy(below->prefix, joined, len + fromBelow);
+                below->prefixLen += n->prefixLen + 1;
+            }
+            *ref = child;
+            delete n;
+        }
+        return;
+    }
+    case ART_NODE16: {
+        Node16* n = static_cast<Node16*>(node);
+        if(n->count > 3) {
+            return;
+        }
+        Node4* smaller = new Node4();
+        copyHeader(smaller, n);
+        memcpy(smaller->keys, n->keys, n->count);
+        memcpy(smaller->children, n->children, n->count * sizeof(ArtNode*));
+        *ref = smaller;
+        delete n;
+        return;
+    }
+    case ART_NODE48: {
+        Node48* n = static_cast<Node48*>(node);
+        if(n->count > 12) {
+            return;
+        }
+        Node16* smaller = new Node16();
+        copyHeader(smaller, n);
+        int at = 0;
+        for(int b = 0; b < 256; ++b) {
+            if(n->index[b] != 0) {
+                smaller->keys[at] = (uint8_t)b;
+                smaller->children[at] = n->children[n->index[b] - 1];
+                ++at;
+            }
+        }
+        *ref = smaller;
+        delete n;
+        return;
+    }
+    default: {
+        Node256* n = static_cast<Node256*>(node);
+        if(n->count > 37) {
+            return;
+        }
+        Node48* smaller = new Node48();
+        copyHeader(smaller, n);
+        int slot = 0;
+        for(int b = 0; b < 256; ++b) {
+            if(n->children[b] != nullptr) {
+                smaller->index[b] = (uint8_t)(slot + 1);
+                smaller->children[slot++] = n->children[b];
+            }
+        }
+        *ref = smaller;
+        delete n;
+        return;
+    }
+    }
+}
+
+// the nodes aren't virtual (keeps them small), so delete through the right type
+template<class Key, class Value>
+void ArtTree<Key, Value>::deleteNode(ArtNode* node)
+{
+    switch(node->type) {
+    case ART_LEAF: delete static_cast<Leaf*>(node); break;
+    case ART_NODE4: delete static_cast<Node4*>(node); break;
+    case ART_NODE16: delete static_cast<Node16*>(node); break;
+    case ART_NODE48: delete static_cast<Node48*>(node); break;
+    default: delete static_cast<Node256*>(node); break;
+    }
+}
+
+#endif
@@ -0,0 +1,240 @@
+#include <iostream>
+#include <map>
+#include <string>
+#include <cstdlib>
+#include "augavlbst.h"
+#include "test-check.h"
+
+using namespace std;
+
+// the keys in order, so a range aggregate only comes out right if the
+// pieces get combined left to right (combine isn't commutative)
+struct KeyListMonoid
+{
+    typedef string type;
+    static type identity() { return ""; }
+    static type lift(const int& key, const int&) { return to_string(key) + " "; }
+    static type combine(const type& a, const type& b) { return a + b; }
+};
+
+// exposes the nodes so every stored aggregate can be checked against its kids
+template<class Monoid>
+struct AugPeek : public AugmentedAVLTree<int, int, Monoid>
+{
+    typedef AugmentedAVLTree<int, int, Monoid> Base;
+
+    bool aggregatesOk() const
+    {
+        return subtreeOk(static_cast<typename Base::AugNode*>(this->root_));
+    }
+
+    static bool subtreeOk(typename Base::AugNode* node)
+    {
+        if(node == nullptr) {
+            return true;
+        }
+        typename Base::Aggregate expect = Monoid::combine(
+            Monoid::combine(Base::aggregateOf(node->getLeft()), Base::liftOf(node)),
+            Base::aggregateOf(node->getRight()));
+        return node->getAggregate() == expect && subtreeOk(node->getLeft()) && subtreeOk(node->getRight());
+    }
+};
+
+typedef AugPeek<KeyListMonoid> ListTree;
+typedef AugPeek<SumMonoid<long> > SumTree;
+
+string listOf(const map<int,int>& model, int lo, int hi)
+{
+    string out;
+    for(map<int,int>::const_iterator it = model.lower_bound(lo); it != model.end() && it->first < hi; ++it) {
+        out += to_string(it->first) + " ";
+    }
+    return out;
+}
+
+// every stored aggregate is right, the tree is a valid AVL tree, and a
+// handful of ranges (plus the whole tree) agree with model
+bool agrees(const ListTree& tree, const map<int,int>& model)
+{
+    if(!tree.validate() || !tree.aggregatesOk()) {
+        return false;
+    }
+    if(tree.aggregate() != listOf(model, -1000000, 1000000)) {
+        return false;
+    }
+    for(int i = 0; i < 10; ++i) {
+        int lo = rand() % 1200 - 100;
+        int hi = lo + rand() % 400 - 50;
+        if(tree.aggregate(lo, hi) != listOf(model, lo, hi)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void testRanges()
+{
+    cout << "aggregate(lo, hi)" << endl;
+    ListTree tree;
+    CHECK(tree.aggregate() == "" && tree.aggregate(0, 10) == "");
+
+    map<int,int> model;
+    for(int i = 0; i < 20; ++i) {
+        tree.insert(make_pair(i * 5, i));
+        model[i * 5] = i;
+    }
+    CHECK(tree.aggregate(10, 25) == "10 15 20 ");  // lo is in, hi is out
+    CHECK(tree.aggregate(11, 14) == "");           // between two keys
+    CHECK(tree.aggregate(10, 10) == "");           // empty range
+    CHECK(tree.aggregate(30, 10) == "");           // backwards range
+    CHECK(tree.aggregate(-50, 1) == "0 ");
+    CHECK(tree.aggregate(95, 1000) == "95 ");
+    CHECK(tree.aggregate(-50, 1000) == tree.aggregate());
+
+    SumTree sums;
+    long total = 0;
+    for(int i = 1; i <= 100; ++i) {
+        sums.insert(make_pair(i, i));
+        total += i;
+    }
+    CHECK(sums.aggregate() == total);
+    CHECK(sums.aggregate(1, 11) == 55);
+    CHECK(sums.aggregate(50, 51) == 50);
+
+    // overwriting a value through insert fixes the aggregates above it
+    sums.insert(make_pair(50, 1000));
+    CHECK(sums.aggregatesOk() && sums.aggregate(50, 51) == 1000);
+    CHECK(sums.aggregate() == total - 50 + 1000);
+}
+
+// random inserts and removes go through every rotation case
+void testAfterRotations()
+{
+    cout << "aggregates after inserts/removes" << endl;
+    srand(35);
+    ListTree tree;
+    map<int,int> model;
+    for(int step = 0; step < 3000; ++step) {
+        int key = rand() % 1000;
+        if(rand() % 3 == 0) {
+            tree.remove(key);
+            model.erase(key);
+        }
+        else {
+            tree.insert(make_pair(key, step));
+            model[key] = step;
+        }
+        if(step % 50 == 0) {
+            CHECK(agrees(tree, model));
+        }
+    }
+    CHECK(agrees(tree, model));
+
+    // sorted runs are the worst case for rotations
+    ListTree sorted;
+    map<int,int> sortedModel;
+    for(int i = 0; i < 500; ++i) {
+        sorted.insert(make_pair(i, i));
+        sortedModel[i] = i;
+    }
+    for(int i = 499; i >= 0; i -= 2) {
+        sorted.remove(i);
+        sortedModel.erase(i);
+    }
+    CHECK(agrees(sorted, sortedModel));
+}
+
+void testBulkOperations()
+{
+    cout << "aggregates after eraseRange/merge/removeIf" << endl;
+    srand(36);
+    ListTree tree;
+    map<int,int> model;
+    for(int i = 0; i < 600; ++i) {
+        int key = rand() % 1000;
+        tree.insert(make_pair(key, i));
+        model[key] = i;
+    }
+
+    for(int cut = 0; cut < 10; ++cut) {
+        int lo = rand() % 1000;
+        int hi = lo + rand() % 80;
+        tree.eraseRange(lo, hi);
+        model.erase(model.lower_bound(lo), model.lower_bound(hi));
+        CHECK(agrees(tree, model));
+    }
+
+    ListTree other;
+    for(int i = 0; i < 400; ++i) {
+        int key = rand() % 1000;
+        other.insert(make_pair(key, -i));
+    }
+    // MERGE_KEEP_OTHER is the default, so other's values win on shared keys
+    for(ListTree::iterator it = other.begin(); it != other.end(); ++it) {
+        model[it->first] = it->second;
+    }
+    tree.merge(other);
+    CHECK(other.empty());
+    CHECK(agrees(tree, model));
+    for(map<int,int>::iterator it = model.begin(); it != model.end(); ++it) {
+        CHECK(tree[it->first] == it->second);
+    }
+
+    size_t removed = tree.removeIf([](const pair<const int,int>& item) { return item.first % 3 == 0; });
+    size_t expected = 0;
+    for(map<int,int>::iterator it = model.begin(); it != model.end(); ) {
+        if(it->first % 3 == 0) {
+            it = model.erase(it);
+            ++expected;
+        }
+        else {
+            ++it;
+        }
+    }
+    CHECK(removed == expected);
+    CHECK(agrees(tree, model));
+}
+
+// lazily deleted items are still nodes in the tree but mustn't count
+void testTombstones()
+{
+    cout << "tombstones in aggregates" << endl;
+    ListTree tree;
+    SumTree sums;
+    map<int,int> model;
+    tree.setLazyDelete(true, 0.9);  // high ratio so nothing gets compacted yet
+    sums.setLazyDelete(true, 0.9);
+    for(int i = 0; i < 100; ++i) {
+        tree.insert(make_pair(i, i));
+        sums.insert(make_pair(i, 1));
+        model[i] = i;
+    }
+    for(int i = 0; i < 100; i += 4) {
+        tree.remove(i);
+        sums.remove(i);
+        model.erase(i);
+    }
+    CHECK(agrees(tree, model));
+    CHECK(sums.aggregatesOk() && sums.aggregate() == 75);
+    CHECK(sums.aggregate(0, 4) == 3);
+    CHECK(tree.aggregate(0, 5) == "1 2 3 ");
+
+    // bringing one back counts it again
+    tree.insert(make_pair(4, 4));
+    sums.insert(make_pair(4, 1));
+    model[4] = 4;
+    CHECK(agrees(tree, model));
+    CHECK(sums.aggregate() == 76);
+
+    tree.compact();
+    CHECK(agrees(tree, model));
+}
+
+int main()
+{
+    testRanges();
+    testAfterRotations();
+    testBulkOperations();
+    testTombstones();
+    return checkResult();
+}
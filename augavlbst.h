@@ -0,0 +1,337 @@
+#ifndef AUGAVLBST_H
+#define AUGAVLBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstddef>
+#include <limits>
+#include <utility>
+#include "avlbst.h"
+
+/*
+  Monoids for AugmentedAVLTree. A monoid is any struct with
+    typedef ... type;
+    static type identity();
+    static type lift(const Key& key, const Value& value);   // one item on its own
+    static type combine(const type& a, const type& b);     // a's items come before b's
+  where combine is associative and identity really is one. combine doesn't
+  have to be commutative, the tree always combines in key order.
+*/
+
+/**
+* Sum of the values.
+*/
+template<typename Value>
+struct SumMonoid
+{
+    typedef Value type;
+    static type identity() { return Value(); }
+    template<typename Key>
+    static type lift(const Key&, const Value& value) { return value; }
+    static type combine(const type& a, const type& b) { return a + b; }
+};
+
+/**
+* Smallest value (numeric_limits max when there's nothing).
+*/
+template<typename Value>
+struct MinMonoid
+{
+    typedef Value type;
+    static type identity() { return std::numeric_limits<Value>::max(); }
+    template<typename Key>
+    static type lift(const Key&, const Value& value) { return value; }
+    static type combine(const type& a, const type& b) { return (b < a) ? b : a; }
+};
+
+/**
+* Largest value (numeric_limits lowest when there's nothing).
+*/
+template<typename Value>
+struct MaxMonoid
+{
+    typedef Value type;
+    static type identity() { return std::numeric_limits<Value>::lowest(); }
+    template<typename Key>
+    static type lift(const Key&, const Value& value) { return value; }
+    static type combine(const type& a, const type& b) { return (a < b) ? b : a; }
+};
+
+/**
+* How many items there are.
+*/
+struct CountMonoid
+{
+    typedef size_t type;
+    static type identity() { return 0; }
+    template<typename Key, typename Value>
+    static type lift(const Key&, const Value&) { return 1; }
+    static type combine(const type& a, const type& b) { return a + b; }
+};
+
+/**
+* Two monoids at once, e.g. PairMonoid<SumMonoid<double>, CountMonoid> for a
+* mean, or PairMonoid<MinMonoid<int>, MaxMonoid<int> > for a range. Nest them
+* for more than two.
+*/
+template<typename First, typename Second>
+struct PairMonoid
+{
+    typedef std::pair<typename First::type, typename Second::type> type;
+    static type identity() { return type(First::identity(), Second::identity()); }
+    template<typename Key, typename Value>
+    static type lift(const Key& key, const Value& value)
+    {
+        return type(First::lift(key, value), Second::lift(key, value));
+    }
+    static type combine(const type& a, const type& b)
+    {
+        return type(First::combine(a.first, b.first), Second::combine(a.second, b.second));
+    }
+};
+
+/**
+* An AVLNode that also keeps the monoid aggregate of its whole subtree.
+*/
+template <typename Key, typename Value, typename Aggregate>
+class AugAVLNode : public AVLNode<Key, Value>
+{
+public:
+    AugAVLNode(const Key& key, const Value& value, AugAVLNode<Key, Value, Aggregate>* parent, const Aggregate& aggregate);
+    virtual ~AugAVLNode();
+
+    const Aggregate& getAggregate() const;
+    void setAggregate(const Aggregate& aggregate);
+    virtual size_t footprint() const override;
+
+    virtual AugAVLNode<Key, Value, Aggregate>* getParent() const override;
+    virtual AugAVLNode<Key, Value, Aggregate>* getLeft() const override;
+    virtual AugAVLNode<Key, Value, Aggregate>* getRight() const override;
+
+protected:
+    Aggregate aggregate_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the AugAVLNode class.
+  -------------------------------------------------
+*/
+
+template<class Key, class Value, class Aggregate>
+AugAVLNode<Key, Value, Aggregate>::AugAVLNode(const Key& key, const Value& value, AugAVLNode<Key, Value, Aggregate>* parent, const Aggregate& aggregate) :
+    AVLNode<Key, Value>(key, value, parent), aggregate_(aggregate)
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+AugAVLNode<Key, Value, Aggregate>::~AugAVLNode()
+{
+
+}
+
+template<class Key, class Value, class Aggregate>
+const Aggregate& AugAVLNode<Key, Value, Aggregate>::getAggregate() const
+{
+    return aggregate_;
+}
+
+template<class Key, class Value, class Aggregate>
+void AugAVLNode<Key, Value, Aggregate>::setAggregate(const Aggregate& aggregate)
+{
+    aggregate_ = aggregate;
+}
+
+template<class Key, class Value, class Aggregate>
+size_t AugAVLNode<Key, Value, Aggregate>::footprint() const
+{
+    return sizeof(*this);
+}
+
+template<class Key, class Value, class Aggregate>
+AugAVLNode<Key, Value, Aggregate>* AugAVLNode<Key, Value, Aggregate>::getParent() const
+{
+    return static_cast<AugAVLNode<Key, Value, Aggregate>*>(this->parent_);
+}
+
+template<class Key, class Value, class Aggregate>
+AugAVLNode<Key, Value, Aggregate>* AugAVLNode<Key, Value, Aggregate>::getLeft() const
+{
+    return static_cast<AugAVLNode<Key, Value, Aggregate>*>(this->left_);
+}
+
+template<class Key, class Value, class Aggregate>
+AugAVLNode<Key, Value, Aggregate>* AugAVLNode<Key, Value, Aggregate>::getRight() const
+{
+    return static_cast<AugAVLNode<Key, Value, Aggregate>*>(this->right_);
+}
+
+/*
+  -----------------------------------------------
+  End implementations for the AugAVLNode class.
+  -----------------------------------------------
+*/
+
+/**
+* An AVLTree where every node also stores Monoid's aggregate over its
+* subtree, so aggregate(lo, hi) over any key range is O(log n) instead of
+* a walk over every item in it. The aggregates get fixed up along the
+* insert/remove path (which also covers the nodeSwap removal does) and
+* locally after every rotation, so the usual AVL costs don't change.
+* Changing a value in place through operator[] or an iterator skips all
+* of that, so update values with insert() instead.
+*/
+template <class Key, class Value, class Monoid>
+class AugmentedAVLTree : public AVLTree<Key, Value>
+{
+public:
+    typedef typename Monoid::type Aggregate;
+    typedef AugAVLNode<Key, Value, Aggregate> AugNode;
+
+    Aggregate aggregate() const;
+    Aggregate aggregate(const Key& lo, const Key& hi) const;
+
+protected:
+    virtual AugNode* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual AugNode* cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const std::allocator<std::pair<const Key, Value> >& alloc) const;
+    virtual void afterRotate(Node<Key, Value>* down);
+    virtual void subtreeChanged(Node<Key, Value>* node);
+    virtual void rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight);
+
+    static Aggregate aggregateOf(AugNode* node);
+    static Aggregate liftOf(AugNode* node);
+    static void pull(AugNode* node);
+};
+
+/**
+* Aggregate over the whole tree.
+*/
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate AugmentedAVLTree<Key, Value, Monoid>::aggregate() const
+{
+    return aggregateOf(static_cast<AugNode*>(this->root_));
+}
+
+/**
+* Aggregate over every item with lo <= key < hi, combined in key order.
+* Finds the node where the paths to lo and hi split, then walks each path
+* down once taking whole subtrees that are inside the range, so O(log n).
+*/
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate AugmentedAVLTree<Key, Value, Monoid>::aggregate(const Key& lo, const Key& hi) const
+{
+    AugNode* split = static_cast<AugNode*>(this->root_);
+    while(split != nullptr) {
+        if(split->getKey() < lo) {
+            split = split->getRight();
+        }
+        else if(!(split->getKey() < hi)) {
+            split = split->getLeft();
+        }
+        else {
+            break;
+        }
+    }
+    if(split == nullptr) {
+        return Monoid::identity();
+    }
+
+    // left side, everything >= lo under split's left. built up right to left
+    Aggregate leftPart = Monoid::identity();
+    AugNode* curr = split->getLeft();
+    while(curr != nullptr) {
+        if(curr->getKey() < lo) {
+            curr = curr->getRight();
+        }
+        else {
+            Aggregate here = Monoid::combine(liftOf(curr), aggregateOf(curr->getRight()));
+            leftPart = Monoid::combine(here, leftPart);
+            curr = curr->getLeft();
+        }
+    }
+
+    // right side, everything < hi under split's right. built up left to right
+    Aggregate rightPart = Monoid::identity();
+    curr = split->getRight();
+    while(curr != nullptr) {
+        if(curr->getKey() < hi) {
+            Aggregate here = Monoid::combine(aggregateOf(curr->getLeft()), liftOf(curr));
+            rightPart = Monoid::combine(rightPart, here);
+            curr = curr->getRight();
+        }
+        else {
+            curr = curr->getLeft();
+        }
+    }
+
+    Aggregate middle = liftOf(split);
+    return Monoid::combine(Monoid::combine(leftPart, middle), rightPart);
+}
+
+// new nodes start out as a subtree of one
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::AugNode* AugmentedAVLTree<Key, Value, Monoid>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return this->template makeNode<AugNode>(this->alloc_, key, value, static_cast<AugNode*>(parent), Monoid::lift(key, value));
+}
+
+// copies keep their balance and aggregate as is
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::AugNode* AugmentedAVLTree<Key, Value, Monoid>::cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const std::allocator<std::pair<const Key, Value> >& alloc) const
+{
+    const AugNode* from = static_cast<const AugNode*>(source);
+    AugNode* copy = this->template makeNode<AugNode>(alloc, from->getKey(), from->getValue(), static_cast<AugNode*>(parent), from->getAggregate());
+    copy->setBalance(from->getBalance());
+    return copy;
+}
+
+// a rotation only changes which subtrees down and its new parent cover, everything
+// above them still covers the same items. so just those two, bottom one first
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::afterRotate(Node<Key, Value>* down)
+{
+    pull(static_cast<AugNode*>(down));
+    pull(static_cast<AugNode*>(down->getParent()));
+}
+
+// node's subtree changed, redo it and everything above it (O(height))
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::subtreeChanged(Node<Key, Value>* node)
+{
+    for(AugNode* curr = static_cast<AugNode*>(node); curr != nullptr; curr = curr->getParent()) {
+        pull(curr);
+    }
+}
+
+// rebuilds hand us nodes bottom up, so the kids are already right
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    AVLTree<Key, Value>::rebuiltNode(node, leftHeight, rightHeight);
+    pull(static_cast<AugNode*>(node));
+}
+
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate AugmentedAVLTree<Key, Value, Monoid>::aggregateOf(AugNode* node)
+{
+    return (node == nullptr) ? Monoid::identity() : node->getAggregate();
+}
+
+// node's own item on its own, nothing for a tombstone
+template<class Key, class Value, class Monoid>
+typename AugmentedAVLTree<Key, Value, Monoid>::Aggregate AugmentedAVLTree<Key, Value, Monoid>::liftOf(AugNode* node)
+{
+    return node->isTombstone() ? Monoid::identity() : Monoid::lift(node->getKey(), node->getValue());
+}
+
+// recomputes node's aggregate from its kids (which have to be right already)
+template<class Key, class Value, class Monoid>
+void AugmentedAVLTree<Key, Value, Monoid>::pull(AugNode* node)
+{
+    Aggregate below = Monoid::combine(aggregateOf(node->getLeft()), liftOf(node));
+    node->setAggregate(Monoid::combine(below, aggregateOf(node->getRight())));
+}
+
+#endif
@@ -27,6 +27,7 @@ public:
     int8_t getBalance () const;
     void setBalance (int8_t balance);
     void updateBalance(int8_t diff);
+    virtual size_t footprint() const override;
 
     // Getters for parent, left, and right. These need to be redefined since they
     // return pointers to AVLNodes - not plain Nodes. See the Node class in bst.h
@@ -91,6 +92,15 @@ void AVLNode<Key, Value>::updateBalance(int8_t diff)
     balance_ += diff;
 }
 
+/**
+* sizeof an AVLNode (see Node::footprint).
+*/
+template<class Key, class Value>
+size_t AVLNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
 /**
 * An overridden function for getting the parent since a static_cast is necessary to make sure
 * that our node is a AVLNode.
@@ -127,54 +137,132 @@ AVLNode<Key, Value> *AVLNode<Key, Value>::getRight() const
 */
 
 
-template <class Key, class Value>
-class AVLTree : public BinarySearchTree<Key, Value>
+/**
+* An AVL tree, nodes come from Allocator the same way as BinarySearchTree.
+*/
+template <class Key, class Value, class Allocator = std::allocator<std::pair<const Key, Value> > >
+class AVLTree : public BinarySearchTree<Key, Value, Allocator>
 {
 public:
+    AVLTree();
+    explicit AVLTree(const Allocator& alloc);
     virtual void insert (const std::pair<const Key, Value> &new_item); // TODO
     virtual void remove(const Key& key);  // TODO
+    virtual void eraseRange(const Key& lo, const Key& hi);
 protected:
+    virtual AVLNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual AVLNode<Key, Value>* cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const Allocator& alloc) const;
+    virtual void removeNode(Node<Key, Value>* node);
     virtual void nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2);
 
     // Add helper functions here
+    AVLNode<Key, Value>* insertNode(const std::pair<const Key, Value>& new_item, bool overwrite, bool& added);
     void rotateLeft(AVLNode<Key, Value>* node);
     void rotateRight(AVLNode<Key, Value>* node);
-    void rebalanceUp(AVLNode<Key, Value>* start, int8_t initialDiff, bool stopOnInsertBehavior);
+    bool rebalanceUp(AVLNode<Key, Value>* start, int8_t initialDiff, bool stopOnInsertBehavior);
+    int subtreeHeight(AVLNode<Key, Value>* node) const;
+    void split(AVLNode<Key, Value>* node, int height, const Key& key,
+               AVLNode<Key, Value>*& less, int& lessHeight, AVLNode<Key, Value>*& rest, int& restHeight);
+    AVLNode<Key, Value>* join(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* middle,
+                              AVLNode<Key, Value>* right, int rightHeight, int& height);
+    AVLNode<Key, Value>* extractMax(AVLNode<Key, Value>*& piece, int& pieceHeight);
+    virtual bool checkNode(Node<Key, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const;
+    virtual void rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight);
 
 
 };
 
+template<class Key, class Value, class Allocator>
+AVLTree<Key, Value, Allocator>::AVLTree()
+{
+
+}
+
+template<class Key, class Value, class Allocator>
+AVLTree<Key, Value, Allocator>::AVLTree(const Allocator& alloc) :
+    BinarySearchTree<Key, Value, Allocator>(alloc)
+{
+
+}
+
+// every node an AVLTree makes is an AVLNode, subclasses with fancier nodes override this
+template<class Key, class Value, class Allocator>
+AVLNode<Key, Value>* AVLTree<Key, Value, Allocator>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return this->template makeNode<AVLNode<Key, Value> >(this->alloc_, key, value, static_cast<AVLNode<Key, Value>*>(parent));
+}
+
+// copies keep their balance, the shape they're copied into is identical so it's still right
+template<class Key, class Value, class Allocator>
+AVLNode<Key, Value>* AVLTree<Key, Value, Allocator>::cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const Allocator& alloc) const
+{
+    AVLNode<Key, Value>* copy = this->template makeNode<AVLNode<Key, Value> >(alloc, source->getKey(), source->getValue(), static_cast<AVLNode<Key, Value>*>(parent));
+    copy->setBalance(static_cast<const AVLNode<Key, Value>*>(source)->getBalance());
+    return copy;
+}
+
 /*
  * Recall: If key is already in the tree, you should 
  * overwrite the current value with the updated value.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::insert (const std::pair<const Key, Value> &new_item)
+{
+    LatencyProbe probe(this->latency_, OP_INSERT);
+    BST_STAT(++this->stats_.inserts);
+    bool added;
+    insertNode(new_item, true, added);
+}
+
+// the insert walk, handing back the node that holds the key afterwards. with
+// overwrite false a key that's already there (and alive) keeps its value, so
+// callers like SplitAVLTree can look up or add in one descent; added says
+// which it was. the node stays valid through the rebalancing (rotations
+// move whole nodes)
+template<class Key, class Value, class Allocator>
+AVLNode<Key, Value>* AVLTree<Key, Value, Allocator>::insertNode(const std::pair<const Key, Value>& new_item, bool overwrite, bool& added)
 {
+    added = true;
+
     // if tree is empty, we can just insert at root and skip the rest
     if(this->root_ == NULL) {
-        this->root_ = new AVLNode<Key, Value>(new_item.first, new_item.second, NULL);
-        return;
+        AVLNode<Key, Value>* node = createNode(new_item.first, new_item.second, NULL);
+        this->root_ = node;
+        ++this->size_;
+        this->indexNode(node);
+        return node;
     }
 
-    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->root_); 
+    AVLNode<Key, Value>* curr = static_cast<AVLNode<Key, Value>*>(this->searchStart(new_item.first));
 
     while (true) {
+        BST_STAT(++this->stats_.insertComparisons);
+
         // key already exists so we can just update and return
         if (new_item.first == curr->getKey()) {
-            curr->setValue(new_item.second);
-            return;
+            added = curr->isTombstone();
+            if (overwrite || added) {
+                curr->setValue(new_item.second);
+                this->reviveNode(curr);
+                this->subtreeChanged(curr);
+            }
+            this->moveFinger(curr);
+            return curr;
         } 
         // key is less than current, so go left
         else if (new_item.first < curr->getKey()) {
             // no left child, so we can insert to left
             if (curr->getLeft() == nullptr) {
-                AVLNode<Key, Value>* node = new AVLNode<Key, Value>(new_item.first, new_item.second, curr);
+                AVLNode<Key, Value>* node = createNode(new_item.first, new_item.second, curr);
                 curr->setLeft(node);
+                ++this->size_;
+                this->moveFinger(node);
+                this->indexNode(node);
+                this->subtreeChanged(node);
 
                 // initialDiff should be 1 since we added to the left, make sure to set insertion detector!!!
                 rebalanceUp(curr, 1, true);
-                return;
+                return node;
             } 
             // left child exists
             else {
@@ -184,12 +272,16 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
         // going right since key is greater than current 
         else {
             if (curr->getRight() == nullptr) {
-                AVLNode<Key, Value>* node = new AVLNode<Key, Value>(new_item.first, new_item.second, curr);
+                AVLNode<Key, Value>* node = createNode(new_item.first, new_item.second, curr);
                 curr->setRight(node);
+                ++this->size_;
+                this->moveFinger(node);
+                this->indexNode(node);
+                this->subtreeChanged(node);
 
                 // initialDiff should be -1 since we added to the right, make sure to set insertion detector!!!
                 rebalanceUp(curr, -1, true);
-                return;
+                return node;
             } 
             // right child exists
             else {
@@ -203,14 +295,28 @@ void AVLTree<Key, Value>::insert (const std::pair<const Key, Value> &new_item)
  * Recall: The writeup specifies that if a node has 2 children you
  * should swap with the predecessor and then remove.
  */
-template<class Key, class Value>
-void AVLTree<Key, Value>:: remove(const Key& key)
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>:: remove(const Key& key)
 {
+    LatencyProbe probe(this->latency_, OP_REMOVE);
+
     // error catch if key not in tree already
-    AVLNode<Key, Value>* nodeToRemove = static_cast<AVLNode<Key, Value>*>(this->internalFind(key));
-    if(nodeToRemove == nullptr) {
+    Node<Key, Value>* found = this->internalFind(key);
+    if(found == nullptr) {
         return;
     }
+    this->discardNode(found);
+}
+
+/*
+ * Unlinks and frees a node we already have (remove, erase, etc. all land here),
+ * then rebalances from where it was.
+ */
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::removeNode(Node<Key, Value>* node)
+{
+    AVLNode<Key, Value>* nodeToRemove = static_cast<AVLNode<Key, Value>*>(node);
+    BST_STAT(++this->stats_.removes);
 
     // check to see if nodeToRemove has 2 kids, if so then we swap until there's only <=1 kid associated with it 
     while (nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr) {
@@ -257,95 +363,45 @@ void AVLTree<Key, Value>:: remove(const Key& key)
         }
     }
 
-    delete nodeToRemove;
+    this->freeNode(nodeToRemove);
+    --this->size_;
 
     // now we can rebalance if needed
     if(parent != nullptr){
+        this->subtreeChanged(parent);
         // check which side got shrank, insertion detector CANNOT be set here
         rebalanceUp(parent, (shrunkLeft ? -1 : +1), false); 
     }
 
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateLeft(AVLNode<Key, Value>* node){
-    if (node == nullptr || node->getRight() == nullptr){
-        return;
-    }
-
-    AVLNode<Key, Value>* node2 = node->getRight();
-    AVLNode<Key, Value>* parent = node->getParent();
-
-    // jesus figuring this part out gave me a headache
-    // node2's left child now node's right child
-    node->setRight(node2->getLeft());
-    if(node2->getLeft() != nullptr){
-        node2->getLeft()->setParent(node);
-    }
-
-    // node now node2's left child
-    node2->setLeft(node);
-    node->setParent(node2);
-
-    // clean up parents to maintain AVL tree order/connectivity
-    node2->setParent(parent);
-    if(parent == nullptr){
-        this->root_ = node2;
-    }
-    else if(parent->getLeft() == node){
-        parent->setLeft(node2);
-    }
-    else{
-        parent->setRight(node2);
-    }
+// the pointer shuffling itself lives in BinarySearchTree now so the other trees can share it
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::rotateLeft(AVLNode<Key, Value>* node){
+    BinarySearchTree<Key, Value, Allocator>::rotateLeft(node);
 }
 
-// just a repeat of rotateLeft but reversed left/right
-template<class Key, class Value>
-void AVLTree<Key, Value>::rotateRight(AVLNode<Key, Value>* node){
-    if (node == nullptr || node->getLeft() == nullptr){
-        return;
-    }
-
-    AVLNode<Key, Value>* node2 = node->getLeft(); 
-    AVLNode<Key, Value>* parent = node->getParent();
-
-    // mirrored copy of rotateLeft
-    // node2's right child now node's left child
-    node->setLeft(node2->getRight());
-    if(node2->getRight() != nullptr){
-        node2->getRight()->setParent(node);
-    }
-
-    // node now node2's right child
-    node2->setRight(node);
-    node->setParent(node2);
-
-    // clean up parents to maintain AVL tree order/connectivity
-    node2->setParent(parent);
-    if(parent == nullptr){
-        this->root_ = node2;
-    }
-    else if(parent->getLeft() == node){
-        parent->setLeft(node2);
-    }
-    else{
-        parent->setRight(node2);
-    }
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::rotateRight(AVLNode<Key, Value>* node){
+    BinarySearchTree<Key, Value, Allocator>::rotateRight(node);
 }
 
 // helper function for rebalancing (i got annoyed by repeating my code in insert and remove)
-template<class Key, class Value>
-void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initialDiff, bool stopOnInsertBehavior)
+// returns true if the height change made it all the way out the top (the whole tree grew/shrank)
+template<class Key, class Value, class Allocator>
+bool AVLTree<Key, Value, Allocator>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initialDiff, bool stopOnInsertBehavior)
 {
     if (parent == nullptr) {
-        return;
+        return false;
     }
+    bool reachedTop = false;
+    BST_STAT(++this->stats_.rebalanceCalls);
     
     AVLNode<Key, Value>* child = nullptr; // need this to maintain tree order later
     int8_t diff = initialDiff;
 
     while (parent != nullptr) {
+        BST_STAT(++this->stats_.retraceSteps);
         
         parent->updateBalance(diff);
         int8_t parentBalance = parent->getBalance(); 
@@ -369,6 +425,7 @@ void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initia
             parent = parent->getParent();
 
             if (parent == nullptr){
+                reachedTop = true;
                 break;
             }
 
@@ -391,6 +448,7 @@ void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initia
             // right rotation (zig-zig tests check here!!!)
             if (left->getBalance() >= 0) {
                 rotateRight(parent);
+                BST_STAT(++this->stats_.singleRight);
 
                 // handling a removal
                 if (left->getBalance() == 0) {
@@ -417,6 +475,7 @@ void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initia
                 AVLNode<Key, Value>* LR = left->getRight();
                 rotateLeft(left);
                 rotateRight(parent);
+                BST_STAT(++this->stats_.doubleLeftRight);
 
                 // balance handling post-rotation
                 if (LR->getBalance() == 1) {
@@ -449,6 +508,7 @@ void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initia
             // zig-zig but left this time lol
             if (right->getBalance() <= 0) { 
                 rotateLeft(parent);
+                BST_STAT(++this->stats_.singleLeft);
 
 
                 // removal handling
@@ -480,6 +540,7 @@ void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initia
                 AVLNode<Key, Value>* RL = right->getLeft();
                 rotateRight(right);
                 rotateLeft(parent);
+                BST_STAT(++this->stats_.doubleRightLeft);
 
                 // balance handling post-rotation
                 if (RL->getBalance() == -1) {
@@ -502,22 +563,272 @@ void AVLTree<Key, Value>::rebalanceUp(AVLNode<Key, Value>* parent, int8_t initia
             }
         }
         
-        // height definitely shrank if we made it here, so time to start from the root again
+        // height definitely changed if we made it here (shrank for a removal, or grew when
+        // join() hangs a whole subtree that's balanced 0 underneath), so keep walking up
         AVLNode<Key, Value>* up = child->getParent();
         if (up == nullptr) {
+            reachedTop = true;
             break;
         }
 
         // time to walk up the tree again
         parent = up;
-        diff = (child == parent->getLeft()) ? -1 : 1;
+        if (child == parent->getLeft()) {
+            diff = stopOnInsertBehavior ? 1 : -1;
+        }
+        else {
+            diff = stopOnInsertBehavior ? -1 : 1;
+        }
     }
+    return reachedTop;
 }
 
-template<class Key, class Value>
-void AVLTree<Key, Value>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
+/**
+* Removes every item with lo <= key < hi. Instead of one remove per item,
+* the tree gets split at lo and at hi, the middle piece is freed whole and
+* the two outside pieces are joined back together. Split and join each only
+* walk one root-to-leaf path, so this is O(k + log n) for k removed items.
+*/
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::eraseRange(const Key& lo, const Key& hi)
+{
+    LatencyProbe probe(this->latency_, OP_REMOVE);
+    if(this->root_ == nullptr || !(lo < hi)) {
+        return;
+    }
+
+    AVLNode<Key, Value>* whole = static_cast<AVLNode<Key, Value>*>(this->root_);
+    AVLNode<Key, Value>* less;
+    AVLNode<Key, Value>* rest;
+    AVLNode<Key, Value>* doomed;
+    AVLNode<Key, Value>* more;
+    int lessHeight, restHeight, doomedHeight, moreHeight;
+    split(whole, subtreeHeight(whole), lo, less, lessHeight, rest, restHeight);
+    split(rest, restHeight, hi, doomed, doomedHeight, more, moreHeight);
+
+    this->finger_ = nullptr;
+    this->forgetSubtree(doomed);
+    size_t removed = this->destroySubtree(doomed);
+    this->size_ -= removed;
+    BST_STAT(this->stats_.removes += removed);
+
+    // glue the outsides back together, borrowing the biggest key on the left as the middle node
+    if(less == nullptr) {
+        this->root_ = more;
+    }
+    else {
+        AVLNode<Key, Value>* pivot = extractMax(less, lessHeight);
+        int height;
+        this->root_ = join(less, lessHeight, pivot, more, moreHeight, height);
+    }
+    if(this->root_ != nullptr) {
+        this->root_->setParent(nullptr);
+    }
+    this->findExtremes();
+}
+
+// height of a subtree straight from the balance factors, just follows the taller side down
+template<class Key, class Value, class Allocator>
+int AVLTree<Key, Value, Allocator>::subtreeHeight(AVLNode<Key, Value>* node) const
+{
+    int height = 0;
+    while(node != nullptr) {
+        ++height;
+        node = (node->getBalance() >= 0) ? node->getLeft() : node->getRight();
+    }
+    return height;
+}
+
+// splits the detached subtree at node (height tall) into keys < key and keys >= key,
+// handing back each piece with its height. the pieces get put together with join(),
+// and the join costs telescope so the whole split is O(height)
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::split(AVLNode<Key, Value>* node, int height, const Key& key,
+                                AVLNode<Key, Value>*& less, int& lessHeight, AVLNode<Key, Value>*& rest, int& restHeight)
+{
+    if(node == nullptr) {
+        less = rest = nullptr;
+        lessHeight = restHeight = 0;
+        return;
+    }
+
+    // the kids' heights fall right out of the balance factor
+    AVLNode<Key, Value>* left = node->getLeft();
+    AVLNode<Key, Value>* right = node->getRight();
+    int leftHeight = (node->getBalance() >= 0) ? height - 1 : height - 2;
+    int rightHeight = (node->getBalance() <= 0) ? height - 1 : height - 2;
+
+    // cut node loose, join() hooks it back up on whichever side it belongs
+    node->setLeft(nullptr);
+    node->setRight(nullptr);
+    if(left != nullptr) {
+        left->setParent(nullptr);
+    }
+    if(right != nullptr) {
+        right->setParent(nullptr);
+    }
+
+    if(node->getKey() < key) {
+        // node and everything left of it are < key, the cut is somewhere on the right
+        AVLNode<Key, Value>* smaller;
+        int smallerHeight;
+        split(right, rightHeight, key, smaller, smallerHeight, rest, restHeight);
+        less = join(left, leftHeight, node, smaller, smallerHeight, lessHeight);
+    }
+    else {
+        AVLNode<Key, Value>* bigger;
+        int biggerHeight;
+        split(left, leftHeight, key, less, lessHeight, bigger, biggerHeight);
+        rest = join(bigger, biggerHeight, node, right, rightHeight, restHeight);
+    }
+}
+
+// joins left (every key < middle), middle, and right (every key > middle) into one
+// AVL subtree in O(|leftHeight - rightHeight| + 1) and returns it with its height.
+// middle goes down the taller side's spine to where the heights match, then it's
+// rebalanced like an insert. rotations at the top update root_, so root_ is scratch
+// space here; only use this on pieces that are cut off from the real tree
+template<class Key, class Value, class Allocator>
+AVLNode<Key, Value>* AVLTree<Key, Value, Allocator>::join(AVLNode<Key, Value>* left, int leftHeight, AVLNode<Key, Value>* middle,
+                                               AVLNode<Key, Value>* right, int rightHeight, int& height)
+{
+    // left is taller, walk its right spine down
+    if(leftHeight > rightHeight + 1) {
+        AVLNode<Key, Value>* above = nullptr;
+        AVLNode<Key, Value>* spine = left;
+        int spineHeight = leftHeight;
+        while(spineHeight > rightHeight + 1) {
+            int next = (spine->getBalance() <= 0) ? spineHeight - 1 : spineHeight - 2;
+            above = spine;
+            spine = spine->getRight();
+            spineHeight = next;
+        }
+
+        middle->setLeft(spine);
+        middle->setRight(right);
+        if(spine != nullptr) {
+            spine->setParent(middle);
+        }
+        if(right != nullptr) {
+            right->setParent(middle);
+        }
+        middle->setBalance(spineHeight - rightHeight);
+        middle->setParent(above);
+        above->setRight(middle);
+        this->subtreeChanged(middle);
+
+        // above's right side just got one taller, same as after an insert
+        this->root_ = left;
+        bool grew = rebalanceUp(above, -1, true);
+        height = leftHeight + (grew ? 1 : 0);
+        return static_cast<AVLNode<Key, Value>*>(this->root_);
+    }
+
+    // mirror image, right is taller
+    if(rightHeight > leftHeight + 1) {
+        AVLNode<Key, Value>* above = nullptr;
+        AVLNode<Key, Value>* spine = right;
+        int spineHeight = rightHeight;
+        while(spineHeight > leftHeight + 1) {
+            int next = (spine->getBalance() >= 0) ? spineHeight - 1 : spineHeight - 2;
+            above = spine;
+            spine = spine->getLeft();
+            spineHeight = next;
+        }
+
+        middle->setLeft(left);
+        middle->setRight(spine);
+        if(left != nullptr) {
+            left->setParent(middle);
+        }
+        if(spine != nullptr) {
+            spine->setParent(middle);
+        }
+        middle->setBalance(leftHeight - spineHeight);
+        middle->setParent(above);
+        above->setLeft(middle);
+        this->subtreeChanged(middle);
+
+        this->root_ = right;
+        bool grew = rebalanceUp(above, 1, true);
+        height = rightHeight + (grew ? 1 : 0);
+        return static_cast<AVLNode<Key, Value>*>(this->root_);
+    }
+
+    // close enough in height, middle just goes on top
+    middle->setLeft(left);
+    middle->setRight(right);
+    if(left != nullptr) {
+        left->setParent(middle);
+    }
+    if(right != nullptr) {
+        right->setParent(middle);
+    }
+    middle->setParent(nullptr);
+    middle->setBalance(leftHeight - rightHeight);
+    this->subtreeChanged(middle);
+    height = 1 + std::max(leftHeight, rightHeight);
+    return middle;
+}
+
+// unhooks the biggest node from a detached piece, rebalancing the piece (and its
+// height) as it goes. same root_ caveat as join()
+template<class Key, class Value, class Allocator>
+AVLNode<Key, Value>* AVLTree<Key, Value, Allocator>::extractMax(AVLNode<Key, Value>*& piece, int& pieceHeight)
+{
+    AVLNode<Key, Value>* node = piece;
+    while(node->getRight() != nullptr) {
+        node = node->getRight();
+    }
+
+    AVLNode<Key, Value>* parent = node->getParent();
+    AVLNode<Key, Value>* child = node->getLeft();
+    if(child != nullptr) {
+        child->setParent(parent);
+    }
+
+    if(parent == nullptr) {
+        piece = child;
+        --pieceHeight;
+    }
+    else {
+        parent->setRight(child);
+        this->subtreeChanged(parent);
+        this->root_ = piece;
+        if(rebalanceUp(parent, 1, false)) {
+            --pieceHeight;
+        }
+        piece = static_cast<AVLNode<Key, Value>*>(this->root_);
+    }
+
+    node->setLeft(nullptr);
+    node->setParent(nullptr);
+    node->setBalance(0);
+    return node;
+}
+
+// rebuilds (merge) hand every node over bottom up with its kids' heights,
+// which is all the balance is
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    static_cast<AVLNode<Key, Value>*>(node)->setBalance(leftHeight - rightHeight);
+}
+
+// validate() hook: the stored balance has to be left height - right height, and in [-1, 1]
+template<class Key, class Value, class Allocator>
+bool AVLTree<Key, Value, Allocator>::checkNode(Node<Key, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const
+{
+    (void)leftRank;
+    (void)rightRank;
+    int balance = static_cast<AVLNode<Key, Value>*>(node)->getBalance();
+    return balance == leftHeight - rightHeight && balance >= -1 && balance <= 1;
+}
+
+template<class Key, class Value, class Allocator>
+void AVLTree<Key, Value, Allocator>::nodeSwap( AVLNode<Key,Value>* n1, AVLNode<Key,Value>* n2)
 {
-    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    BinarySearchTree<Key, Value, Allocator>::nodeSwap(n1, n2);
     int8_t temparentBalance = n1->getBalance();
     n1->setBalance(n2->getBalance());
     n2->setBalance(temparentBalance);
@@ -1,10 +1,1421 @@
 #include <iostream>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
 #include <map>
+#if __cplusplus >= 201703L
+#include <memory_resource>
+#endif
+#include <sstream>
+#include <string>
+#include <cstdlib>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#include <vector>
 #include "bst.h"
 #include "avlbst.h"
+#include "rbbst.h"
+#include "splaybst.h"
+#include "test-check.h"
 
 using namespace std;
 
+template<class Tree>
+void fill(Tree& tree, map<int,int>& model, int count, int step)
+{
+    for(int i = 0; i < count; ++i) {
+        tree.insert(make_pair(i * step, i));
+        model[i * step] = i;
+    }
+}
+
+// eraseRange(lo, hi) drops lo <= key < hi. AVLTree does it by split/join,
+// the base class one erase at a time, so run both against std::map
+template<class Tree>
+void testEraseRange(const char* name)
+{
+    cout << "eraseRange (" << name << ")" << endl;
+
+    Tree empty;
+    empty.eraseRange(0, 10);
+    CHECK(empty.empty() && empty.validate());
+
+    Tree tree;
+    map<int,int> model;
+    fill(tree, model, 50, 2);   // 0, 2, ..., 98
+
+    tree.eraseRange(10, 10);    // lo == hi is an empty range
+    tree.eraseRange(20, 10);    // so is lo > hi
+    CHECK(sameAs(tree, model));
+
+    tree.eraseRange(11, 12);    // nothing between 10 and 12
+    CHECK(sameAs(tree, model));
+
+    tree.eraseRange(10, 20);    // lo is a key and goes, hi is a key and stays
+    model.erase(model.lower_bound(10), model.lower_bound(20));
+    CHECK(sameAs(tree, model));
+    CHECK(tree.find(20) != tree.end() && tree.find(10) == tree.end());
+
+    tree.eraseRange(-100, 1);   // just the smallest key
+    model.erase(0);
+    CHECK(sameAs(tree, model));
+
+    tree.eraseRange(98, 1000);  // just the largest key
+    model.erase(98);
+    CHECK(sameAs(tree, model));
+
+    tree.eraseRange(-1000, 1000);   // the whole tree
+    CHECK(tree.empty() && tree.begin() == tree.end() && tree.validate());
+
+    // random ranges over random trees, every size up to a few hundred
+    // so split/join see all kinds of height differences
+    srand(33);
+    for(int round = 0; round < 200; ++round) {
+        Tree t;
+        map<int,int> m;
+        int count = rand() % 300;
+        for(int i = 0; i < count; ++i) {
+            int key = rand() % 1000;
+            t.insert(make_pair(key, i));
+            m[key] = i;
+        }
+        for(int cut = 0; cut < 5; ++cut) {
+            int lo = rand() % 1100 - 50;
+            int hi = lo + rand() % 300;
+            t.eraseRange(lo, hi);
+            m.erase(m.lower_bound(lo), m.lower_bound(hi));
+            CHECK(sameAs(t, m));
+        }
+        // the tree still works normally afterwards
+        for(int i = 0; i < 20; ++i) {
+            int key = rand() % 1000;
+            t.insert(make_pair(key, -i));
+            m[key] = -i;
+        }
+        CHECK(sameAs(t, m));
+    }
+}
+
+// erase(iterator) hands back the next item, erase(first, last) stops at last
+void testEraseIterators()
+{
+    cout << "erase(iterator)" << endl;
+    AVLTree<int,int> tree;
+    map<int,int> model;
+    fill(tree, model, 100, 1);
+
+    AVLTree<int,int>::iterator next = tree.erase(tree.find(40));
+    model.erase(40);
+    CHECK(next != tree.end() && next->first == 41);
+    CHECK(tree.erase(tree.find(99)) == tree.end());
+    model.erase(99);
+
+    next = tree.erase(tree.find(10), tree.find(30));
+    model.erase(model.find(10), model.find(30));
+    CHECK(next != tree.end() && next->first == 30);
+    CHECK(sameAs(tree, model));
+
+    CHECK(tree.erase(tree.begin(), tree.end()) == tree.end());
+    CHECK(tree.empty() && tree.validate());
+}
+
+// lets the checks see inside: where the finger is, and how many nodes
+// (live or not) and tombstones there are
+template<class Tree>
+struct TreePeek : public Tree
+{
+    TreePeek() { }
+    explicit TreePeek(const decltype(std::declval<Tree>().getAllocator())& alloc) : Tree(alloc) { }
+
+    Node<int,int>* finger() const { return this->finger_; }
+    Node<int,int>* root() const { return this->root_; }
+    size_t nodes() const { return this->size_; }
+    size_t tombstones() const { return this->tombstones_; }
+
+    // how many edges down from the root key is, -1 if it isn't there
+    int depth(int key) const
+    {
+        int edges = 0;
+        for(Node<int,int>* curr = this->root_; curr != nullptr; ++edges) {
+            if(curr->getKey() == key) {
+                return edges;
+            }
+            curr = (key < curr->getKey()) ? curr->getLeft() : curr->getRight();
+        }
+        return -1;
+    }
+
+    // the cached min_/max_ are the ends of the two spines
+    bool extremesOk() const
+    {
+        Node<int,int>* low = this->root_;
+        Node<int,int>* high = this->root_;
+        while(low != nullptr && low->getLeft() != nullptr) {
+            low = low->getLeft();
+        }
+        while(high != nullptr && high->getRight() != nullptr) {
+            high = high->getRight();
+        }
+        return this->min_ == low && this->max_ == high;
+    }
+};
+
+// an AVL node's stored balance, 0 for any other kind of node
+template<class Key, class Value>
+int balanceOf(Node<Key,Value>* node)
+{
+    AVLNode<Key,Value>* avl = dynamic_cast<AVLNode<Key,Value>*>(node);
+    return avl == nullptr ? 0 : avl->getBalance();
+}
+
+// a and b hold the same keys and values in exactly the same shape (with
+// the same balances, for AVL nodes)
+template<class Key, class Value>
+bool sameShape(Node<Key,Value>* a, Node<Key,Value>* b)
+{
+    vector<pair<Node<Key,Value>*, Node<Key,Value>*> > stack(1, make_pair(a, b));
+    while(!stack.empty()) {
+        Node<Key,Value>* x = stack.back().first;
+        Node<Key,Value>* y = stack.back().second;
+        stack.pop_back();
+        if(x == nullptr || y == nullptr) {
+            if(x != y) {
+                return false;
+            }
+            continue;
+        }
+        if(x == y || !(x->getKey() == y->getKey()) || !(x->getValue() == y->getValue()) ||
+           x->isTombstone() != y->isTombstone() || balanceOf(x) != balanceOf(y)) {
+            return false;
+        }
+        stack.push_back(make_pair(x->getLeft(), y->getLeft()));
+        stack.push_back(make_pair(x->getRight(), y->getRight()));
+    }
+    return true;
+}
+
+// with finger search off, lookups (and inserts) must leave finger_ alone,
+// otherwise const finds write to the tree and readers race. build
+// bst-test-tsan to have ThreadSanitizer watch the two reader threads
+void testReadersDontWrite()
+{
+    cout << "concurrent const lookups" << endl;
+    TreePeek<SplayTree<int,int> > splay;
+    TreePeek<AVLTree<int,int> > avl;
+    for(int i = 0; i < 2000; ++i) {
+        splay.insert(make_pair((i * 7919) % 2000, i));
+        avl.insert(make_pair(i, i));
+    }
+    splay.setSplayMode(SPLAY_NONE);
+    CHECK(avl.finger() == nullptr);
+
+    const SplayTree<int,int>& shared = splay;
+    Node<int,int>* rootBefore = splay.root();
+    int found[2] = { 0, 0 };
+    vector<thread> readers;
+    for(int t = 0; t < 2; ++t) {
+        readers.push_back(thread([&shared, &found, t]() {
+            for(int round = 0; round < 20; ++round) {
+                for(int key = t; key < 2200; key += 2) {
+                    if(shared.find(key) != shared.end()) {
+                        ++found[t];
+                    }
+                }
+            }
+        }));
+    }
+    for(size_t t = 0; t < readers.size(); ++t) {
+        readers[t].join();
+    }
+    CHECK(found[0] == 20 * 1000 && found[1] == 20 * 1000);
+    CHECK(splay.finger() == nullptr);
+    CHECK(splay.root() == rootBefore);
+
+    // SPLAY_NONE covers the non-const find too
+    CHECK(splay.find(1234) != splay.end());
+    CHECK(splay.root() == rootBefore);
+
+    // and with finger search on, the finger does follow lookups
+    avl.setFingerSearch(true);
+    AVLTree<int,int>::iterator it = avl.find(1500);
+    CHECK(it != avl.end() && avl.finger() != nullptr && avl.finger()->getKey() == 1500);
+    avl.insert(make_pair(1501, 0));
+    CHECK(avl.finger()->getKey() == 1501);
+    CHECK(avl.find(1400) != avl.end() && avl.find(-5) == avl.end());
+    avl.setFingerSearch(false);
+    CHECK(avl.finger() == nullptr);
+    avl.find(10);
+    CHECK(avl.finger() == nullptr);
+}
+
+// full splaying brings what a lookup found right to the root, semi-splaying
+// only part way (and the tree stays a valid BST either way)
+void testSplayModes()
+{
+    cout << "splay modes" << endl;
+    TreePeek<SplayTree<int,int> > tree;
+    map<int,int> model;
+    // sorted inserts splay each new key to the root, leaving one long left path
+    fill(tree, model, 1024, 1);
+    CHECK(tree.depth(0) == 1023);
+
+    tree.setSplayMode(SPLAY_SEMI);
+    CHECK(tree.find(0) != tree.end());
+    int semiDepth = tree.depth(0);
+    CHECK(semiDepth > 0 && semiDepth < 1023 && sameAs(tree, model));
+    // a few more semi splays keep moving it up, still without reaching the root
+    CHECK(tree.find(1) != tree.end());
+    int before = tree.depth(1);
+    tree.find(1);
+    CHECK(tree.depth(1) > 0 && tree.depth(1) < before && sameAs(tree, model));
+
+    tree.setSplayMode(SPLAY_FULL);
+    srand(32);
+    for(int i = 0; i < 50; ++i) {
+        int key = rand() % 1024;
+        CHECK(tree.find(key) != tree.end() && tree.root()->getKey() == key);
+    }
+    // a miss splays the last node it looked at
+    CHECK(tree.find(5000) == tree.end() && tree.root()->getKey() == 1023);
+    CHECK(sameAs(tree, model));
+}
+
+// merge(other, conflict) moves everything over and leaves other empty
+template<class Tree>
+void testMerge(const char* name)
+{
+    cout << "merge (" << name << ")" << endl;
+
+    // disjoint: all of other is above everything here
+    Tree low, high;
+    map<int,int> model;
+    fill(low, model, 50, 1);
+    for(int i = 100; i < 150; ++i) {
+        high.insert(make_pair(i, i));
+        model[i] = i;
+    }
+    low.merge(high);
+    CHECK(sameAs(low, model) && low.size() == 100);
+    CHECK(high.empty() && high.size() == 0 && high.begin() == high.end() && high.validate());
+
+    // merging into an empty tree, and merging an empty tree in
+    Tree empty;
+    empty.merge(low);
+    CHECK(sameAs(empty, model) && low.empty());
+    empty.merge(low);
+    CHECK(sameAs(empty, model));
+    empty.merge(empty);     // with itself does nothing
+    CHECK(sameAs(empty, model));
+
+    // interleaved keys with some in both, either side winning
+    for(int round = 0; round < 2; ++round) {
+        MergeConflict conflict = (round == 0) ? MERGE_KEEP_THIS : MERGE_KEEP_OTHER;
+        Tree evens, threes;
+        map<int,int> expect;
+        for(int i = 0; i < 300; i += 2) {
+            evens.insert(make_pair(i, 1));
+            expect[i] = 1;
+        }
+        for(int i = 0; i < 300; i += 3) {
+            threes.insert(make_pair(i, 2));
+            if(conflict == MERGE_KEEP_OTHER || expect.find(i) == expect.end()) {
+                expect[i] = 2;
+            }
+        }
+        evens.merge(threes, conflict);
+        CHECK(sameAs(evens, expect) && evens.size() == expect.size());
+        CHECK(threes.empty());
+        // the merged tree carries on like any other
+        evens.insert(make_pair(1001, 5));
+        evens.remove(6);
+        expect[1001] = 5;
+        expect.erase(6);
+        CHECK(sameAs(evens, expect));
+    }
+
+    // tombstones on either side are dropped, not merged in, and don't beat live keys
+    Tree lazyMine, lazyTheirs;
+    map<int,int> expect;
+    lazyMine.setLazyDelete(true, 0.9);
+    lazyTheirs.setLazyDelete(true, 0.9);
+    for(int i = 0; i < 40; ++i) {
+        lazyMine.insert(make_pair(i, 1));
+        lazyTheirs.insert(make_pair(i + 20, 2));
+    }
+    for(int i = 0; i < 40; i += 2) {
+        lazyMine.remove(i);
+        lazyTheirs.remove(i + 20);
+    }
+    for(int i = 1; i < 40; i += 2) {
+        expect[i] = 1;
+    }
+    for(int i = 21; i < 60; i += 2) {
+        expect[i] = 2;
+    }
+    lazyMine.merge(lazyTheirs, MERGE_KEEP_OTHER);
+    CHECK(sameAs(lazyMine, expect) && lazyMine.size() == expect.size());
+    CHECK(lazyTheirs.empty());
+
+    // even when nothing but tombstones is left on both sides (popMax really
+    // removes, so it can take out the live keys without compacting)
+    Tree deadMine, deadTheirs;
+    deadMine.setLazyDelete(true, 0.9);
+    deadTheirs.setLazyDelete(true, 0.9);
+    for(int i = 1; i <= 3; ++i) {
+        deadMine.insert(make_pair(i, i));
+        deadTheirs.insert(make_pair(i + 1, i));
+    }
+    deadMine.remove(1);
+    deadTheirs.remove(2);
+    deadMine.popMax();
+    deadMine.popMax();
+    deadTheirs.popMax();
+    deadTheirs.popMax();
+    CHECK(deadMine.empty() && deadTheirs.empty());
+    deadMine.merge(deadTheirs);
+    CHECK(deadMine.empty() && deadMine.begin() == deadMine.end() && deadMine.validate());
+    deadMine.insert(make_pair(3, 3));
+    CHECK(deadMine.size() == 1 && deadMine.find(3) != deadMine.end());
+
+    // with the hash index on, finds go through it, so it has to be rebuilt
+    Tree indexed, donor;
+    indexed.setHashIndex(true);
+    donor.setHashIndex(true);
+    for(int i = 0; i < 100; ++i) {
+        indexed.insert(make_pair(i * 2, i));
+        donor.insert(make_pair(i * 2 + 1, -i));
+    }
+    indexed.merge(donor);
+    bool allFound = true;
+    for(int i = 0; i < 200; ++i) {
+        typename Tree::iterator it = indexed.find(i);
+        allFound = allFound && it != indexed.end() && it->first == i;
+    }
+    CHECK(allFound);
+    CHECK(donor.find(1) == donor.end() && donor.find(2) == donor.end());
+    donor.insert(make_pair(7, 7));
+    CHECK(donor.find(7) != donor.end() && donor.size() == 1);
+}
+
+// merge() moves nodes, so both trees have to be the same kind
+void testMergeKinds()
+{
+    AVLTree<int,int> avl;
+    SplayTree<int,int> splay;
+    avl.insert(make_pair(1, 1));
+    splay.insert(make_pair(2, 2));
+    bool threw = false;
+    try {
+        avl.merge(splay);
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(avl.size() == 1 && splay.size() == 1 && avl.validate() && splay.validate());
+}
+
+// parallelReduce over several threads has to give what a plain in-order
+// fold does, for a bool result too (no std::vector<bool> for the partials)
+void testParallelReduce()
+{
+    cout << "parallelReduce" << endl;
+    AVLTree<int,int> tree;
+    map<int,int> model;
+    fill(tree, model, 5000, 3);
+    tree.setParallelism(4, 16);    // small grain so it really splits
+
+    typedef pair<const int,int> Item;
+    bool anyOdd = tree.parallelReduce(false,
+        [](bool acc, Item& item) { return acc || item.second % 2 == 1; },
+        [](bool a, bool b) { return a || b; });
+    bool allSmall = tree.parallelReduce(true,
+        [](bool acc, Item& item) { return acc && item.first < 15000; },
+        [](bool a, bool b) { return a && b; });
+    bool anyHuge = tree.parallelReduce(false,
+        [](bool acc, Item& item) { return acc || item.first > 20000; },
+        [](bool a, bool b) { return a || b; });
+    CHECK(anyOdd && allSmall && !anyHuge);
+
+    // string concatenation isn't commutative, so any piece out of order shows
+    string serial;
+    for(map<int,int>::iterator it = model.begin(); it != model.end(); ++it) {
+        serial += to_string(it->first) + ",";
+    }
+    string parallel = tree.parallelReduce(string(),
+        [](const string& acc, Item& item) { return acc + to_string(item.first) + ","; },
+        [](const string& a, const string& b) { return a + b; });
+    CHECK(parallel == serial);
+
+    // tombstones are skipped
+    tree.setLazyDelete(true, 0.9);
+    for(int i = 0; i < 5000; i += 2) {
+        tree.remove(i * 3);
+    }
+    long sum = tree.parallelReduce(0L,
+        [](long acc, Item& item) { return acc + item.second; },
+        [](long a, long b) { return a + b; });
+    long expect = 0;
+    for(int i = 1; i < 5000; i += 2) {
+        expect += i;
+    }
+    CHECK(sum == expect);
+}
+
+// lazy delete: removes leave tombstones that everything else has to look
+// past, until there are too many and the tree compacts itself
+template<class Tree>
+void testLazyDelete(const char* name)
+{
+    cout << "lazy delete (" << name << ")" << endl;
+    TreePeek<Tree> tree;
+    map<int,int> model;
+    tree.setLazyDelete(true, 0.25);
+    fill(tree, model, 100, 1);
+
+    for(int i = 10; i < 30; ++i) {
+        tree.remove(i);
+        model.erase(i);
+    }
+    CHECK(tree.nodes() == 100 && tree.tombstones() == 20);
+    CHECK(tree.size() == 80 && !tree.empty() && sameAs(tree, model));
+    CHECK(tree.find(15) == tree.end());
+    tree.remove(15);    // already dead, nothing changes
+    CHECK(tree.tombstones() == 20);
+
+    // bringing a dead key back reuses its node
+    tree.insert(make_pair(20, -20));
+    model[20] = -20;
+    CHECK(tree.nodes() == 100 && tree.tombstones() == 19 && tree.size() == 81);
+    CHECK(tree.find(20) != tree.end() && tree[20] == -20 && sameAs(tree, model));
+
+    // tombstones at either end don't show through begin/front/back
+    tree.remove(0);
+    tree.remove(1);
+    tree.remove(99);
+    model.erase(0);
+    model.erase(1);
+    model.erase(99);
+    CHECK(tree.begin()->first == 2 && tree.front().first == 2 && tree.back().first == 98);
+    CHECK(sameAs(tree, model));
+
+    // one more than 25% of the nodes being dead compacts everything away
+    CHECK(tree.tombstones() == 22);
+    for(int i = 30; i < 34; ++i) {
+        tree.remove(i);
+        model.erase(i);
+    }
+    CHECK(tree.tombstones() == 0 && tree.nodes() == model.size() && tree.size() == model.size());
+    CHECK(sameAs(tree, model));
+
+    // erase(iterator) marks too, and hands back the next live item
+    typename Tree::iterator next = tree.erase(tree.find(40));
+    model.erase(40);
+    CHECK(tree.tombstones() == 1 && next != tree.end() && next->first == 41);
+    tree.remove(42);
+    model.erase(42);
+    next = tree.erase(tree.find(41));
+    model.erase(41);
+    CHECK(next != tree.end() && next->first == 43);
+
+    // eraseRange over tombstones keeps the count straight (AVLTree frees the
+    // range outright, the others mark it)
+    tree.eraseRange(38, 50);
+    model.erase(model.lower_bound(38), model.lower_bound(50));
+    CHECK(tree.nodes() - tree.tombstones() == model.size() && tree.size() == model.size());
+    CHECK(sameAs(tree, model));
+
+    // turning lazy delete off compacts
+    tree.remove(60);
+    model.erase(60);
+    tree.setLazyDelete(false);
+    CHECK(tree.tombstones() == 0 && tree.nodes() == model.size() && sameAs(tree, model));
+    tree.remove(61);
+    model.erase(61);
+    CHECK(tree.tombstones() == 0 && tree.nodes() == model.size());
+
+    // with the hash index the dead keys have to miss in the index too
+    TreePeek<Tree> indexed;
+    indexed.setHashIndex(true);
+    indexed.setLazyDelete(true, 0.5);
+    for(int i = 0; i < 20; ++i) {
+        indexed.insert(make_pair(i, i));
+    }
+    indexed.remove(7);
+    CHECK(indexed.find(7) == indexed.end() && indexed.tombstones() == 1);
+    indexed.insert(make_pair(7, 70));
+    CHECK(indexed.find(7) != indexed.end() && indexed.find(7)->second == 70 && indexed.tombstones() == 0);
+
+    bool threw = false;
+    try {
+        indexed.setLazyDelete(true, 1.0);
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+}
+
+// removeIf calls pred once per live item, in key order, and still leaves a
+// whole (and balanced) tree behind if pred throws part way
+template<class Tree>
+void testRemoveIf(const char* name)
+{
+    cout << "removeIf (" << name << ")" << endl;
+    TreePeek<Tree> tree;
+    map<int,int> model;
+    srand(46);
+    for(int i = 0; i < 500; ++i) {
+        int key = rand() % 2000;
+        tree.insert(make_pair(key, i));
+        model[key] = i;
+    }
+    tree.setLazyDelete(true, 0.9);
+    tree.setHashIndex(true);
+    for(int i = 0; i < 2000; i += 7) {
+        tree.remove(i);
+        model.erase(i);
+    }
+
+    vector<int> seen;
+    size_t removed = tree.removeIf([&seen](const pair<const int,int>& item) {
+        seen.push_back(item.first);
+        return item.first % 3 == 0;
+    });
+    vector<int> expectSeen;
+    size_t expectRemoved = 0;
+    for(map<int,int>::iterator it = model.begin(); it != model.end(); ) {
+        expectSeen.push_back(it->first);
+        if(it->first % 3 == 0) {
+            it = model.erase(it);
+            ++expectRemoved;
+        }
+        else {
+            ++it;
+        }
+    }
+    CHECK(seen == expectSeen);  // tombstones never get asked about
+    CHECK(removed == expectRemoved);
+    CHECK(tree.tombstones() == 0 && tree.nodes() == model.size() && sameAs(tree, model));
+    CHECK(tree.isBalanced());
+    CHECK(tree.find(3 * 5) == tree.end() && tree.find(model.begin()->first) != tree.end());
+
+    // pred throws on the 50th item: the 49 before it get their answer, the rest stay
+    int calls = 0;
+    vector<int> said;
+    bool threw = false;
+    try {
+        tree.removeIf([&calls, &said](const pair<const int,int>& item) -> bool {
+            if(++calls == 50) {
+                throw std::runtime_error("pred failed");
+            }
+            if(item.first % 2 == 0) {
+                said.push_back(item.first);
+                return true;
+            }
+            return false;
+        });
+    }
+    catch(std::runtime_error&) {
+        threw = true;
+    }
+    CHECK(threw && calls == 50);
+    for(size_t i = 0; i < said.size(); ++i) {
+        model.erase(said[i]);
+    }
+    CHECK(sameAs(tree, model) && tree.size() == model.size() && tree.isBalanced());
+    CHECK(said.empty() || tree.find(said[0]) == tree.end());
+    tree.insert(make_pair(-1, -1));
+    model[-1] = -1;
+    CHECK(sameAs(tree, model));
+
+    // everything, and then an empty tree
+    CHECK(tree.removeIf([](const pair<const int,int>&) { return true; }) == model.size());
+    CHECK(tree.empty() && tree.begin() == tree.end() && tree.validate());
+    CHECK(tree.removeIf([](const pair<const int,int>&) { return true; }) == 0);
+}
+
+// long random mixes of everything that changes a tree, checked against
+// std::map and validate() after every round: the per-item rebalancing
+// (rotations, RB recolor fixups) and the rebuilds merge/compact/removeIf do
+template<class Tree>
+void testRandomMix(const char* name)
+{
+    cout << "random mix (" << name << ")" << endl;
+    Tree tree;
+    map<int,int> model;
+    srand(31);
+    for(int round = 0; round < 60; ++round) {
+        // lazy delete on for some rounds, so compaction gets its turn too
+        tree.setLazyDelete(round % 3 == 1, 0.3);
+        for(int step = 0; step < 200; ++step) {
+            int key = rand() % 2000;
+            if(rand() % 5 < 2) {
+                tree.remove(key);
+                model.erase(key);
+            }
+            else {
+                tree.insert(make_pair(key, step));
+                model[key] = step;
+            }
+        }
+        CHECK(sameAs(tree, model) && tree.size() == model.size());
+
+        switch(round % 4) {
+        case 0: {
+            int lo = rand() % 2000;
+            int hi = lo + rand() % 200;
+            tree.eraseRange(lo, hi);
+            model.erase(model.lower_bound(lo), model.lower_bound(hi));
+            break;
+        }
+        case 1: {
+            Tree other;
+            for(int i = 0; i < 100; ++i) {
+                int key = rand() % 2000;
+                other.insert(make_pair(key, -i));
+                model[key] = -i;
+            }
+            tree.merge(other);
+            break;
+        }
+        case 2:
+            tree.compact();
+            break;
+        default: {
+            int mod = 2 + rand() % 5;
+            tree.removeIf([mod](const pair<const int,int>& item) { return item.first % mod == 0; });
+            for(map<int,int>::iterator it = model.begin(); it != model.end(); ) {
+                it = (it->first % mod == 0) ? model.erase(it) : next(it);
+            }
+            break;
+        }
+        }
+        if(!sameAs(tree, model) || tree.size() != model.size()) {
+            CHECK(sameAs(tree, model) && tree.size() == model.size());
+            break;
+        }
+    }
+
+    // then empty it out one remove at a time, the fixups all the way down
+    while(!model.empty()) {
+        int key = next(model.begin(), rand() % model.size())->first;
+        tree.remove(key);
+        model.erase(key);
+        if(model.size() % 64 == 0) {
+            CHECK(sameAs(tree, model));
+        }
+    }
+    CHECK(tree.empty() && tree.validate());
+}
+
+// the export calls copy live items out in key order, stop at capacity
+// without touching anything past it, and keep the SoA keys and values lined up
+template<class Tree>
+void testExport(const char* name)
+{
+    cout << "export (" << name << ")" << endl;
+    Tree tree;
+    map<int,int> model;
+    vector<int> keys, values;
+    vector<pair<int,int> > items;
+    tree.exportKeys(keys);
+    tree.exportItems(items);
+    CHECK(keys.empty() && items.empty());
+
+    srand(41);
+    tree.setLazyDelete(true, 0.5);
+    for(int i = 0; i < 1000; ++i) {
+        int key = rand() % 5000;
+        tree.insert(make_pair(key, key * 3 + 1));
+        model[key] = key * 3 + 1;
+    }
+    for(int i = 0; i < 5000; i += 9) {
+        tree.remove(i);
+        model.erase(i);
+    }
+    vector<int> expectKeys, expectValues;
+    for(map<int,int>::iterator it = model.begin(); it != model.end(); ++it) {
+        expectKeys.push_back(it->first);
+        expectValues.push_back(it->second);
+    }
+
+    // into vectors: everything, tombstones skipped
+    tree.exportKeys(keys);
+    tree.exportValues(values);
+    CHECK(keys == expectKeys && values == expectValues);
+    keys.assign(3, -1);
+    values.clear();
+    tree.exportItems(keys, values);
+    CHECK(keys == expectKeys && values == expectValues);
+    tree.exportItems(items);
+    bool lined = items.size() == model.size();
+    for(size_t i = 0; lined && i < items.size(); ++i) {
+        lined = items[i].first == expectKeys[i] && items[i].second == expectValues[i];
+    }
+    CHECK(lined);
+
+    // into arrays: capacity cuts it short, the slot after it is left alone
+    size_t capacities[] = { 0, 1, 17, model.size(), model.size() + 5 };
+    for(size_t c = 0; c < 5; ++c) {
+        size_t cap = capacities[c];
+        size_t want = (cap < model.size()) ? cap : model.size();
+        vector<int> k(cap + 1, -7), v(cap + 1, -7);
+        CHECK(tree.exportKeys(k.data(), cap) == want && k[want] == -7);
+        CHECK(equal(k.begin(), k.begin() + want, expectKeys.begin()));
+        CHECK(tree.exportValues(v.data(), cap) == want && v[want] == -7);
+        CHECK(equal(v.begin(), v.begin() + want, expectValues.begin()));
+
+        vector<int> sk(cap + 1, -7), sv(cap + 1, -7);
+        CHECK(tree.exportItems(sk.data(), sv.data(), cap) == want && sk[want] == -7 && sv[want] == -7);
+        bool same = true;
+        for(size_t i = 0; i < want; ++i) {
+            same = same && sk[i] == expectKeys[i] && sv[i] == sk[i] * 3 + 1;
+        }
+        CHECK(same);
+
+        vector<pair<int,int> > p(cap + 1, make_pair(-7, -7));
+        CHECK(tree.exportItems(p.data(), cap) == want && p[want].first == -7);
+        CHECK(want == 0 || (p[want - 1].first == expectKeys[want - 1] && p[want - 1].second == expectValues[want - 1]));
+    }
+}
+
+// dump() of a small known tree, written out in full: post-order, pre-order
+// ids, measured height/balance, summaries past maxDepth, escaping, tombstones
+void testDump()
+{
+    cout << "dump" << endl;
+    BinarySearchTree<int,int> tree;
+    ostringstream out;
+    tree.dump(out);
+    CHECK(out.str() == "digraph bst {\n}\n");
+    out.str("");
+    tree.dump(out, DUMP_JSON);
+    CHECK(out.str() == "{\"nodes\": [\n], \"size\": 0, \"height\": 0}\n");
+
+    //      5
+    //    3   8
+    //   1
+    int keys[] = { 5, 3, 8, 1 };
+    for(int i = 0; i < 4; ++i) {
+        tree.insert(make_pair(keys[i], keys[i] * 10));
+    }
+    out.str("");
+    tree.dump(out);
+    CHECK(out.str() ==
+        "digraph bst {\n"
+        "n2 [label=\"1\\nd=2 h=1 b=0\"];\n"
+        "n1 -> n2 [label=\"L\"];\n"
+        "n1 [label=\"3\\nd=1 h=2 b=1\"];\n"
+        "n0 -> n1 [label=\"L\"];\n"
+        "n3 [label=\"8\\nd=1 h=1 b=0\"];\n"
+        "n0 -> n3 [label=\"R\"];\n"
+        "n0 [label=\"5\\nd=0 h=3 b=1\"];\n"
+        "}\n");
+    out.str("");
+    tree.dump(out, DUMP_JSON);
+    CHECK(out.str() ==
+        "{\"nodes\": [\n"
+        "{\"id\": 2, \"parent\": 1, \"side\": \"L\", \"key\": \"1\", \"value\": \"10\", \"depth\": 2, \"height\": 1, \"balance\": 0, \"size\": 1},\n"
+        "{\"id\": 1, \"parent\": 0, \"side\": \"L\", \"key\": \"3\", \"value\": \"30\", \"depth\": 1, \"height\": 2, \"balance\": 1, \"size\": 2},\n"
+        "{\"id\": 3, \"parent\": 0, \"side\": \"R\", \"key\": \"8\", \"value\": \"80\", \"depth\": 1, \"height\": 1, \"balance\": 0, \"size\": 1},\n"
+        "{\"id\": 0, \"parent\": null, \"side\": null, \"key\": \"5\", \"value\": \"50\", \"depth\": 0, \"height\": 3, \"balance\": 1, \"size\": 4}\n"
+        "], \"size\": 4, \"height\": 3}\n");
+
+    // maxDepth 0: each of the root's subtrees turns into one summary with its size and height
+    out.str("");
+    tree.dump(out, DUMP_JSON, 0);
+    CHECK(out.str() ==
+        "{\"nodes\": [\n"
+        "{\"id\": 1, \"parent\": 0, \"side\": \"L\", \"hidden\": 2, \"height\": 2},\n"
+        "{\"id\": 2, \"parent\": 0, \"side\": \"R\", \"hidden\": 1, \"height\": 1},\n"
+        "{\"id\": 0, \"parent\": null, \"side\": null, \"key\": \"5\", \"value\": \"50\", \"depth\": 0, \"height\": 3, \"balance\": 1, \"size\": 4}\n"
+        "], \"size\": 4, \"height\": 3}\n");
+    out.str("");
+    tree.dump(out, DUMP_DOT, 0);
+    CHECK(out.str() ==
+        "digraph bst {\n"
+        "n1 [shape=ellipse, label=\"2 nodes\\nh=2\"];\n"
+        "n0 -> n1 [label=\"L\"];\n"
+        "n2 [shape=ellipse, label=\"1 nodes\\nh=1\"];\n"
+        "n0 -> n2 [label=\"R\"];\n"
+        "n0 [label=\"5\\nd=0 h=3 b=1\"];\n"
+        "}\n");
+
+    // tombstones are still nodes, just marked
+    tree.setLazyDelete(true, 0.9);
+    tree.remove(8);
+    out.str("");
+    tree.dump(out, DUMP_JSON);
+    CHECK(out.str().find("\"key\": \"8\", \"value\": \"80\", \"depth\": 1, \"height\": 1, \"balance\": 0, \"size\": 1, \"dead\": true}") != string::npos);
+    CHECK(out.str().find("\"dead\"") == out.str().rfind("\"dead\""));
+    out.str("");
+    tree.dump(out);
+    CHECK(out.str().find("n3 [label=\"8\\nd=1 h=1 b=0\", style=dashed];\n") != string::npos);
+    CHECK(out.str().find("dashed") == out.str().rfind("dashed"));
+
+    // quotes, backslashes, newlines and other control characters in keys get escaped
+    BinarySearchTree<string,string> strings;
+    strings.insert(make_pair(string("say \"hi\"\\\n\x01"), string("tab\there")));
+    out.str("");
+    strings.dump(out, DUMP_JSON);
+    CHECK(out.str().find("\"key\": \"say \\\"hi\\\"\\\\\\n\\u0001\", \"value\": \"tab\\u0009here\"") != string::npos);
+    out.str("");
+    strings.dump(out);
+    CHECK(out.str().find("n0 [label=\"say \\\"hi\\\"\\\\\\n\\u0001\\nd=0 h=1 b=0\"];\n") != string::npos);
+}
+
+// a stateful allocator that tallies what goes through it. two of them are
+// equal only if they share a tally, like two separate pools. the counts are
+// atomic since parallel copies and teardowns allocate from worker threads
+struct Tally
+{
+    Tally() : allocations(0), frees(0), liveBytes(0) { }
+    std::atomic<long> allocations;
+    std::atomic<long> frees;
+    std::atomic<long> liveBytes;
+};
+
+template<class T>
+struct CountingAllocator
+{
+    typedef T value_type;
+
+    explicit CountingAllocator(Tally* tally) : tally(tally) { }
+    template<class U>
+    CountingAllocator(const CountingAllocator<U>& other) : tally(other.tally) { }
+
+    T* allocate(size_t n)
+    {
+        ++tally->allocations;
+        tally->liveBytes += n * sizeof(T);
+        return static_cast<T*>(::operator new(n * sizeof(T)));
+    }
+    void deallocate(T* memory, size_t n)
+    {
+        ++tally->frees;
+        tally->liveBytes -= n * sizeof(T);
+        ::operator delete(memory);
+    }
+
+    Tally* tally;
+};
+
+template<class T, class U>
+bool operator==(const CountingAllocator<T>& a, const CountingAllocator<U>& b) { return a.tally == b.tally; }
+template<class T, class U>
+bool operator!=(const CountingAllocator<T>& a, const CountingAllocator<U>& b) { return a.tally != b.tally; }
+
+// every node comes from the tree's allocator and goes back to it, copies
+// (parallel ones too) use the source's, and memoryUsage's node bytes are
+// exactly what the allocator has out
+template<class Tree>
+void testAllocator(const char* name)
+{
+    cout << "counting allocator (" << name << ")" << endl;
+    typedef CountingAllocator<pair<const int,int> > Alloc;
+    Tally mine, theirs;
+    {
+        Tree tree((Alloc(&mine)));
+        map<int,int> model;
+        fill(tree, model, 1000, 1);
+        CHECK(mine.allocations == 1000 && mine.frees == 0);
+        CHECK(tree.memoryUsage().nodeBytes == (size_t)mine.liveBytes);
+        CHECK(tree.getAllocator() == Alloc(&mine));
+
+        tree.insert(make_pair(5, -5));  // overwriting allocates nothing
+        model[5] = -5;
+        for(int i = 0; i < 1000; i += 10) {
+            tree.remove(i);
+            model.erase(i);
+        }
+        CHECK(mine.allocations == 1000 && mine.frees == 100 && sameAs(tree, model));
+        CHECK(tree.memoryUsage().nodeBytes == (size_t)mine.liveBytes);
+
+        // tombstones hold on to their nodes until compact() gives them back
+        tree.setLazyDelete(true, 0.9);
+        tree.remove(1);
+        tree.remove(2);
+        model.erase(1);
+        model.erase(2);
+        CHECK(mine.frees == 100 && tree.memoryUsage().nodeBytes == (size_t)mine.liveBytes);
+        tree.compact();
+        CHECK(mine.frees == 102 && tree.memoryUsage().nodeBytes == (size_t)mine.liveBytes);
+
+        Tree copy(tree);
+        CHECK(copy.getAllocator() == Alloc(&mine) && sameAs(copy, model));
+        CHECK(mine.allocations - mine.frees == (long)(tree.size() + copy.size()));
+
+        tree.setParallelism(4, 16);
+        Tree parallelCopy(tree);
+        CHECK(sameAs(parallelCopy, model));
+        CHECK(mine.allocations - mine.frees == (long)(3 * tree.size()));
+        parallelCopy.clear();
+        CHECK(mine.allocations - mine.frees == (long)(2 * tree.size()));
+
+        // nodes can't move between trees that don't share an allocator
+        Tree other((Alloc(&theirs)));
+        other.insert(make_pair(5000, 1));
+        bool threw = false;
+        try {
+            tree.merge(other);
+        }
+        catch(std::invalid_argument&) {
+            threw = true;
+        }
+        CHECK(threw && other.size() == 1 && sameAs(tree, model));
+        CHECK(theirs.allocations == 1 && theirs.frees == 0);
+
+        // same allocator: the nodes just move over
+        long before = mine.allocations;
+        copy.insert(make_pair(5000, 2));
+        model[5000] = 2;
+        tree.merge(copy);
+        CHECK(copy.empty() && sameAs(tree, model));
+        CHECK(mine.allocations == before + 1);
+        CHECK(tree.memoryUsage().nodeBytes + parallelCopy.memoryUsage().nodeBytes == (size_t)mine.liveBytes);
+
+        // assignment keeps this tree's allocator and copies over into it
+        other = tree;
+        CHECK(other.getAllocator() == Alloc(&theirs) && sameAs(other, model));
+        CHECK(theirs.allocations - theirs.frees == (long)model.size());
+    }
+    CHECK(mine.allocations == mine.frees && mine.liveBytes == 0);
+    CHECK(theirs.allocations == theirs.frees && theirs.liveBytes == 0);
+}
+
+#if __cplusplus >= 201703L
+// std::pmr::polymorphic_allocator works too, only built in bst-test-cxx17.
+// a monotonic buffer with nothing upstream: every node has to come out of it
+void testPmrAllocator()
+{
+    cout << "pmr allocator" << endl;
+    typedef std::pmr::polymorphic_allocator<pair<const int,int> > Alloc;
+    static char buffer[1 << 16];
+    std::pmr::monotonic_buffer_resource pool(buffer, sizeof(buffer), std::pmr::null_memory_resource());
+    AVLTree<int,int,Alloc> tree((Alloc(&pool)));
+    map<int,int> model;
+    fill(tree, model, 200, 3);
+    for(int i = 0; i < 600; i += 9) {
+        tree.remove(i);
+        model.erase(i);
+    }
+    CHECK(sameAs(tree, model));
+    bool inside = true;
+    for(AVLTree<int,int,Alloc>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        const char* at = reinterpret_cast<const char*>(&*it);
+        inside = inside && at >= buffer && at < buffer + sizeof(buffer);
+    }
+    CHECK(inside);
+}
+#endif
+
+// with setParallelism, copies get cloned and trees torn down by several
+// threads at once. the result has to be the sequential copy node for node,
+// and every node has to get back to the allocator
+template<class Tree>
+void testParallelCopy(const char* name)
+{
+    cout << "parallel copy/clear (" << name << ")" << endl;
+    typedef CountingAllocator<pair<const int,int> > Alloc;
+    Tally tally;
+    {
+        TreePeek<Tree> tree((Alloc(&tally)));
+        map<int,int> model;
+        srand(38);
+        for(int i = 0; i < 200000; ++i) {
+            int key = rand();
+            tree.insert(make_pair(key, i));
+            model[key] = i;
+        }
+        // leave some tombstones in for the clones to copy
+        tree.setLazyDelete(true, 0.5);
+        vector<int> keys;
+        for(map<int,int>::iterator it = model.begin(); it != model.end(); ++it) {
+            keys.push_back(it->first);
+        }
+        for(size_t i = 0; i < keys.size(); i += 100) {
+            tree.remove(keys[i]);
+            model.erase(keys[i]);
+        }
+        CHECK(tree.tombstones() > 0);
+
+        TreePeek<Tree> sequential(tree);
+        tree.setParallelism(4, 64);
+        TreePeek<Tree> parallel(tree);
+        CHECK(sameAs(parallel, model) && sameAs(sequential, model));
+        CHECK(sameShape(sequential.root(), parallel.root()) && sameShape(tree.root(), parallel.root()));
+        CHECK(parallel.tombstones() == tree.tombstones() && parallel.size() == tree.size());
+        long live = tally.allocations - tally.frees;
+        CHECK(live == (long)(3 * tree.nodes()));
+
+        // assigning over a tree with something in it, both sides in parallel
+        TreePeek<Tree> assigned(tree);
+        assigned.erase(assigned.begin(), assigned.end());
+        assigned.insert(make_pair(-1, -1));
+        static_cast<Tree&>(assigned) = tree;
+        CHECK(sameShape(tree.root(), assigned.root()) && sameAs(assigned, model));
+
+        // parallel teardown gives back every node
+        parallel.clear();
+        CHECK(parallel.empty() && parallel.validate());
+        CHECK(tally.allocations - tally.frees == (long)(3 * tree.nodes()));
+        // and the cleared tree still works
+        parallel.insert(make_pair(1, 1));
+        CHECK(parallel.size() == 1 && parallel.validate());
+    }
+    CHECK(tally.allocations == tally.frees && tally.liveBytes == 0);
+}
+
+// a plain BinarySearchTree fed sorted keys is one long path. validate(),
+// height() and isBalanced() walk it (and copying and clearing go down it)
+// without recursing, so even a path far deeper than the stack has to work
+void testDegenerate()
+{
+    cout << "degenerate tree" << endl;
+    BinarySearchTree<int,int> sorted;
+    map<int,int> model;
+    fill(sorted, model, 10000, 1);
+    CHECK(sorted.height() == 10000 && !sorted.isBalanced() && sameAs(sorted, model));
+
+    // sorted inserts cost O(depth) each, too slow for a really deep path. taking
+    // keys off both ends in turn builds one just as deep, and with finger
+    // search each insert starts right where the last one went
+    const int count = 200000;
+    BinarySearchTree<int,int> path;
+    path.setFingerSearch(true);
+    for(int i = 0; i < count / 2; ++i) {
+        path.insert(make_pair(i, i));
+        path.insert(make_pair(count - 1 - i, i));
+    }
+    CHECK(path.size() == (size_t)count && path.height() == count);
+    CHECK(path.validate() && !path.isBalanced());
+    CHECK(path.front().first == 0 && path.back().first == count - 1);
+    CHECK(path.find(count / 2) != path.end() && path[count / 2 - 1] == count / 2 - 1);
+    int seen = 0;
+    for(BinarySearchTree<int,int>::iterator it = path.begin(); it != path.end(); ++it) {
+        seen += (it->first == seen);
+    }
+    CHECK(seen == count);
+
+    BinarySearchTree<int,int> copy(path);
+    CHECK(copy.height() == count && copy.validate());
+    copy.remove(count / 2);
+    CHECK(copy.height() == count - 1 && copy.validate());
+    copy.clear();
+    CHECK(copy.empty() && copy.height() == 0 && copy.isBalanced());
+}
+
+// percentiles never go down as p goes up, and stay inside [min, max]
+bool percentilesOk(const LatencyHistogram& hist)
+{
+    uint64_t last = 0;
+    for(double p = 0.0; p <= 100.0; p += 0.5) {
+        uint64_t value = hist.percentile(p);
+        if(value < last || value < hist.min() || value > hist.max()) {
+            return false;
+        }
+        last = value;
+    }
+    return true;
+}
+
+// the histogram on its own, with values we know
+void testLatencyHistogram()
+{
+    cout << "latency histogram" << endl;
+    LatencyHistogram hist;
+    CHECK(hist.count() == 0 && hist.min() == 0 && hist.max() == 0 && hist.percentile(50) == 0);
+    for(uint64_t ns = 1; ns <= 1000; ++ns) {
+        hist.record(ns);
+    }
+    hist.record(1000000000);
+    CHECK(hist.count() == 1001 && hist.min() == 1 && hist.max() == 1000000000);
+    CHECK(hist.percentile(0) == 1 && hist.percentile(100) == 1000000000);
+    // past 16 the buckets are 1/16 of a power of two wide
+    uint64_t median = hist.percentile(50);
+    CHECK(median >= 500 && median <= 500 + 500 / 16);
+    CHECK(percentilesOk(hist));
+    hist.reset();
+    CHECK(hist.count() == 0 && hist.percentile(99) == 0);
+}
+
+// only one call in sampleEvery gets timed, counted across all the ops, so
+// phases that are multiples of it give exact per-op counts. clear() is
+// always timed, and the removes it does inside don't count as removes
+template<class Tree>
+void testLatency(const char* name)
+{
+    cout << "latency tracking (" << name << ")" << endl;
+    Tree tree;
+    CHECK(tree.latency() == nullptr);
+    tree.enableLatencyTracking(10);
+    const LatencyTracker* tracker = tree.latency();
+    CHECK(tracker != nullptr && tracker->sampleEvery() == 10);
+
+    for(int i = 0; i < 1000; ++i) {
+        tree.insert(make_pair((i * 7919) % 1000, i));
+    }
+    for(int i = 0; i < 500; ++i) {
+        tree.find(i);
+    }
+    for(int i = 0; i < 300; ++i) {
+        tree[i] += 1;
+    }
+    for(int i = 0; i < 200; ++i) {
+        tree.remove(i * 5);
+    }
+    CHECK(tracker->histogram(OP_INSERT).count() == 100);
+    CHECK(tracker->histogram(OP_FIND).count() == 50);
+    CHECK(tracker->histogram(OP_INDEX).count() == 30);
+    CHECK(tracker->histogram(OP_REMOVE).count() == 20);
+    CHECK(tracker->histogram(OP_CLEAR).count() == 0);
+
+    tree.clear();
+    tree.clear();
+    CHECK(tracker->histogram(OP_CLEAR).count() == 2 && tracker->histogram(OP_REMOVE).count() == 20);
+    for(int op = 0; op < OP_COUNT; ++op) {
+        CHECK(percentilesOk(tracker->histogram((TreeOp)op)));
+    }
+
+    // a copy starts its own empty tracker, sampling the same way
+    tree.insert(make_pair(1, 1));
+    Tree copy(tree);
+    CHECK(copy.latency() != nullptr && copy.latency() != tracker && copy.latency()->sampleEvery() == 10);
+    CHECK(copy.latency()->histogram(OP_INSERT).count() == 0);
+
+    // sampleEvery 0 means every call
+    tree.enableLatencyTracking(0);
+    tracker = tree.latency();
+    CHECK(tracker->sampleEvery() == 1);
+    for(int i = 0; i < 7; ++i) {
+        tree.insert(make_pair(i, i));
+    }
+    CHECK(tracker->histogram(OP_INSERT).count() == 7 && tracker->histogram(OP_FIND).count() == 0);
+    tree.disableLatencyTracking();
+    CHECK(tree.latency() == nullptr);
+}
+
+#ifdef BST_STATS
+// the counters for small insert sequences worked out by hand. only built
+// into bst-test-stats, since without -DBST_STATS there are no counters
+void testStats()
+{
+    cout << "operation counters" << endl;
+
+    // sorted into a plain BST: a path, each insert compares against every node so far
+    BinarySearchTree<int,int> path;
+    for(int i = 1; i <= 10; ++i) {
+        path.insert(make_pair(i, i));
+    }
+    TreeStats stats = path.stats();
+    CHECK(stats.inserts == 10 && stats.insertComparisons == 45 && stats.rotations == 0);
+    CHECK(stats.nodes == 10 && stats.height == 10 && stats.averageDepth == 4.5);
+    path.find(10);
+    path.find(11);
+    stats = path.stats();
+    CHECK(stats.lookups == 2 && stats.lookupComparisons == 20);
+
+    // the four AVL cases, each on three inserts: one rotation for the
+    // straight lines, two for the zig-zags, and always one rebalance retrace
+    int orders[4][3] = { {1, 2, 3}, {3, 2, 1}, {1, 3, 2}, {3, 1, 2} };
+    for(int o = 0; o < 4; ++o) {
+        AVLTree<int,int> tree;
+        for(int i = 0; i < 3; ++i) {
+            tree.insert(make_pair(orders[o][i], 0));
+        }
+        stats = tree.stats();
+        CHECK(stats.inserts == 3 && stats.insertComparisons == 3);
+        CHECK(stats.rotations == (o < 2 ? 1u : 2u));
+        CHECK(stats.singleLeft == (o == 0 ? 1u : 0u) && stats.singleRight == (o == 1 ? 1u : 0u));
+        CHECK(stats.doubleRightLeft == (o == 2 ? 1u : 0u) && stats.doubleLeftRight == (o == 3 ? 1u : 0u));
+        CHECK(stats.nodes == 3 && stats.height == 2 && tree.begin()->first == 1);
+    }
+
+    // resetStats zeroes the counters but stats() still measures the shape
+    AVLTree<int,int> tree;
+    for(int i = 0; i < 127; ++i) {
+        tree.insert(make_pair(i, i));
+    }
+    CHECK(tree.stats().rotations > 0);
+    tree.resetStats();
+    stats = tree.stats();
+    CHECK(stats.rotations == 0 && stats.inserts == 0 && stats.lookups == 0);
+    CHECK(stats.nodes == 127 && stats.height == 7);
+
+    // a move takes the counters along
+    tree.find(5);
+    AVLTree<int,int> moved(std::move(tree));
+    CHECK(moved.stats().lookups == 1 && tree.stats().lookups == 0);
+}
+#endif
+
+// size(), front()/back() and popMin()/popMax() run off the cached ends,
+// which every kind of change has to keep pointing at the right nodes
+template<class Tree>
+void testEnds(const char* name)
+{
+    cout << "front/back/popMin/popMax (" << name << ")" << endl;
+    TreePeek<Tree> tree;
+    map<int,int> model;
+    CHECK(tree.size() == 0 && tree.extremesOk());
+    int threw = 0;
+    try { tree.front(); } catch(std::out_of_range&) { ++threw; }
+    try { tree.back(); } catch(std::out_of_range&) { ++threw; }
+    try { tree.popMin(); } catch(std::out_of_range&) { ++threw; }
+    try { tree.popMax(); } catch(std::out_of_range&) { ++threw; }
+    CHECK(threw == 4);
+
+    // random inserts and removes, which rotate (or splay) all over the place
+    srand(50);
+    for(int step = 0; step < 3000; ++step) {
+        int key = rand() % 500;
+        if(rand() % 3 == 0) {
+            tree.remove(key);
+            model.erase(key);
+        }
+        else {
+            tree.insert(make_pair(key, step));
+            model[key] = step;
+        }
+        if(!tree.extremesOk() || tree.size() != model.size()) {
+            CHECK(tree.extremesOk() && tree.size() == model.size());
+            break;
+        }
+    }
+    CHECK(tree.front().first == model.begin()->first && tree.back().first == model.rbegin()->first);
+
+    // popping from both ends hands items back in order
+    for(int i = 0; i < 20; ++i) {
+        pair<int,int> low = tree.popMin();
+        pair<int,int> high = tree.popMax();
+        CHECK(low.first == model.begin()->first && low.second == model.begin()->second);
+        CHECK(high.first == model.rbegin()->first && high.second == model.rbegin()->second);
+        model.erase(model.begin());
+        model.erase(prev(model.end()));
+    }
+    CHECK(tree.extremesOk() && sameAs(tree, model));
+
+    // rebuilds: eraseRange at both ends, removeIf, merge, compact
+    tree.eraseRange(-1, model.begin()->first + 10);
+    model.erase(model.begin(), model.lower_bound(model.begin()->first + 10));
+    int top = model.rbegin()->first;
+    tree.eraseRange(top - 10, top + 1);
+    model.erase(model.lower_bound(top - 10), model.end());
+    CHECK(tree.extremesOk() && tree.front().first == model.begin()->first && tree.back().first == model.rbegin()->first);
+
+    // take both ends out along with the evens
+    int lowest = model.begin()->first;
+    int highest = model.rbegin()->first;
+    auto doomed = [lowest, highest](const pair<const int,int>& item) {
+        return item.first % 2 == 0 || item.first == lowest || item.first == highest;
+    };
+    tree.removeIf(doomed);
+    for(map<int,int>::iterator it = model.begin(); it != model.end(); ) {
+        it = doomed(*it) ? model.erase(it) : next(it);
+    }
+    CHECK(tree.extremesOk() && sameAs(tree, model));
+
+    TreePeek<Tree> other;
+    other.insert(make_pair(-5, 1));
+    other.insert(make_pair(900, 2));
+    model[-5] = 1;
+    model[900] = 2;
+    tree.merge(other);
+    CHECK(tree.extremesOk() && tree.front().first == -5 && tree.back().first == 900);
+
+    // a copy is the same tree node for node; a move takes the nodes over
+    TreePeek<Tree> copy(tree);
+    CHECK(sameShape(tree.root(), copy.root()) && copy.extremesOk() && sameAs(copy, model));
+    Node<int,int>* copyRoot = copy.root();
+    TreePeek<Tree> moved(std::move(copy));
+    CHECK(moved.root() == copyRoot && moved.extremesOk() && sameAs(moved, model));
+    CHECK(copy.size() == 0 && copy.root() == nullptr && copy.extremesOk());
+    copy.insert(make_pair(1, 1));
+    CHECK(copy.size() == 1 && copy.validate());
+
+    // assigning over a tree that has something in it, and onto itself
+    TreePeek<Tree> assigned;
+    for(int i = 1000; i < 1100; ++i) {
+        assigned.insert(make_pair(i, i));
+    }
+    assigned = tree;
+    CHECK(sameShape(tree.root(), assigned.root()) && assigned.extremesOk() && sameAs(assigned, model));
+    TreePeek<Tree>& self = assigned;
+    assigned = self;
+    CHECK(sameShape(tree.root(), assigned.root()) && assigned.extremesOk() && sameAs(assigned, model));
+    moved = std::move(copy);
+    CHECK(moved.size() == 1 && moved.front().first == 1 && moved.extremesOk() && moved.validate());
+    moved = std::move(assigned);
+    CHECK(sameShape(tree.root(), moved.root()) && moved.extremesOk() && sameAs(moved, model));
+
+    // tombstones at the front/back: front/back look past them, pops clear them out
+    tree.setLazyDelete(true, 0.9);
+    int dead = 0;
+    for(map<int,int>::iterator it = model.begin(); dead < 5; ++dead) {
+        tree.remove(it->first);
+        it = model.erase(it);
+    }
+    tree.remove(900);
+    model.erase(900);
+    CHECK(tree.tombstones() == 6 && tree.extremesOk());
+    CHECK(tree.front().first == model.begin()->first && tree.back().first == model.rbegin()->first);
+    size_t nodesBefore = tree.nodes();
+    pair<int,int> low = tree.popMin();
+    CHECK(low.first == model.begin()->first);
+    model.erase(model.begin());
+    CHECK(tree.tombstones() == 1 && tree.nodes() == nodesBefore - 6);
+    pair<int,int> high = tree.popMax();
+    CHECK(high.first == model.rbegin()->first);
+    model.erase(prev(model.end()));
+    CHECK(tree.tombstones() == 0 && tree.extremesOk() && sameAs(tree, model));
+
+    tree.compact();
+    CHECK(tree.extremesOk());
+
+    // and all the way down
+    while(!model.empty()) {
+        CHECK(tree.popMin().first == model.begin()->first);
+        model.erase(model.begin());
+    }
+    CHECK(tree.empty() && tree.size() == 0 && tree.extremesOk() && tree.begin() == tree.end());
+    threw = 0;
+    try { tree.popMin(); } catch(std::out_of_range&) { ++threw; }
+    try { tree.back(); } catch(std::out_of_range&) { ++threw; }
+    CHECK(threw == 2);
+}
+
+// scapegoat mode rebuilds subtrees as it goes, the ends have to survive that
+// too and the rebuilds have to actually keep the height down
+void testEndsScapegoat()
+{
+    TreePeek<BinarySearchTree<int,int> > tree;
+    tree.setScapegoat(true, 0.6);
+    for(int i = 0; i < 1000; ++i) {
+        tree.insert(make_pair(i, i));
+        tree.insert(make_pair(-i, i));
+    }
+    CHECK(tree.extremesOk() && tree.front().first == -999 && tree.back().first == 999);
+
+    // and it keeps the alpha-height bound, height <= log_{1/alpha}(n) + 1, under
+    // sorted and reverse sorted inserts, which would otherwise build a path
+    const double alphas[] = { 0.55, 0.6, 0.75, 0.9 };
+    for(double alpha : alphas) {
+        for(int direction = 1; direction >= -1; direction -= 2) {
+            BinarySearchTree<int,int> sorted;
+            sorted.setScapegoat(true, alpha);
+            bool bounded = true;
+            for(int n = 1; n <= 3000; ++n) {
+                sorted.insert(make_pair(direction * n, n));
+                if(n % 50 == 0 || n < 50) {
+                    bounded = bounded && sorted.height() <= std::log((double)n) / std::log(1.0 / alpha) + 1;
+                }
+            }
+            CHECK(bounded && sorted.size() == 3000 && sorted.validate());
+        }
+    }
+}
 
 int main(int argc, char *argv[])
 {
@@ -44,5 +1455,48 @@ int main(int argc, char *argv[])
     cout << "Erasing b" << endl;
     at.remove('b');
 
-    return 0;
+    cout << "\nSelf checks:" << endl;
+    testEraseRange<BinarySearchTree<int,int> >("BinarySearchTree");
+    testEraseRange<AVLTree<int,int> >("AVLTree");
+    testEraseIterators();
+    testReadersDontWrite();
+    testSplayModes();
+    testMerge<BinarySearchTree<int,int> >("BinarySearchTree");
+    testMerge<AVLTree<int,int> >("AVLTree");
+    testMerge<SplayTree<int,int> >("SplayTree");
+    testMergeKinds();
+    testParallelReduce();
+    testLazyDelete<BinarySearchTree<int,int> >("BinarySearchTree");
+    testLazyDelete<AVLTree<int,int> >("AVLTree");
+    testLazyDelete<SplayTree<int,int> >("SplayTree");
+    testRemoveIf<BinarySearchTree<int,int> >("BinarySearchTree");
+    testRemoveIf<AVLTree<int,int> >("AVLTree");
+    testRandomMix<RBTree<int,int> >("RBTree");
+    testRandomMix<AVLTree<int,int> >("AVLTree");
+    testEnds<BinarySearchTree<int,int> >("BinarySearchTree");
+    testEnds<AVLTree<int,int> >("AVLTree");
+    testEnds<RBTree<int,int> >("RBTree");
+    testEnds<SplayTree<int,int> >("SplayTree");
+    testEndsScapegoat();
+    testExport<BinarySearchTree<int,int> >("BinarySearchTree");
+    testExport<AVLTree<int,int> >("AVLTree");
+    testDump();
+    testAllocator<BinarySearchTree<int,int,CountingAllocator<pair<const int,int> > > >("BinarySearchTree");
+    testAllocator<AVLTree<int,int,CountingAllocator<pair<const int,int> > > >("AVLTree");
+#if __cplusplus >= 201703L
+    testPmrAllocator();
+#endif
+    testDegenerate();
+    testLatencyHistogram();
+    testLatency<BinarySearchTree<int,int> >("BinarySearchTree");
+    testLatency<AVLTree<int,int> >("AVLTree");
+    testLatency<RBTree<int,int> >("RBTree");
+    testLatency<SplayTree<int,int> >("SplayTree");
+    testParallelCopy<BinarySearchTree<int,int,CountingAllocator<pair<const int,int> > > >("BinarySearchTree");
+    testParallelCopy<AVLTree<int,int,CountingAllocator<pair<const int,int> > > >("AVLTree");
+#ifdef BST_STATS
+    testStats();
+#endif
+
+    return checkResult();
 }
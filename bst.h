@@ -4,9 +4,105 @@
 #include <iostream>
 #include <exception>
 #include <cstdlib>
+#include <cstddef>
+#include <memory>
 #include <utility>
+#include <vector>
+#include <cmath>
+#include <stdexcept>
+#include <atomic>
+#include <type_traits>
+#include <new>
+#include <typeinfo>
+#include "latency.h"
+#include "leaf-depth.h"
+#include "parallel.h"
+#include "hashindex.h"
 //#include "equal-paths.h"
 
+// operation counters only get compiled in with -DBST_STATS (see the Makefile),
+// otherwise BST_STAT() throws its argument away and the trees don't even
+// carry the counters, so there's no cost at all. that changes the class
+// layout, so everything linked into one program has to agree on the flag
+#ifdef BST_STATS
+#define BST_STAT(expr) (expr)
+#else
+#define BST_STAT(expr) ((void)0)
+#endif
+
+/**
+* A snapshot of what a tree has been doing, returned by BinarySearchTree::stats().
+* The counters stay at zero unless the code was built with -DBST_STATS.
+* nodes, height and averageDepth describe the current shape and are always filled in.
+*/
+struct TreeStats
+{
+    TreeStats();
+
+    size_t lookups;             // internalFind descents
+    size_t lookupComparisons;   // nodes compared against during those descents
+    size_t inserts;
+    size_t insertComparisons;   // nodes compared against while looking for the insert spot
+    size_t removes;
+    size_t predecessorSwaps;    // nodeSwap calls made by remove
+
+    size_t rotations;           // every rotateLeft/rotateRight call
+    size_t singleLeft;          // AVL rebalance kinds
+    size_t singleRight;
+    size_t doubleLeftRight;
+    size_t doubleRightLeft;
+    size_t rebalanceCalls;      // rebalanceUp calls
+    size_t subtreeRebuilds;     // scapegoat rebuilds
+    size_t retraceSteps;        // nodes visited by rebalanceUp, i.e. total retracing distance
+
+    size_t nodes;
+    int height;                 // 0 for an empty tree, 1 for just a root
+    double averageDepth;        // root is at depth 0
+};
+
+inline TreeStats::TreeStats() :
+    lookups(0), lookupComparisons(0), inserts(0), insertComparisons(0),
+    removes(0), predecessorSwaps(0), rotations(0), singleLeft(0), singleRight(0),
+    doubleLeftRight(0), doubleRightLeft(0), rebalanceCalls(0), subtreeRebuilds(0), retraceSteps(0),
+    nodes(0), height(0), averageDepth(0.0)
+{
+
+}
+
+/**
+* Where a tree's memory goes, returned by BinarySearchTree::memoryUsage().
+* Only counts what the tree itself holds, not anything keys or values point to.
+*/
+struct MemoryUsage
+{
+    MemoryUsage();
+
+    size_t nodes;               // allocated nodes, tombstones included
+    size_t nodeBytes;           // what the allocator handed out for them
+    size_t payloadBytes;        // the key/value pairs of the live ones
+    size_t overheadBytes;       // everything else in use: links, balance/color, padding, the tree object, hash index, latency tracker
+    size_t deadBytes;           // held but holding nothing: tombstoned nodes, empty hash index slots
+    size_t totalBytes;          // payloadBytes + overheadBytes + deadBytes
+    double fragmentation;       // deadBytes / totalBytes
+};
+
+inline MemoryUsage::MemoryUsage() :
+    nodes(0), nodeBytes(0), payloadBytes(0), overheadBytes(0), deadBytes(0),
+    totalBytes(0), fragmentation(0.0)
+{
+
+}
+
+/**
+* What a tree's allocator actually hands out: nodes get allocated as a whole
+* number of these, so any node type is aligned and freeing one only needs
+* its footprint(), not its type.
+*/
+struct alignas(alignof(std::max_align_t)) NodeBlock
+{
+    unsigned char bytes[alignof(std::max_align_t)];
+};
+
 /**
  * A templated class for a Node in a search tree.
  * The getters for parent/left/right are virtual so
@@ -35,15 +131,16 @@ public:
     void setLeft(Node<Key, Value>* left);
     void setRight(Node<Key, Value>* right);
     void setValue(const Value &value);
+    bool isTombstone() const;
+    void setTombstone(bool dead);
+    virtual size_t footprint() const;
 
 protected:
     std::pair<const Key, Value> item_;
     Node<Key, Value>* parent_;
     Node<Key, Value>* left_;
     Node<Key, Value>* right_;
-
-    // declaration for checkDepth function from equal-paths.cpp ported over here
-    static int checkDepth(Node<Key,Value>* root);
+    bool tombstone_;    // removed in lazy delete mode, still in the tree until the next compact
 };
 
 /*
@@ -60,7 +157,8 @@ Node<Key, Value>::Node(const Key& key, const Value& value, Node<Key, Value>* par
     item_(key, value),
     parent_(parent),
     left_(NULL),
-    right_(NULL)
+    right_(NULL),
+    tombstone_(false)
 {
 
 }
@@ -184,30 +282,111 @@ void Node<Key, Value>::setValue(const Value& value)
     item_.second = value;
 }
 
+/**
+* True if the node was removed in lazy delete mode and is only waiting for
+* the tree to be compacted.
+*/
+template<typename Key, typename Value>
+bool Node<Key, Value>::isTombstone() const
+{
+    return tombstone_;
+}
+
+/**
+* A setter for the tombstone flag.
+*/
+template<typename Key, typename Value>
+void Node<Key, Value>::setTombstone(bool dead)
+{
+    tombstone_ = dead;
+}
+
+/**
+* How many bytes this node takes, i.e. sizeof its most derived type. Every
+* node type overrides it, so the tree can give a node back to its allocator
+* without knowing what kind it is.
+*/
+template<typename Key, typename Value>
+size_t Node<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
 /*
   ---------------------------------------
   End implementations for the Node class.
   ---------------------------------------
 */
 
+/**
+* Which value survives when merge() finds the same key in both trees.
+*/
+enum MergeConflict { MERGE_KEEP_THIS, MERGE_KEEP_OTHER };
+
+/**
+* Output format for BinarySearchTree::dump() (see dump_bst.h).
+*/
+enum DumpFormat { DUMP_DOT, DUMP_JSON };
+
 /**
 * A templated unbalanced binary search tree.
+* Nodes come from Allocator (anything std::allocator-like, and built as
+* C++17 a std::pmr::polymorphic_allocator too), rebound to NodeBlock. It gets
+* called from the worker threads when copying/clearing with setParallelism,
+* so an allocator that isn't thread safe means leaving parallelism at 1.
 */
-template <typename Key, typename Value>
+template <typename Key, typename Value, typename Allocator = std::allocator<std::pair<const Key, Value> > >
 class BinarySearchTree
 {
 public:
     BinarySearchTree(); //TODO
+    explicit BinarySearchTree(const Allocator& alloc);
+    BinarySearchTree(const BinarySearchTree& other);
+    BinarySearchTree(BinarySearchTree&& other) noexcept;
+    BinarySearchTree& operator=(const BinarySearchTree& other);
+    BinarySearchTree& operator=(BinarySearchTree&& other) noexcept(std::is_empty<Allocator>::value);
     virtual ~BinarySearchTree(); //TODO
     virtual void insert(const std::pair<const Key, Value>& keyValuePair); //TODO
     virtual void remove(const Key& key); //TODO
     void clear(); //TODO
     bool isBalanced() const; //TODO
+    int height() const;
+    bool validate() const;
+    bool equalPaths(unsigned threads = 1) const;
+    void setScapegoat(bool enabled, double alpha = 0.7);
+    void setFingerSearch(bool enabled);
+    void setHashIndex(bool enabled);
+    void setLazyDelete(bool enabled, double maxDeadRatio = 0.25);
+    void compact();
+    template<typename Pred>
+    size_t removeIf(Pred pred);
+    void setParallelism(unsigned threads, size_t grain = 65536);
+    void merge(BinarySearchTree<Key, Value, Allocator>& other, MergeConflict conflict = MERGE_KEEP_OTHER);
+    template<typename Fn>
+    void parallelForEach(Fn fn) const;
+    template<typename T, typename Op>
+    T parallelReduce(const T& init, Op op) const;
+    template<typename T, typename Fold, typename Combine>
+    T parallelReduce(const T& init, Fold fold, Combine combine) const;
     void print() const;
+    size_t size() const;
+    std::pair<const Key, Value>& front() const;
+    std::pair<const Key, Value>& back() const;
+    std::pair<Key, Value> popMin();
+    std::pair<Key, Value> popMax();
+    void dump(std::ostream& os, DumpFormat format = DUMP_DOT, int maxDepth = -1) const;
     bool empty() const;
-
-    template<typename PPKey, typename PPValue>
-    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue> & tree);
+    TreeStats stats() const;
+    void resetStats();
+    void enableLatencyTracking(uint32_t sampleEvery = 1);
+    void disableLatencyTracking();
+    const LatencyTracker* latency() const;
+    void printLatency(std::ostream& os = std::cout) const;
+    Allocator getAllocator() const;
+    MemoryUsage memoryUsage() const;
+
+    template<typename PPKey, typename PPValue, typename PPAllocator>
+    friend void prettyPrintBST(BinarySearchTree<PPKey, PPValue, PPAllocator> & tree);
 public:
     /**
     * An internal iterator class for traversing the contents of the BST.
@@ -226,7 +405,7 @@ public:
         iterator& operator++();
 
     protected:
-        friend class BinarySearchTree<Key, Value>;
+        friend class BinarySearchTree<Key, Value, Allocator>;
         iterator(Node<Key,Value>* ptr);
         Node<Key, Value> *current_;
     };
@@ -235,13 +414,27 @@ public:
     iterator begin() const;
     iterator end() const;
     iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    iterator erase(iterator pos);
+    iterator erase(iterator first, iterator last);
+    virtual void eraseRange(const Key& lo, const Key& hi);
     Value& operator[](const Key& key);
     Value const & operator[](const Key& key) const;
 
+    size_t exportKeys(Key* out, size_t capacity) const;
+    size_t exportValues(Value* out, size_t capacity) const;
+    size_t exportItems(Key* keys, Value* values, size_t capacity) const;
+    size_t exportItems(std::pair<Key, Value>* out, size_t capacity) const;
+    void exportKeys(std::vector<Key>& out) const;
+    void exportValues(std::vector<Value>& out) const;
+    void exportItems(std::vector<Key>& keys, std::vector<Value>& values) const;
+    void exportItems(std::vector<std::pair<Key, Value> >& out) const;
+
 protected:
     // Mandatory helper functions
     Node<Key, Value>* internalFind(const Key& k) const; // TODO
     Node<Key, Value> *getSmallestNode() const;  // TODO
+    Node<Key, Value> *getLargestNode() const;
     static Node<Key, Value>* predecessor(Node<Key, Value>* current); // TODO
     static Node<Key, Value>* successor(Node<Key, Value>* current); // added successor declaration as recommended in guide
     // Note:  static means these functions don't have a "this" pointer
@@ -252,11 +445,77 @@ protected:
     virtual void nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2) ;
 
     // Add helper functions here
+    int walkShape(bool requireBalanced, bool fullCheck) const;
+    virtual bool checkNode(Node<Key, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const;
+    virtual int nodeRank(Node<Key, Value>* node) const;
+    void afterPlace(Node<Key, Value>* newNode, int depth);
+    void rebuildSubtree(Node<Key, Value>* top);
+    Node<Key, Value>* buildFromVine(Node<Key, Value>*& vine, size_t count, Node<Key, Value>* parent, int& height);
+    virtual void rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight);
+    virtual void rebuiltTop(Node<Key, Value>* top);
+    static Node<Key, Value>* flattenToVine(Node<Key, Value>* top, size_t& count);
+    static size_t countNodes(Node<Key, Value>* top);
+    size_t destroySubtree(Node<Key, Value>* top) const;
+    static iterator iteratorAt(Node<Key, Value>* node);
+    virtual void removeNode(Node<Key, Value>* node);
+    Node<Key, Value>* internalLowerBound(const Key& key) const;
+    Node<Key, Value>* searchStart(const Key& key) const;
+    void moveFinger(Node<Key, Value>* node) const;
+    void forgetNode(Node<Key, Value>* node);
+    void discardNode(Node<Key, Value>* node);
+    void reviveNode(Node<Key, Value>* node);
+    static Node<Key, Value>* liveFrom(Node<Key, Value>* node);
+    static Node<Key, Value>* liveBefore(Node<Key, Value>* node);
+    void findExtremes();
+    std::pair<Key, Value> popEnd(bool smallest);
+    void indexNode(Node<Key, Value>* node);
+    void forgetSubtree(Node<Key, Value>* top);
+    void reindex();
+    template<typename Pred>
+    size_t rebuildWithout(Pred drop);
+    void rotateLeft(Node<Key, Value>* node);
+    void rotateRight(Node<Key, Value>* node);
+    virtual Node<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual void afterRotate(Node<Key, Value>* down);
+    virtual void subtreeChanged(Node<Key, Value>* node);
+    virtual Node<Key, Value>* cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const Allocator& alloc) const;
+    typedef typename std::allocator_traits<Allocator>::template rebind_alloc<NodeBlock> BlockAllocator;
+    template<typename N, typename... Args>
+    static N* makeNode(const Allocator& alloc, Args&&... args);
+    void freeNode(Node<Key, Value>* node) const;
+    Node<Key, Value>* cloneTree(const BinarySearchTree<Key, Value, Allocator>& other) const;
+    Node<Key, Value>* cloneSubtree(const BinarySearchTree<Key, Value, Allocator>& other, Node<Key, Value>* top, Node<Key, Value>* parent) const;
+    static size_t blocksFor(size_t bytes);
+    void destroyAll();
+    static size_t parallelPieces(size_t nodes, unsigned threads, size_t grain);
+    void takeFrom(BinarySearchTree<Key, Value, Allocator>& other);
+    template<typename Fn>
+    static void walkInOrder(Node<Key, Value>* top, Fn fn);
+    static void scanTasks(Node<Key, Value>* top, size_t pieces, std::vector<std::pair<Node<Key, Value>*, bool> >& tasks);
 
 
 protected:
     Node<Key, Value>* root_;
     // You should not need other data members
+    size_t size_;     // number of nodes
+    size_t maxSize_;  // largest size_ since the last full rebuild (scapegoat mode)
+    bool scapegoat_;
+    double scapegoatAlpha_;
+    LatencyTracker* latency_; // null unless enableLatencyTracking() was called
+    bool fingerSearch_;
+    HashIndex<Key, Node<Key, Value> >* hashIndex_; // NULL unless setHashIndex(true)
+    bool lazyDelete_;
+    double maxDeadRatio_;
+    size_t tombstones_; // dead nodes still in the tree (size_ counts them too)
+    mutable Node<Key, Value>* finger_; // last node a lookup/insert touched (finger search mode)
+    Node<Key, Value>* min_; // smallest and largest nodes (tombstones count), NULL when there are none
+    Node<Key, Value>* max_;
+    unsigned threads_; // for copying and tearing down, see setParallelism
+    size_t grain_;
+    Allocator alloc_; // where nodes come from (rebound to NodeBlock)
+#ifdef BST_STATS
+    mutable TreeStats stats_; // mutable since internalFind is const
+#endif
 };
 
 /*
@@ -268,8 +527,8 @@ Begin implementations for the BinarySearchTree::iterator class.
 /**
 * Explicit constructor that initializes an iterator with a given node pointer.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>::iterator::iterator(Node<Key,Value> *ptr)
 {
     current_ = ptr; // is it this easy??? 
 }
@@ -277,8 +536,8 @@ BinarySearchTree<Key, Value>::iterator::iterator(Node<Key,Value> *ptr)
 /**
 * A default constructor that initializes the iterator to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::iterator::iterator() 
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>::iterator::iterator() 
 {
     current_ = nullptr; // this should be already associated with a BST, so we can just set to NULL
 }
@@ -286,9 +545,9 @@ BinarySearchTree<Key, Value>::iterator::iterator()
 /**
 * Provides access to the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Allocator>
 std::pair<const Key,Value> &
-BinarySearchTree<Key, Value>::iterator::operator*() const
+BinarySearchTree<Key, Value, Allocator>::iterator::operator*() const
 {
     return current_->getItem();
 }
@@ -296,9 +555,9 @@ BinarySearchTree<Key, Value>::iterator::operator*() const
 /**
 * Provides access to the address of the item.
 */
-template<class Key, class Value>
+template<class Key, class Value, class Allocator>
 std::pair<const Key,Value> *
-BinarySearchTree<Key, Value>::iterator::operator->() const
+BinarySearchTree<Key, Value, Allocator>::iterator::operator->() const
 {
     return &(current_->getItem());
 }
@@ -307,10 +566,10 @@ BinarySearchTree<Key, Value>::iterator::operator->() const
 * Checks if 'this' iterator's internals have the same value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Allocator>
 bool
-BinarySearchTree<Key, Value>::iterator::operator==(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Allocator>::iterator::operator==(
+    const BinarySearchTree<Key, Value, Allocator>::iterator& rhs) const
 {
     return (current_ == rhs.current_); // check if the node pointers are the same, if yes then they should have same internals
 }
@@ -319,10 +578,10 @@ BinarySearchTree<Key, Value>::iterator::operator==(
 * Checks if 'this' iterator's internals have a different value
 * as 'rhs'
 */
-template<class Key, class Value>
+template<class Key, class Value, class Allocator>
 bool
-BinarySearchTree<Key, Value>::iterator::operator!=(
-    const BinarySearchTree<Key, Value>::iterator& rhs) const
+BinarySearchTree<Key, Value, Allocator>::iterator::operator!=(
+    const BinarySearchTree<Key, Value, Allocator>::iterator& rhs) const
 {
     return !(current_ == rhs.current_); // same deal as above but negated
 }
@@ -331,11 +590,11 @@ BinarySearchTree<Key, Value>::iterator::operator!=(
 /**
 * Advances the iterator's location using an in-order sequencing
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator&
-BinarySearchTree<Key, Value>::iterator::operator++()
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator&
+BinarySearchTree<Key, Value, Allocator>::iterator::operator++()
 {
-    current_ = BinarySearchTree<Key, Value>::successor(current_);
+    current_ = BinarySearchTree<Key, Value, Allocator>::liveFrom(BinarySearchTree<Key, Value, Allocator>::successor(current_));
     return *this; // TODO want this to return the iterator, but not sure if *this is correct over current_
 }
 
@@ -352,8 +611,8 @@ Begin implementations for the BinarySearchTree class.
 -----------------------------------------------------
 */
 
-template<typename Key, typename Value>
-Node<Key,Value>* BinarySearchTree<Key,Value>::successor(Node<Key,Value>* current) {
+template<typename Key, typename Value, typename Allocator>
+Node<Key,Value>* BinarySearchTree<Key, Value, Allocator>::successor(Node<Key,Value>* current) {
     // check if right child exists
     if(current->getRight() != nullptr) {
         Node<Key, Value>* kid = current->getRight();
@@ -383,54 +642,406 @@ Node<Key,Value>* BinarySearchTree<Key,Value>::successor(Node<Key,Value>* current
 /**
 * Default constructor for a BinarySearchTree, which sets the root to NULL.
 */
-template<class Key, class Value>
-BinarySearchTree<Key, Value>::BinarySearchTree() 
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>::BinarySearchTree() :
+    BinarySearchTree(Allocator())
+{
+
+}
+
+/**
+* Empty tree whose nodes will come from alloc.
+*/
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>::BinarySearchTree(const Allocator& alloc) :
+    alloc_(alloc)
 {
     // instantiate an empty tree
-    BinarySearchTree<Key, Value>::root_ = NULL;
+    BinarySearchTree<Key, Value, Allocator>::root_ = NULL;
+    size_ = 0;
+    maxSize_ = 0;
+    scapegoat_ = false;
+    scapegoatAlpha_ = 0.7;
+    latency_ = NULL;
+    fingerSearch_ = false;
+    hashIndex_ = NULL;
+    lazyDelete_ = false;
+    maxDeadRatio_ = 0.25;
+    tombstones_ = 0;
+    finger_ = NULL;
+    min_ = NULL;
+    max_ = NULL;
+    threads_ = 1;
+    grain_ = 65536;
 }
 
-template<typename Key, typename Value>
-BinarySearchTree<Key, Value>::~BinarySearchTree()
+/**
+* Copy constructor. Copies other's shape node for node in one pass (no
+* comparisons, no rebalancing), so every node's extra data like AVL balance
+* or RB color comes along as is. The settings come along too; the finger
+* and the stats start fresh, and latency tracking starts empty at the same
+* sampling rate. The allocator is whatever
+* select_on_container_copy_construction gives for other's.
+*/
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>::BinarySearchTree(const BinarySearchTree<Key, Value, Allocator>& other) :
+    alloc_(std::allocator_traits<Allocator>::select_on_container_copy_construction(other.alloc_))
 {
-    BinarySearchTree<Key, Value>::clear(); // use built in clear function
+    root_ = NULL;
+    size_ = 0;
+    maxSize_ = 0;
+    scapegoat_ = other.scapegoat_;
+    scapegoatAlpha_ = other.scapegoatAlpha_;
+    latency_ = NULL;
+    fingerSearch_ = other.fingerSearch_;
+    hashIndex_ = NULL;
+    lazyDelete_ = other.lazyDelete_;
+    maxDeadRatio_ = other.maxDeadRatio_;
+    tombstones_ = 0;
+    finger_ = NULL;
+    min_ = NULL;
+    max_ = NULL;
+    threads_ = other.threads_;
+    grain_ = other.grain_;
+
+    root_ = cloneTree(other);
+    size_ = other.size_;
+    maxSize_ = other.maxSize_;
+    tombstones_ = other.tombstones_;
+    findExtremes();
+    try {
+        setHashIndex(other.hashIndex_ != NULL);
+    }
+    catch(...) {
+        destroyAll();
+        throw;
+    }
+    if(other.latency_ != NULL) {
+        latency_ = new LatencyTracker(other.latency_->sampleEvery());
+    }
+}
+
+/**
+* Move constructor, O(1). Takes other's nodes and settings (and a copy of
+* its allocator) and leaves it empty.
+*/
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>::BinarySearchTree(BinarySearchTree<Key, Value, Allocator>&& other) noexcept :
+    alloc_(other.alloc_)
+{
+    root_ = NULL;
+    latency_ = NULL;
+    hashIndex_ = NULL;
+    takeFrom(other);
+}
+
+/**
+* Copy assignment, same deal as the copy constructor. The copy gets made
+* before the old nodes go, so if it throws this tree is left alone.
+* This tree keeps its own latency tracker and its own allocator.
+*/
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>& BinarySearchTree<Key, Value, Allocator>::operator=(const BinarySearchTree<Key, Value, Allocator>& other)
+{
+    if(this == &other) {
+        return *this;
+    }
+    Node<Key, Value>* copy = cloneTree(other);
+    destroyAll();
+
+    root_ = copy;
+    size_ = other.size_;
+    maxSize_ = other.maxSize_;
+    scapegoat_ = other.scapegoat_;
+    scapegoatAlpha_ = other.scapegoatAlpha_;
+    fingerSearch_ = other.fingerSearch_;
+    lazyDelete_ = other.lazyDelete_;
+    maxDeadRatio_ = other.maxDeadRatio_;
+    tombstones_ = other.tombstones_;
+    finger_ = NULL;
+    findExtremes();
+    threads_ = other.threads_;
+    grain_ = other.grain_;
+    setHashIndex(other.hashIndex_ != NULL);
+    return *this;
+}
+
+/**
+* Move assignment, frees whatever this tree had then takes over other's.
+* This tree keeps its own allocator, so if the two allocators don't compare
+* equal other's nodes can't be taken over and get copied instead (which can
+* throw, hence noexcept only for stateless allocators).
+*/
+template<class Key, class Value, class Allocator>
+BinarySearchTree<Key, Value, Allocator>& BinarySearchTree<Key, Value, Allocator>::operator=(BinarySearchTree<Key, Value, Allocator>&& other) noexcept(std::is_empty<Allocator>::value)
+{
+    if(this == &other) {
+        return *this;
+    }
+    if(!(alloc_ == other.alloc_)) {
+        *this = static_cast<const BinarySearchTree<Key, Value, Allocator>&>(other);
+        other.clear();
+        return *this;
+    }
+    destroyAll();
+    delete latency_;
+    delete hashIndex_;
+    takeFrom(other);
+    return *this;
+}
+
+template<typename Key, typename Value, typename Allocator>
+BinarySearchTree<Key, Value, Allocator>::~BinarySearchTree()
+{
+    BinarySearchTree<Key, Value, Allocator>::clear(); // use built in clear function
+    delete latency_;
+    delete hashIndex_;
 }
 
 /**
  * Returns true if tree is empty
 */
-template<class Key, class Value>
-bool BinarySearchTree<Key, Value>::empty() const
+template<class Key, class Value, class Allocator>
+bool BinarySearchTree<Key, Value, Allocator>::empty() const
 {
-    return root_ == NULL;
+    return size_ == tombstones_; // nothing but tombstones counts as empty
 }
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::print() const
+/**
+* Number of items in the tree, O(1) (tombstones don't count).
+*/
+template<class Key, class Value, class Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::size() const
+{
+    return size_ - tombstones_;
+}
+
+/**
+* The item with the smallest key, O(1) since the tree keeps track of it
+* (only tombstones at the very front add a step each).
+* Throws std::out_of_range if the tree is empty.
+*/
+template<class Key, class Value, class Allocator>
+std::pair<const Key, Value>& BinarySearchTree<Key, Value, Allocator>::front() const
+{
+    Node<Key, Value>* node = liveFrom(min_);
+    if(node == nullptr) {
+        throw std::out_of_range("front() on an empty tree");
+    }
+    return node->getItem();
+}
+
+/**
+* The item with the largest key, same deal as front().
+*/
+template<class Key, class Value, class Allocator>
+std::pair<const Key, Value>& BinarySearchTree<Key, Value, Allocator>::back() const
+{
+    Node<Key, Value>* node = liveBefore(max_);
+    if(node == nullptr) {
+        throw std::out_of_range("back() on an empty tree");
+    }
+    return node->getItem();
+}
+
+/**
+* Removes the item with the smallest key and returns it, for using the tree
+* as a priority queue. No descent: the node is already known and has no
+* left kid, so it's just the unlink plus whatever rebalancing that takes.
+* Always really removes, even in lazy delete mode, and any tombstones at
+* the front get cleared out on the way.
+* Throws std::out_of_range if the tree is empty.
+*/
+template<class Key, class Value, class Allocator>
+std::pair<Key, Value> BinarySearchTree<Key, Value, Allocator>::popMin()
+{
+    return popEnd(true);
+}
+
+/**
+* Removes the item with the largest key and returns it, same as popMin().
+*/
+template<class Key, class Value, class Allocator>
+std::pair<Key, Value> BinarySearchTree<Key, Value, Allocator>::popMax()
+{
+    return popEnd(false);
+}
+
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::print() const
 {
     printRoot(root_);
     std::cout << "\n";
 }
 
+/**
+* Returns the operation counters plus the current node count, height
+* and average node depth. The shape part walks the whole tree, so it's O(n).
+*/
+template<typename Key, typename Value, typename Allocator>
+TreeStats BinarySearchTree<Key, Value, Allocator>::stats() const
+{
+    TreeStats result;
+#ifdef BST_STATS
+    result = stats_;
+#endif
+
+    // walk with our own stack so degenerate trees can't blow the call stack
+    std::vector<std::pair<Node<Key, Value>*, int> > stack;
+    if(root_ != nullptr) {
+        stack.push_back(std::make_pair(root_, 0));
+    }
+    size_t depthSum = 0;
+    while(!stack.empty()) {
+        Node<Key, Value>* curr = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        ++result.nodes;
+        depthSum += depth;
+        if(depth + 1 > result.height) {
+            result.height = depth + 1;
+        }
+
+        if(curr->getLeft() != nullptr) {
+            stack.push_back(std::make_pair(curr->getLeft(), depth + 1));
+        }
+        if(curr->getRight() != nullptr) {
+            stack.push_back(std::make_pair(curr->getRight(), depth + 1));
+        }
+    }
+    result.averageDepth = (result.nodes == 0) ? 0.0 : (double)depthSum / result.nodes;
+    return result;
+}
+
+/**
+* Starts timing insert/remove/find/operator[]/clear calls on this tree.
+* Only every sampleEvery-th call gets timed so the clock reads stay cheap.
+* Calling it again resets the histograms.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::enableLatencyTracking(uint32_t sampleEvery)
+{
+    delete latency_;
+    latency_ = new LatencyTracker(sampleEvery);
+}
+
+/**
+* Stops timing and throws the histograms away.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::disableLatencyTracking()
+{
+    delete latency_;
+    latency_ = NULL;
+}
+
+/**
+* Returns the latency histograms, or NULL if tracking is off.
+*/
+template<typename Key, typename Value, typename Allocator>
+const LatencyTracker* BinarySearchTree<Key, Value, Allocator>::latency() const
+{
+    return latency_;
+}
+
+/**
+* Dumps the latency percentiles for every operation.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::printLatency(std::ostream& os) const
+{
+    if(latency_ == NULL) {
+        os << "latency tracking is off" << std::endl;
+        return;
+    }
+    latency_->print(os);
+}
+
+/**
+* A copy of the allocator nodes come from.
+*/
+template<typename Key, typename Value, typename Allocator>
+Allocator BinarySearchTree<Key, Value, Allocator>::getAllocator() const
+{
+    return alloc_;
+}
+
+/**
+* Adds up what this tree holds, in O(1): every node is the same type so one
+* footprint() covers all of them. Node sizes are what was asked of the
+* allocator, whatever it rounds up on its own end isn't visible from here.
+* The tree object itself counts as the base class.
+*/
+template<typename Key, typename Value, typename Allocator>
+MemoryUsage BinarySearchTree<Key, Value, Allocator>::memoryUsage() const
+{
+    MemoryUsage usage;
+    size_t perNode = (root_ != nullptr) ? blocksFor(root_->footprint()) * sizeof(NodeBlock) : 0;
+    usage.nodes = size_;
+    usage.nodeBytes = size_ * perNode;
+    usage.payloadBytes = (size_ - tombstones_) * sizeof(std::pair<const Key, Value>);
+    usage.deadBytes = tombstones_ * perNode;
+
+    size_t sideBytes = sizeof(*this);
+    if(hashIndex_ != NULL) {
+        size_t slots = hashIndex_->capacity();
+        sideBytes += sizeof(*hashIndex_) + hashIndex_->bytes();
+        if(slots != 0) {
+            usage.deadBytes += hashIndex_->bytes() / slots * (slots - hashIndex_->size());
+        }
+    }
+    if(latency_ != NULL) {
+        sideBytes += sizeof(*latency_);
+    }
+
+    usage.totalBytes = usage.nodeBytes + sideBytes;
+    usage.overheadBytes = usage.totalBytes - usage.payloadBytes - usage.deadBytes;
+    usage.fragmentation = (double)usage.deadBytes / usage.totalBytes;
+    return usage;
+}
+
+/**
+* Zeroes the operation counters (does nothing without -DBST_STATS).
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::resetStats()
+{
+#ifdef BST_STATS
+    stats_ = TreeStats();
+#endif
+}
+
 /**
 * Returns an iterator to the "smallest" item in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::begin() const
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::begin() const
 {
-    BinarySearchTree<Key, Value>::iterator begin(getSmallestNode());
+    BinarySearchTree<Key, Value, Allocator>::iterator begin(liveFrom(getSmallestNode()));
     return begin;
 }
 
+/**
+* Wraps a node in an iterator, for subclasses (the iterator's constructor
+* only lets BinarySearchTree itself in).
+*/
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::iteratorAt(Node<Key, Value>* node)
+{
+    return iterator(node);
+}
+
 /**
 * Returns an iterator whose value means INVALID
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::end() const
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::end() const
 {
-    BinarySearchTree<Key, Value>::iterator end(NULL);
+    BinarySearchTree<Key, Value, Allocator>::iterator end(NULL);
     return end;
 }
 
@@ -438,29 +1049,89 @@ BinarySearchTree<Key, Value>::end() const
 * Returns an iterator to the item with the given key, k
 * or the end iterator if k does not exist in the tree
 */
-template<class Key, class Value>
-typename BinarySearchTree<Key, Value>::iterator
-BinarySearchTree<Key, Value>::find(const Key & k) const
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::find(const Key & k) const
 {
+    LatencyProbe probe(latency_, OP_FIND);
     Node<Key, Value> *curr = internalFind(k);
-    BinarySearchTree<Key, Value>::iterator it(curr);
+    BinarySearchTree<Key, Value, Allocator>::iterator it(curr);
     return it;
 }
 
+/**
+* Returns an iterator to the first item whose key is >= key,
+* or the end iterator if there isn't one
+*/
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::lowerBound(const Key& key) const
+{
+    return iterator(liveFrom(internalLowerBound(key)));
+}
+
+/**
+* Removes the item pos points at and returns an iterator to the one after it.
+* No second lookup, the node gets unlinked directly. pos must be a valid,
+* non-end iterator into this tree; other iterators stay valid except ones to pos.
+*/
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::erase(iterator pos)
+{
+    LatencyProbe probe(latency_, OP_REMOVE);
+    if(pos.current_ == NULL) {
+        return end();
+    }
+    // grab the next node first, removal moves nodes around but never frees anybody but pos
+    Node<Key, Value>* next = liveFrom(successor(pos.current_));
+    discardNode(pos.current_);
+    return iterator(next);
+}
+
+/**
+* Removes every item in [first, last) and returns last.
+*/
+template<class Key, class Value, class Allocator>
+typename BinarySearchTree<Key, Value, Allocator>::iterator
+BinarySearchTree<Key, Value, Allocator>::erase(iterator first, iterator last)
+{
+    while(first != last) {
+        first = erase(first);
+    }
+    return last;
+}
+
+/**
+* Removes every item with lo <= key < hi. Here it's one descent plus a
+* removeNode per item; AVLTree overrides it to cut the whole range out
+* at once.
+*/
+template<class Key, class Value, class Allocator>
+void BinarySearchTree<Key, Value, Allocator>::eraseRange(const Key& lo, const Key& hi)
+{
+    iterator it = lowerBound(lo);
+    while(it != end() && it->first < hi) {
+        it = erase(it);
+    }
+}
+
 /**
  * @precondition The key exists in the map
  * Returns the value associated with the key
  */
-template<class Key, class Value>
-Value& BinarySearchTree<Key, Value>::operator[](const Key& key)
+template<class Key, class Value, class Allocator>
+Value& BinarySearchTree<Key, Value, Allocator>::operator[](const Key& key)
 {
+    LatencyProbe probe(latency_, OP_INDEX);
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
 }
-template<class Key, class Value>
-Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
+template<class Key, class Value, class Allocator>
+Value const & BinarySearchTree<Key, Value, Allocator>::operator[](const Key& key) const
 {
+    LatencyProbe probe(latency_, OP_INDEX);
     Node<Key, Value> *curr = internalFind(key);
     if(curr == NULL) throw std::out_of_range("Invalid key");
     return curr->getValue();
@@ -472,24 +1143,33 @@ Value const & BinarySearchTree<Key, Value>::operator[](const Key& key) const
 * Recall: If key is already in the tree, you should 
 * overwrite the current value with the updated value.
 */
-template<class Key, class Value>
-void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &keyValuePair)
+template<class Key, class Value, class Allocator>
+void BinarySearchTree<Key, Value, Allocator>::insert(const std::pair<const Key, Value> &keyValuePair)
 {
     // TODO DEF COME BACK
+    LatencyProbe probe(latency_, OP_INSERT);
+    BST_STAT(++stats_.inserts);
 
     // if tree is empty, we can just insert at root and skip the rest
     if(root_ == NULL) {
-        root_ = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, NULL);
+        root_ = createNode(keyValuePair.first, keyValuePair.second, NULL);
+        afterPlace(root_, 0);
         return;
     }
 
-    Node<Key, Value>* curr = root_; 
+    // scapegoat mode needs the real depth of the new node, so it always starts from the root
+    Node<Key, Value>* curr = scapegoat_ ? root_ : searchStart(keyValuePair.first);
+    int depth = 1; // depth of curr's children, which is where a new node would go
 
     // in this loop, walk thru tree to find if key already exists or where to insert new node
     while(true) {
+        BST_STAT(++stats_.insertComparisons);
+
         // key already exists, so just update value and return
         if(keyValuePair.first == curr->getKey()) {
             curr->setValue(keyValuePair.second);
+            reviveNode(curr);
+            moveFinger(curr);
             return;
         }
 
@@ -499,26 +1179,32 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
         else if(keyValuePair.first < curr->getKey()) {
             // no left child, so we can insert to left
             if(curr->getLeft() == NULL) {
-                Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, curr); // REMEMBER TO FREE
+                Node<Key, Value>* newNode = createNode(keyValuePair.first, keyValuePair.second, curr); // REMEMBER TO FREE
                 curr->setLeft(newNode);
+                moveFinger(newNode);
+                afterPlace(newNode, depth);
                 return; // placed node, so we can end here
             }
             // left child exists, so take it from top of loop
             else {
                 curr = curr->getLeft();
+                ++depth;
             }
         }
         // key is greater than current, so go right
         else {
             // no right child, so we can insert to right
             if(curr->getRight() == NULL) {
-                Node<Key, Value>* newNode = new Node<Key, Value>(keyValuePair.first, keyValuePair.second, curr); // REMEMBER TO FREE
+                Node<Key, Value>* newNode = createNode(keyValuePair.first, keyValuePair.second, curr); // REMEMBER TO FREE
                 curr->setRight(newNode);
+                moveFinger(newNode);
+                afterPlace(newNode, depth);
                 return; // placed node, so we can end here
             }
             // right child exists, so take it from top of loop
             else {
                 curr = curr->getRight();
+                ++depth;
             }
         }
     }
@@ -530,16 +1216,29 @@ void BinarySearchTree<Key, Value>::insert(const std::pair<const Key, Value> &key
 * Recall: The writeup specifies that if a node has 2 children you
 * should swap with the predecessor and then remove.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::remove(const Key& key)
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::remove(const Key& key)
 {
     // TODO DEF COME BACK
+    LatencyProbe probe(latency_, OP_REMOVE);
 
     // error catch if key not in tree already
     Node<Key, Value>* nodeToRemove = internalFind(key);
     if(nodeToRemove == nullptr) {
         return; // key not found
     }
+    discardNode(nodeToRemove);
+}
+
+/**
+* Takes out a node we already have a pointer to and frees it, so remove(),
+* erase() and friends don't have to look it up again. Subclasses override
+* this (rather than remove) to do their own rebalancing.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::removeNode(Node<Key, Value>* nodeToRemove)
+{
+    BST_STAT(++stats_.removes);
 
     // check to see if nodeToRemove has 2 kids, if so then we swap until there's only <=1 kid associated with it 
     while (nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr) {
@@ -582,14 +1281,21 @@ void BinarySearchTree<Key, Value>::remove(const Key& key)
         }
     }
 
-    delete nodeToRemove;
+    freeNode(nodeToRemove);
+    --size_;
+
+    // scapegoat mode: once enough has been deleted since the last full rebuild, redo the whole thing
+    if(scapegoat_ && root_ != nullptr && size_ < scapegoatAlpha_ * maxSize_) {
+        rebuildSubtree(root_);
+        maxSize_ = size_;
+    }
 }
 
 
 
-template<class Key, class Value>
+template<class Key, class Value, class Allocator>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
+BinarySearchTree<Key, Value, Allocator>::predecessor(Node<Key, Value>* current)
 {
     // TODO
 
@@ -628,37 +1334,42 @@ BinarySearchTree<Key, Value>::predecessor(Node<Key, Value>* current)
 * A method to remove all contents of the tree and
 * reset the values in the tree for use again.
 */
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::clear()
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::clear()
 {
     // TODO
-    while(root_ != nullptr) {
-        remove(root_->getKey()); // keep removing root until tree is empty
-    }    
+    LatencyProbe probe(latency_, OP_CLEAR);
+    // nothing is left to keep balanced, so just free every node (in parallel if it's set up)
+    destroyAll();
+    size_ = 0;
+    maxSize_ = 0;
+    finger_ = nullptr;
+    tombstones_ = 0;
+    if(hashIndex_ != NULL) {
+        hashIndex_->clear();
+    }
 }
 
 
 /**
 * A helper function to find the smallest node in the tree.
+* It's kept up to date as the tree changes (see findExtremes), so this is O(1).
 */
-template<typename Key, typename Value>
+template<typename Key, typename Value, typename Allocator>
 Node<Key, Value>*
-BinarySearchTree<Key, Value>::getSmallestNode() const
+BinarySearchTree<Key, Value, Allocator>::getSmallestNode() const
 {
-    // TODO
-
-    // error catch if tree is empty
-    if(root_ == nullptr) {
-        return nullptr;
-    }
-
-    // walk down left until we can't anymore (left child always smaller than right/parent)
-    Node<Key, Value>* curr = root_;
-    while(curr->getLeft() != NULL) {
-        curr = curr->getLeft();
-    }
+    return min_;
+}
 
-    return curr;
+/**
+* Same for the largest node.
+*/
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>*
+BinarySearchTree<Key, Value, Allocator>::getLargestNode() const
+{
+    return max_;
 }
 
 /**
@@ -666,17 +1377,31 @@ BinarySearchTree<Key, Value>::getSmallestNode() const
 * return a pointer to it or NULL if no item with that key
 * exists
 */
-template<typename Key, typename Value>
-Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) const
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::internalFind(const Key& key) const
 {
     // TODO
-    Node<Key, Value>* curr = root_;
+    BST_STAT(++stats_.lookups);
+    if(hashIndex_ != NULL) {
+        // hit or miss, the index has the final say
+        Node<Key, Value>* hit = hashIndex_->find(key);
+        if(hit != nullptr) {
+            moveFinger(hit);
+        }
+        return hit;
+    }
+    Node<Key, Value>* curr = searchStart(key);
+    Node<Key, Value>* last = curr;
 
     // walk thru tree to find key
     while(curr != nullptr) {
-        // found key, just return pointer
+        BST_STAT(++stats_.lookupComparisons);
+        last = curr;
+
+        // found key, just return pointer (unless it's been lazily deleted)
         if(key == curr->getKey()) {
-            return curr;
+            moveFinger(curr);
+            return curr->isTombstone() ? nullptr : curr;
         }
         // key is less than current, so go left
         else if(key < curr->getKey()) {
@@ -687,95 +1412,1586 @@ Node<Key, Value>* BinarySearchTree<Key, Value>::internalFind(const Key& key) con
             curr = curr->getRight();
         }
     }
+    // a miss still leaves the finger where the key would have been
+    moveFinger(last);
     return nullptr; // key not in tree
 }
 
 /**
- * Return true iff the BST is balanced.
- */
-template<typename Key, typename Value>
-bool BinarySearchTree<Key, Value>::isBalanced() const
+* Where a search for key should start. Normally that's the root, but in
+* finger search mode it's the lowest node at or above the finger whose
+* subtree has to hold key (or the slot key would be inserted into).
+* Climbing stops as soon as the next ancestor on the far side of the
+* finger is past key, so a key d places away costs O(log d) in a
+* balanced tree instead of a full O(log n) descent.
+*/
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::searchStart(const Key& key) const
 {
-    // TODO
-   //return checkDepth(root_) != -1; // i think we can just use the helper fxn from equalPaths? this is asking for the same thing basically 
+    Node<Key, Value>* curr = finger_;
+    if(!fingerSearch_ || curr == nullptr) {
+        return root_;
+    }
 
-    return checkBalanced(root_) != -1; // testing new helper fxn
-}
+    while(true) {
+        BST_STAT(++stats_.lookupComparisons);
+        if(key == curr->getKey()) {
+            return curr;
+        }
+        bool goRight = curr->getKey() < key;
 
-// helper function for isBalanced, returns -1 if unbalanced, else returns depth of subtree
-template<typename Key, typename Value>
-static int checkDepth(Node<Key,Value> *root) {
-    // base case, no children/empty subtree
-    if (root == nullptr){
-        return -2; 
+        // ancestors we reach from the same side are all on the wrong side of curr, skip them
+        Node<Key, Value>* top = curr;
+        while(top->getParent() != nullptr &&
+              top == (goRight ? top->getParent()->getRight() : top->getParent()->getLeft())) {
+            top = top->getParent();
+        }
+
+        // the first ancestor the other way bounds curr's subtree on the side key is on
+        Node<Key, Value>* bound = top->getParent();
+        if(bound == nullptr) {
+            return curr;
+        }
+        BST_STAT(++stats_.lookupComparisons);
+        if(goRight ? key < bound->getKey() : bound->getKey() < key) {
+            return curr;
+        }
+        curr = bound;
     }
+}
 
-    // base case leaf node
-    if (root->left_ == nullptr && root->right_ == nullptr){
-        return 0; 
+// lookups and inserts leave the finger on the node they ended at, but only in
+// finger search mode: with it off, const lookups must not write anything so
+// readers can share the tree
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::moveFinger(Node<Key, Value>* node) const
+{
+    if(fingerSearch_) {
+        finger_ = node;
     }
+}
 
-    // check left and right subtrees for depth
-    int leftTree = checkDepth(root->left_);
-    if (leftTree == -1){
-        return -1; // depth doesn't match in left subtree
+// call before unlinking and freeing a node so neither the finger, the hash index
+// nor min_/max_ point at garbage
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::forgetNode(Node<Key, Value>* node)
+{
+    if(finger_ == node) {
+        finger_ = nullptr;
     }
-    int rightTree = checkDepth(root->right_);
-    if (rightTree == -1){
-        return -1; // depth doesn't match in right subtree
+    if(min_ == node) {
+        min_ = successor(node);
     }
-
-    // check for missing kids (that sounds weird in retrospect)
-    if (leftTree == -2){
-        return rightTree + 1; // no left child, use right depth
+    if(max_ == node) {
+        max_ = predecessor(node);
     }
-    if (rightTree == -2){
-        return leftTree + 1; // no right child, use left depth
+    if(hashIndex_ != NULL) {
+        hashIndex_->erase(node->getKey());
     }
-
-    // now we know both kids are there, so compare depths
-    return (leftTree == rightTree) ? (leftTree + 1) : -1;
 }
 
-// helper function for isBalanced, returns -1 if unbalanced, else returns height of subtree
-// testing this out since checkDepth is a little broken lol
-template<typename Key, typename Value>
-static int checkBalanced(Node<Key,Value>* node) {
-    // base case
-    if (node == nullptr) {
-        return 0;
+// what remove/erase do with a node they've found: unlink and free it, or in
+// lazy delete mode just mark it dead (compacting if that makes too many)
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::discardNode(Node<Key, Value>* node)
+{
+    if(!lazyDelete_) {
+        forgetNode(node);
+        removeNode(node);
+        return;
+    }
+    BST_STAT(++stats_.removes);
+    node->setTombstone(true);
+    ++tombstones_;
+    if(hashIndex_ != NULL) {
+        hashIndex_->erase(node->getKey());
+    }
+    subtreeChanged(node);
+    if(tombstones_ > maxDeadRatio_ * size_) {
+        compact();
     }
+}
 
-    // recurse down left subtree 
-    int leftTree = checkBalanced(node->getLeft());
-    if (leftTree == -1) {
-        return -1;
+// insert found node's key already there, bring it back if it was dead
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::reviveNode(Node<Key, Value>* node)
+{
+    if(!node->isTombstone()) {
+        return;
     }
+    node->setTombstone(false);
+    --tombstones_;
+    indexNode(node);
+}
 
-    // recurse down right subtree
-    int rightTree = checkBalanced(node->getRight());
-    // right subtree unbalanced
-    if (rightTree == -1){
-        return -1;
+// node itself if it's live, otherwise the next live one after it (NULL if none)
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::liveFrom(Node<Key, Value>* node)
+{
+    while(node != nullptr && node->isTombstone()) {
+        node = successor(node);
+    }
+    return node;
+}
+
+// same but going down: node if it's live, otherwise the closest live one before it
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::liveBefore(Node<Key, Value>* node)
+{
+    while(node != nullptr && node->isTombstone()) {
+        node = predecessor(node);
+    }
+    return node;
+}
+
+// recomputes min_/max_ down the two spines, for after the tree got put
+// together some other way than one insert/remove at a time. O(height)
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::findExtremes()
+{
+    min_ = root_;
+    max_ = root_;
+    if(root_ == nullptr) {
+        return;
+    }
+    while(min_->getLeft() != nullptr) {
+        min_ = min_->getLeft();
+    }
+    while(max_->getRight() != nullptr) {
+        max_ = max_->getRight();
+    }
+}
+
+// popMin/popMax: frees min_ (or max_) until a live one comes up, and hands that one back
+template<typename Key, typename Value, typename Allocator>
+std::pair<Key, Value> BinarySearchTree<Key, Value, Allocator>::popEnd(bool smallest)
+{
+    LatencyProbe probe(latency_, OP_REMOVE);
+    if(empty()) {
+        throw std::out_of_range(smallest ? "popMin() on an empty tree" : "popMax() on an empty tree");
+    }
+    Node<Key, Value>* node = smallest ? min_ : max_;
+    while(node->isTombstone()) {
+        forgetNode(node);
+        removeNode(node);
+        --tombstones_;
+        node = smallest ? min_ : max_;
+    }
+    std::pair<Key, Value> item(node->getKey(), node->getValue());
+    forgetNode(node);
+    removeNode(node);
+    return item;
+}
+
+// call once a brand new node is in the tree. nodes keep their key for life
+// (nodeSwap and rotations move whole nodes), so neither the index nor
+// min_/max_ ever need fixing up after
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::indexNode(Node<Key, Value>* node)
+{
+    if(hashIndex_ != NULL) {
+        hashIndex_->insert(node);
+    }
+    if(min_ == nullptr || node->getKey() < min_->getKey()) {
+        min_ = node;
+    }
+    if(max_ == nullptr || max_->getKey() < node->getKey()) {
+        max_ = node;
+    }
+}
+
+// forgetNode for a whole subtree that's about to be freed at once: drops it from
+// the hash index and stops counting its tombstones. the caller clears the finger
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::forgetSubtree(Node<Key, Value>* top)
+{
+    if(hashIndex_ == NULL && tombstones_ == 0) {
+        return;
+    }
+    walkInOrder(top, [this](Node<Key, Value>* node) {
+        if(node->isTombstone()) {
+            --tombstones_;
+        }
+        else if(hashIndex_ != NULL) {
+            hashIndex_->erase(node->getKey());
+        }
+        return true;
+    });
+}
+
+// refills the hash index from scratch, for after nodes came in from somewhere else
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::reindex()
+{
+    if(hashIndex_ == NULL) {
+        return;
+    }
+    hashIndex_->clear();
+    hashIndex_->reserve(size_ - tombstones_);
+    walkInOrder(root_, [this](Node<Key, Value>* node) {
+        if(!node->isTombstone()) {
+            hashIndex_->insert(node);
+        }
+        return true;
+    });
+}
+
+/**
+* Helper function to find the node with the smallest key >= key,
+* or NULL if every key is smaller
+*/
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::internalLowerBound(const Key& key) const
+{
+    Node<Key, Value>* curr = root_;
+    Node<Key, Value>* best = nullptr;
+    while(curr != nullptr) {
+        // curr is a candidate, but something smaller to the left might still work
+        if(!(curr->getKey() < key)) {
+            best = curr;
+            curr = curr->getLeft();
+        }
+        else {
+            curr = curr->getRight();
+        }
     }
+    return best;
+}
+
+/**
+ * Return true iff the BST is balanced.
+ */
+template<typename Key, typename Value, typename Allocator>
+bool BinarySearchTree<Key, Value, Allocator>::isBalanced() const
+{
+    // TODO
+
+    return walkShape(true, false) != -1; // iterative now, see walkShape
+}
+
+/**
+ * Returns true if every leaf is the same distance from the root, same check as
+ * equalPaths() in equal-paths.cpp (both use leaf-depth.h). threads > 1 splits the
+ * work across threads, 0 means one per core.
+ */
+template<typename Key, typename Value, typename Allocator>
+bool BinarySearchTree<Key, Value, Allocator>::equalPaths(unsigned threads) const
+{
+    if(threads == 1) {
+        return equalLeafDepths(root_);
+    }
+    return equalLeafDepths(root_, threads);
+}
+
+/**
+* Copies up to capacity keys, smallest first, into out and returns how many
+* it wrote. One in-order pass with a stack instead of iterator ++ (which
+* climbs parents), and nothing gets allocated unless the tree is more than
+* 64 levels deep. Size out off of the item count to get everything.
+*/
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::exportKeys(Key* out, size_t capacity) const
+{
+    size_t written = 0;
+    walkInOrder(root_, [&](Node<Key, Value>* node) {
+        if(node->isTombstone()) {
+            return true;
+        }
+        if(written == capacity) {
+            return false;
+        }
+        out[written++] = node->getKey();
+        return true;
+    });
+    return written;
+}
+
+/**
+* Same as exportKeys, for the values (in key order).
+*/
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::exportValues(Value* out, size_t capacity) const
+{
+    size_t written = 0;
+    walkInOrder(root_, [&](Node<Key, Value>* node) {
+        if(node->isTombstone()) {
+            return true;
+        }
+        if(written == capacity) {
+            return false;
+        }
+        out[written++] = node->getValue();
+        return true;
+    });
+    return written;
+}
+
+/**
+* Keys and values in one pass, into two separate arrays (structure of arrays).
+*/
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::exportItems(Key* keys, Value* values, size_t capacity) const
+{
+    size_t written = 0;
+    walkInOrder(root_, [&](Node<Key, Value>* node) {
+        if(node->isTombstone()) {
+            return true;
+        }
+        if(written == capacity) {
+            return false;
+        }
+        keys[written] = node->getKey();
+        values[written] = node->getValue();
+        ++written;
+        return true;
+    });
+    return written;
+}
+
+/**
+* Keys and values in one pass, as pairs in one array.
+*/
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::exportItems(std::pair<Key, Value>* out, size_t capacity) const
+{
+    size_t written = 0;
+    walkInOrder(root_, [&](Node<Key, Value>* node) {
+        if(node->isTombstone()) {
+            return true;
+        }
+        if(written == capacity) {
+            return false;
+        }
+        out[written].first = node->getKey();
+        out[written].second = node->getValue();
+        ++written;
+        return true;
+    });
+    return written;
+}
+
+/**
+* Replaces out's contents with every key in order. out gets sized once up front.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::exportKeys(std::vector<Key>& out) const
+{
+    out.resize(size_ - tombstones_);
+    out.resize(exportKeys(out.data(), out.size()));
+}
+
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::exportValues(std::vector<Value>& out) const
+{
+    out.resize(size_ - tombstones_);
+    out.resize(exportValues(out.data(), out.size()));
+}
 
-    // now check balance btwn subtrees
-    int diff = (leftTree > rightTree) ? (leftTree - rightTree) : (rightTree - leftTree); // could make this an if statement but it looks cuter this way (i hate nesting) 
-    if (diff > 1){
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::exportItems(std::vector<Key>& keys, std::vector<Value>& values) const
+{
+    keys.resize(size_ - tombstones_);
+    values.resize(size_ - tombstones_);
+    size_t written = exportItems(keys.data(), values.data(), keys.size());
+    keys.resize(written);
+    values.resize(written);
+}
+
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::exportItems(std::vector<std::pair<Key, Value> >& out) const
+{
+    out.resize(size_ - tombstones_);
+    out.resize(exportItems(out.data(), out.size()));
+}
+
+// cuts the subtree at top into about `pieces` tasks, appended to tasks in key
+// order. a cut node becomes a task of its own (second = false) and the rest of
+// the budget gets split between its kids, halves for a balanced tree. a missing
+// kid passes its share to the other one, so chains still end up cut (if not evenly)
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::scanTasks(Node<Key, Value>* top, size_t pieces, std::vector<std::pair<Node<Key, Value>*, bool> >& tasks)
+{
+    if(top == nullptr) {
+        return;
+    }
+    if(pieces <= 1) {
+        tasks.push_back(std::make_pair(top, true));
+        return;
+    }
+    Node<Key, Value>* left = top->getLeft();
+    Node<Key, Value>* right = top->getRight();
+    size_t rest = pieces - 1;
+    size_t leftPieces = (left == nullptr) ? 0 : (right == nullptr) ? rest : rest / 2;
+    scanTasks(left, leftPieces, tasks);
+    tasks.push_back(std::make_pair(top, false));
+    scanTasks(right, rest - leftPieces, tasks);
+}
+
+// calls fn(node) on every node under top in key order, stopping early if fn
+// returns false. the stack lives in a fixed array unless the tree is really deep
+template<typename Key, typename Value, typename Allocator>
+template<typename Fn>
+void BinarySearchTree<Key, Value, Allocator>::walkInOrder(Node<Key, Value>* top, Fn fn)
+{
+    static const size_t FIXED_DEPTH = 64;
+    Node<Key, Value>* fixed[FIXED_DEPTH];
+    std::vector<Node<Key, Value>*> spill; // anything deeper than FIXED_DEPTH
+    size_t depth = 0;
+
+    Node<Key, Value>* curr = top;
+    while(curr != nullptr || depth != 0) {
+        while(curr != nullptr) {
+            if(depth < FIXED_DEPTH) {
+                fixed[depth] = curr;
+            }
+            else {
+                spill.push_back(curr);
+            }
+            ++depth;
+            curr = curr->getLeft();
+        }
+
+        --depth;
+        if(depth < FIXED_DEPTH) {
+            curr = fixed[depth];
+        }
+        else {
+            curr = spill.back();
+            spill.pop_back();
+        }
+        if(!fn(curr)) {
+            return;
+        }
+        curr = curr->getRight();
+    }
+}
+
+/**
+ * Returns the height of the tree (0 when empty, 1 for just a root).
+ */
+template<typename Key, typename Value, typename Allocator>
+int BinarySearchTree<Key, Value, Allocator>::height() const
+{
+    return walkShape(false, false);
+}
+
+/**
+ * Returns true iff every invariant holds: keys are strictly increasing in order,
+ * every child points back at its parent, the root has no parent, and
+ * checkNode() is happy with every node (AVL balance factors etc).
+ */
+template<typename Key, typename Value, typename Allocator>
+bool BinarySearchTree<Key, Value, Allocator>::validate() const
+{
+    return walkShape(false, true) != -1;
+}
+
+// per-node hook for validate(), plain BSTs don't have anything extra to check.
+// the ranks are the subtree heights counting only nodes with nodeRank() == 1
+// (red-black trees use that for black heights)
+template<typename Key, typename Value, typename Allocator>
+bool BinarySearchTree<Key, Value, Allocator>::checkNode(Node<Key, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const
+{
+    (void)node;
+    (void)leftHeight;
+    (void)rightHeight;
+    (void)leftRank;
+    (void)rightRank;
+    return true;
+}
+
+// how much a node counts towards the ranks handed to checkNode()
+template<typename Key, typename Value, typename Allocator>
+int BinarySearchTree<Key, Value, Allocator>::nodeRank(Node<Key, Value>* node) const
+{
+    (void)node;
+    return 1;
+}
+
+// helper for isBalanced/height/validate, returns -1 if a check failed, else returns the height
+// this used to be a recursive checkBalanced, but a sorted-input BST is one long stick and
+// that blew the stack around 100K nodes, so it's a post-order walk with our own stack now
+template<typename Key, typename Value, typename Allocator>
+int BinarySearchTree<Key, Value, Allocator>::walkShape(bool requireBalanced, bool fullCheck) const
+{
+    if(root_ == nullptr) {
+        return 0;
+    }
+    if(fullCheck && root_->getParent() != nullptr) {
         return -1;
     }
 
-    // balanced, might as well return the height lol
-    return 1 + ((leftTree > rightTree) ? leftTree : rightTree); // could make this an if statement but it looks cuter this way (i hate nesting)
+    // state 0 = haven't gone left yet, 1 = left is done, 2 = right is done too
+    struct Frame {
+        Node<Key, Value>* node;
+        int leftHeight;
+        int leftRank;
+        int state;
+    };
+    std::vector<Frame> stack;
+    Frame first = { root_, 0, 0, 0 };
+    stack.push_back(first);
+
+    int childHeight = 0; // height handed back by whichever subtree just finished
+    int childRank = 0;   // same but only counting nodeRank(), only tracked for fullCheck
+    Node<Key, Value>* prev = nullptr; // last node visited in order
+
+    while(!stack.empty()) {
+        Node<Key, Value>* node = stack.back().node;
+
+        if(stack.back().state == 0) {
+            stack.back().state = 1;
+            Node<Key, Value>* left = node->getLeft();
+            if(left != nullptr) {
+                if(fullCheck && left->getParent() != node) {
+                    return -1;
+                }
+                Frame next = { left, 0, 0, 0 };
+                stack.push_back(next);
+                continue;
+            }
+            childHeight = 0;
+            childRank = 0;
+        }
+
+        if(stack.back().state == 1) {
+            stack.back().leftHeight = childHeight;
+            stack.back().leftRank = childRank;
+            stack.back().state = 2;
+
+            // in-order spot, so the keys should be going up
+            if(fullCheck) {
+                if(prev != nullptr && !(prev->getKey() < node->getKey())) {
+                    return -1;
+                }
+                prev = node;
+            }
+
+            Node<Key, Value>* right = node->getRight();
+            if(right != nullptr) {
+                if(fullCheck && right->getParent() != node) {
+                    return -1;
+                }
+                Frame next = { right, 0, 0, 0 };
+                stack.push_back(next);
+                continue;
+            }
+            childHeight = 0;
+            childRank = 0;
+        }
+
+        // both subtrees done
+        int leftHeight = stack.back().leftHeight;
+        int rightHeight = childHeight;
+        if(requireBalanced && (leftHeight - rightHeight > 1 || rightHeight - leftHeight > 1)) {
+            return -1;
+        }
+        if(fullCheck) {
+            int leftRank = stack.back().leftRank;
+            int rightRank = childRank;
+            if(!checkNode(node, leftHeight, rightHeight, leftRank, rightRank)) {
+                return -1;
+            }
+            childRank = nodeRank(node) + ((leftRank > rightRank) ? leftRank : rightRank);
+        }
+        childHeight = 1 + ((leftHeight > rightHeight) ? leftHeight : rightHeight);
+        stack.pop_back();
+    }
+
+    return childHeight;
 }
 
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
+/**
+* Turns scapegoat mode on or off for the plain BinarySearchTree insert/remove.
+* It doesn't add anything to the nodes, it just tracks the size and, when an
+* insert lands deeper than log base 1/alpha of the size, rebuilds the lowest
+* ancestor whose subtree is lopsided (one side holds more than alpha of it).
+* That keeps insert/find/remove at amortized O(log n). alpha has to be in
+* (0.5, 1), lower means more balanced but more rebuilding.
+* Turning it on also straightens out the tree if it's already too tall.
+* (AVLTree does its own balancing, so this has no effect there.)
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::setScapegoat(bool enabled, double alpha)
+{
+    if(alpha <= 0.5 || alpha >= 1.0) {
+        throw std::invalid_argument("scapegoat alpha must be in (0.5, 1)");
+    }
+    scapegoat_ = enabled;
+    scapegoatAlpha_ = alpha;
+    maxSize_ = size_;
+
+    if(enabled && root_ != nullptr && height() - 1 > std::log((double)size_) / std::log(1.0 / alpha)) {
+        rebuildSubtree(root_);
+    }
+}
+
+/**
+* Moves every item of other into this tree, leaving other empty. Both trees
+* get flattened into sorted lists, the lists get zipped together and the
+* result is rebuilt perfectly balanced, so it's O(n + m) with no
+* allocation: the nodes themselves move over, except that on a duplicate
+* key the losing node (picked by conflict) is freed.
+* Both trees have to be the same kind (AVLTree with AVLTree, etc.) with
+* allocators that compare equal (nodes move between them), otherwise this
+* throws std::invalid_argument and neither tree changes.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::merge(BinarySearchTree<Key, Value, Allocator>& other, MergeConflict conflict)
+{
+    if(&other == this || other.root_ == nullptr) {
+        return;
+    }
+    if(typeid(*this) != typeid(other)) {
+        throw std::invalid_argument("merge needs two trees of the same kind");
+    }
+    if(!(alloc_ == other.alloc_)) {
+        throw std::invalid_argument("merge needs two trees with equal allocators");
+    }
+
+    size_t mineCount, theirsCount;
+    Node<Key, Value>* mine = flattenToVine(root_, mineCount);
+    Node<Key, Value>* theirs = flattenToVine(other.root_, theirsCount);
+    other.root_ = nullptr;
+    other.size_ = 0;
+    other.maxSize_ = 0;
+    other.tombstones_ = 0;
+    other.finger_ = nullptr;
+    other.min_ = nullptr;
+    other.max_ = nullptr;
+
+    // zip the two vines into one, still linked through the right pointers
+    Node<Key, Value>* head = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    size_t count = 0;
+    while(mine != nullptr || theirs != nullptr) {
+        // tombstones don't count as being there, free them as they come up
+        if(mine != nullptr && mine->isTombstone()) {
+            Node<Key, Value>* dead = mine;
+            mine = mine->getRight();
+            freeNode(dead);
+            continue;
+        }
+        if(theirs != nullptr && theirs->isTombstone()) {
+            Node<Key, Value>* dead = theirs;
+            theirs = theirs->getRight();
+            freeNode(dead);
+            continue;
+        }
+        Node<Key, Value>* next;
+        if(theirs == nullptr || (mine != nullptr && mine->getKey() < theirs->getKey())) {
+            next = mine;
+            mine = mine->getRight();
+        }
+        else if(mine == nullptr || theirs->getKey() < mine->getKey()) {
+            next = theirs;
+            theirs = theirs->getRight();
+        }
+        else {
+            // same key in both, keep the winner's node and free the other
+            Node<Key, Value>* loser;
+            if(conflict == MERGE_KEEP_THIS) {
+                next = mine;
+                loser = theirs;
+            }
+            else {
+                next = theirs;
+                loser = mine;
+            }
+            mine = mine->getRight();
+            theirs = theirs->getRight();
+            freeNode(loser);
+        }
+
+        if(tail == nullptr) {
+            head = next;
+        }
+        else {
+            tail->setRight(next);
+        }
+        tail = next;
+        ++count;
+    }
+    // nothing left at all if both sides were only tombstones
+    if(tail != nullptr) {
+        tail->setRight(nullptr);
+    }
+
+    int height;
+    root_ = buildFromVine(head, count, nullptr, height);
+    rebuiltTop(root_);
+    size_ = count;
+    maxSize_ = count;
+    tombstones_ = 0;
+    finger_ = nullptr;
+    findExtremes();
+    if(other.hashIndex_ != NULL) {
+        other.hashIndex_->clear();
+    }
+    reindex();
+}
+
+/**
+* Calls fn(item) on every item (a std::pair<const Key, Value>&, same as *it)
+* using the threads from setParallelism. The tree gets cut at subtree
+* boundaries into a few pieces per thread, which threads grab as they free
+* up, so one slow piece doesn't hold the rest back. Calls on different items
+* run concurrently and in no particular order; fn can change values but not
+* the tree. If fn throws, the rest of the pieces are skipped and the first
+* exception gets rethrown here.
+*/
+template<typename Key, typename Value, typename Allocator>
+template<typename Fn>
+void BinarySearchTree<Key, Value, Allocator>::parallelForEach(Fn fn) const
+{
+    parallelReduce(0, [&](int, std::pair<const Key, Value>& item) {
+        fn(item);
+        return 0;
+    }, [](int, int) {
+        return 0;
+    });
+}
+
+/**
+* parallelReduce with one op for both folding in items and putting partial
+* results together, i.e. a functor with op(T, item) and op(T, T) overloads.
+*/
+template<typename Key, typename Value, typename Allocator>
+template<typename T, typename Op>
+T BinarySearchTree<Key, Value, Allocator>::parallelReduce(const T& init, Op op) const
+{
+    return parallelReduce(init, op, op);
+}
+
+/**
+* Folds the items in key order on the setParallelism threads. Each piece
+* starts at init and runs acc = fold(acc, item) over its items, then the
+* pieces get put together left to right with combine(left, right), so the
+* result is what a plain in-order fold would give as long as combine is
+* associative and init is an identity for it (combine doesn't have to be
+* commutative). Throws like parallelForEach.
+*/
+template<typename Key, typename Value, typename Allocator>
+template<typename T, typename Fold, typename Combine>
+T BinarySearchTree<Key, Value, Allocator>::parallelReduce(const T& init, Fold fold, Combine combine) const
+{
+    unsigned threads = resolveThreadCount(threads_);
+    size_t pieces = parallelPieces(size_, threads, grain_);
+
+    // (node, whole subtree?) in key order, single nodes are the ones the cuts went through
+    std::vector<std::pair<Node<Key, Value>*, bool> > tasks;
+    scanTasks(root_, pieces, tasks);
+
+    std::vector<PaddedSlot<T> > partial(tasks.size(), PaddedSlot<T>(init));
+    std::exception_ptr error;
+    std::atomic<bool> failed(false);
+    parallelFor(tasks.size(), threads, [&](size_t i) {
+        if(failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            T& acc = partial[i].value;
+            if(tasks[i].second) {
+                walkInOrder(tasks[i].first, [&](Node<Key, Value>* node) {
+                    if(!node->isTombstone()) {
+                        acc = fold(acc, node->getItem());
+                    }
+                    return !failed.load(std::memory_order_relaxed);
+                });
+            }
+            else if(!tasks[i].first->isTombstone()) {
+                acc = fold(acc, tasks[i].first->getItem());
+            }
+        }
+        catch(...) {
+            if(!failed.exchange(true)) {
+                error = std::current_exception();
+            }
+        }
+    });
+    if(error) {
+        std::rethrow_exception(error);
+    }
+
+    T result = init;
+    for(size_t i = 0; i < partial.size(); ++i) {
+        result = combine(result, partial[i].value);
+    }
+    return result;
+}
+
+/**
+* Lets copying, clear(), the destructor and parallelForEach/parallelReduce
+* split a big tree into subtrees and work on them from up to `threads`
+* threads (0 means one per core, 1, the default, keeps everything on the
+* calling thread). Trees under about
+* 2 * grain nodes aren't worth splitting and never are. The result is the
+* same either way, copies come out node for node identical.
+* Copies pick these settings up too.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::setParallelism(unsigned threads, size_t grain)
+{
+    threads_ = threads;
+    grain_ = (grain == 0) ? 1 : grain;
+}
+
+/**
+* Turns finger search on or off. With it on, the tree remembers the last
+* node find/operator[]/insert/remove touched and the next search starts
+* from there, climbing only as far as it has to. Great when consecutive
+* keys are close together, a wash when they're random.
+* The finger gets moved by const lookups too, so don't share a tree
+* between reader threads with this on. (SplayTree's own lookups already
+* get this effect from splaying and ignore the finger.)
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::setFingerSearch(bool enabled)
+{
+    fingerSearch_ = enabled;
+    finger_ = nullptr;
+}
+
+/**
+* Turns the hash side index on or off. With it on, a hash table from key to
+* node is kept next to the tree, and find/operator[]/remove/erase go
+* straight to the node through it in O(1) instead of descending. Ordered
+* things (iteration, lowerBound, eraseRange) still walk the tree and
+* behave exactly the same. Costs a hash insert/erase on every insert/remove
+* and about 16 bytes per item plus slack. Turning it on indexes whatever is
+* already in the tree; copies keep it on. Key needs a std::hash (or to be
+* a pair of such keys), otherwise turning it on throws std::invalid_argument.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::setHashIndex(bool enabled)
+{
+    if(!enabled) {
+        delete hashIndex_;
+        hashIndex_ = NULL;
+        return;
+    }
+    if(!IndexHash<Key>::supported) {
+        throw std::invalid_argument("setHashIndex needs a key type with a std::hash");
+    }
+    if(hashIndex_ == NULL) {
+        hashIndex_ = new HashIndex<Key, Node<Key, Value> >();
+    }
+    reindex();
+}
+
+/**
+* Turns lazy delete mode on or off. With it on, remove/erase only mark the
+* node as a tombstone (one lookup, no swaps or rotations) and everything
+* else acts like it's gone: find, operator[], iteration and the bulk
+* exports skip it, and inserting the key again just brings it back. Once
+* more than maxDeadRatio of the nodes are dead the whole tree gets
+* compacted (see compact), so that's O(1 / maxDeadRatio) amortized per
+* remove, paid in one go instead of on every call. Turning it off compacts.
+* Structural queries like height() and isBalanced() still see the dead nodes.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::setLazyDelete(bool enabled, double maxDeadRatio)
+{
+    if(maxDeadRatio <= 0.0 || maxDeadRatio >= 1.0) {
+        throw std::invalid_argument("maxDeadRatio must be between 0 and 1");
+    }
+    lazyDelete_ = enabled;
+    maxDeadRatio_ = maxDeadRatio;
+    if(!enabled) {
+        compact();
+    }
+}
+
+/**
+* Frees every tombstone and rebuilds what's left perfectly balanced, in
+* O(n) with no allocation: flatten to a vine, unlink and free the dead
+* nodes, rebuild from the vine. Does nothing if there aren't any.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::compact()
+{
+    if(tombstones_ == 0) {
+        return;
+    }
+    rebuildWithout([](const std::pair<const Key, Value>&) {
+        return false;
+    });
+}
+
+/**
+* Removes every item pred(item) is true for (item is a const
+* std::pair<const Key, Value>&) and returns how many went. Unlike finding
+* them and calling remove() on each, this is one pass over the tree plus a
+* rebuild, O(n) total no matter how many match, with no lookups, swaps or
+* rebalancing per item. pred gets called once per item in key order.
+* What's left comes out perfectly balanced; tombstones get cleared too.
+* If pred throws, the items it already said yes to are gone, the rest stay,
+* and the exception comes back out with the tree in one piece.
+*/
+template<typename Key, typename Value, typename Allocator>
+template<typename Pred>
+size_t BinarySearchTree<Key, Value, Allocator>::removeIf(Pred pred)
+{
+    LatencyProbe probe(latency_, OP_REMOVE);
+    if(root_ == nullptr) {
+        return 0;
+    }
+    size_t removed = rebuildWithout(pred);
+    BST_STAT(stats_.removes += removed);
+    return removed;
+}
+
+// flattens the tree to a vine, frees the tombstones and every node drop(item)
+// says to, then rebuilds the rest balanced. returns how many drop got rid of
+template<typename Key, typename Value, typename Allocator>
+template<typename Pred>
+size_t BinarySearchTree<Key, Value, Allocator>::rebuildWithout(Pred drop)
+{
+    size_t count;
+    Node<Key, Value>* vine = flattenToVine(root_, count);
+    Node<Key, Value>* head = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    size_t dropped = 0;
+    count = 0;
+    bool asking = true;
+    std::exception_ptr error;
+    while(vine != nullptr) {
+        Node<Key, Value>* next = vine->getRight();
+        bool gone = vine->isTombstone();
+        if(!gone && asking) {
+            try {
+                gone = drop(vine->getItem());
+            }
+            catch(...) {
+                // stop asking, but keep going so the tree gets put back together
+                error = std::current_exception();
+                asking = false;
+            }
+            if(gone) {
+                ++dropped;
+                if(hashIndex_ != NULL) {
+                    hashIndex_->erase(vine->getKey());
+                }
+            }
+        }
+
+        if(gone) {
+            freeNode(vine);
+        }
+        else {
+            if(tail == nullptr) {
+                head = vine;
+            }
+            else {
+                tail->setRight(vine);
+            }
+            tail = vine;
+            ++count;
+        }
+        vine = next;
+    }
+    if(tail != nullptr) {
+        tail->setRight(nullptr);
+    }
+
+    int height;
+    root_ = buildFromVine(head, count, nullptr, height);
+    rebuiltTop(root_);
+    size_ = count;
+    maxSize_ = count;
+    tombstones_ = 0;
+    finger_ = nullptr;
+    findExtremes();
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+    return dropped;
+}
+
+// called by insert once a brand new node is hooked in at the given depth (root = 0)
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::afterPlace(Node<Key, Value>* newNode, int depth)
+{
+    indexNode(newNode);
+    ++size_;
+    if(size_ > maxSize_) {
+        maxSize_ = size_;
+    }
+    if(!scapegoat_) {
+        return;
+    }
+
+    // deep enough to be a problem?
+    double limit = std::log((double)maxSize_) / std::log(1.0 / scapegoatAlpha_);
+    if(depth <= limit) {
+        return;
+    }
+
+    // walk up until some ancestor's subtree is too lopsided, that's the scapegoat.
+    // subtree sizes get counted as we go, so this costs about as much as the rebuild will
+    Node<Key, Value>* child = newNode;
+    size_t childSize = 1;
+    Node<Key, Value>* parent = child->getParent();
+    while(parent != nullptr) {
+        Node<Key, Value>* sibling = (parent->getLeft() == child) ? parent->getRight() : parent->getLeft();
+        size_t parentSize = 1 + childSize + countNodes(sibling);
+        if(childSize > scapegoatAlpha_ * parentSize) {
+            rebuildSubtree(parent);
+            return;
+        }
+        child = parent;
+        childSize = parentSize;
+        parent = parent->getParent();
+    }
+}
+
+// counts the nodes under top without recursing
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::countNodes(Node<Key, Value>* top)
+{
+    size_t count = 0;
+    std::vector<Node<Key, Value>*> stack;
+    if(top != nullptr) {
+        stack.push_back(top);
+    }
+    while(!stack.empty()) {
+        Node<Key, Value>* node = stack.back();
+        stack.pop_back();
+        ++count;
+        if(node->getLeft() != nullptr) {
+            stack.push_back(node->getLeft());
+        }
+        if(node->getRight() != nullptr) {
+            stack.push_back(node->getRight());
+        }
+    }
+    return count;
+}
+
+// frees every node under top (which should already be cut off from the tree) and
+// returns how many there were. flattens to a vine first so it needs no extra memory
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::destroySubtree(Node<Key, Value>* top) const
+{
+    size_t count = 0;
+    Node<Key, Value>* vine = flattenToVine(top, count);
+    while(vine != nullptr) {
+        Node<Key, Value>* next = vine->getRight();
+        freeNode(vine);
+        vine = next;
+    }
+    return count;
+}
+
+/**
+* Rebuilds the subtree under top into a perfectly balanced one in O(size),
+* reusing the same nodes. It gets flattened into a sorted "vine" (a linked
+* list through the right pointers) by rotations, then rebuilt from the vine,
+* so the only extra memory is O(log n) of call stack.
+*/
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::rebuildSubtree(Node<Key, Value>* top)
+{
+    if(top == nullptr) {
+        return;
+    }
+    BST_STAT(++stats_.subtreeRebuilds);
+
+    Node<Key, Value>* parent = top->getParent();
+    bool wasLeft = (parent != nullptr && parent->getLeft() == top);
+
+    size_t count = 0;
+    Node<Key, Value>* vine = flattenToVine(top, count);
+    int height = 0;
+    Node<Key, Value>* rebuilt = buildFromVine(vine, count, parent, height);
+
+    if(parent == nullptr) {
+        root_ = rebuilt;
+    }
+    else if(wasLeft) {
+        parent->setLeft(rebuilt);
+    }
+    else {
+        parent->setRight(rebuilt);
+    }
+    rebuiltTop(rebuilt);
+}
+
+// turns the subtree into a sorted list linked through the right pointers using right rotations,
+// O(n) and no extra memory. parent pointers are left stale, buildFromVine fixes them up
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::flattenToVine(Node<Key, Value>* top, size_t& count)
+{
+    Node<Key, Value>* head = top;
+    Node<Key, Value>* tail = nullptr; // last node that's already in its final spot on the vine
+    Node<Key, Value>* rest = top;
+    count = 0;
+
+    while(rest != nullptr) {
+        if(rest->getLeft() == nullptr) {
+            ++count;
+            tail = rest;
+            rest = rest->getRight();
+        }
+        else {
+            // rotate the left child up over rest
+            Node<Key, Value>* up = rest->getLeft();
+            rest->setLeft(up->getRight());
+            up->setRight(rest);
+            rest = up;
+            if(tail == nullptr) {
+                head = up;
+            }
+            else {
+                tail->setRight(up);
+            }
+        }
+    }
+    return head;
+}
+
+// builds a balanced tree out of the first count nodes of the vine, moving vine past them.
+// middle node becomes the root so the two sides differ by at most one node
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::buildFromVine(Node<Key, Value>*& vine, size_t count, Node<Key, Value>* parent, int& height)
+{
+    if(count == 0) {
+        height = 0;
+        return nullptr;
+    }
+
+    size_t leftCount = (count - 1) / 2;
+    int leftHeight = 0;
+    int rightHeight = 0;
+    Node<Key, Value>* left = buildFromVine(vine, leftCount, nullptr, leftHeight);
+
+    Node<Key, Value>* node = vine;
+    vine = vine->getRight();
+
+    Node<Key, Value>* right = buildFromVine(vine, count - 1 - leftCount, node, rightHeight);
+
+    node->setParent(parent);
+    node->setLeft(left);
+    node->setRight(right);
+    if(left != nullptr) {
+        left->setParent(node);
+    }
+    rebuiltNode(node, leftHeight, rightHeight);
+
+    height = 1 + ((leftHeight > rightHeight) ? leftHeight : rightHeight);
+    return node;
+}
+
+// hook for trees that keep extra per-node bookkeeping (balance etc.), called
+// bottom up on every node a rebuild touches. plain BSTs have nothing to fix
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    (void)node;
+    (void)leftHeight;
+    (void)rightHeight;
+}
+
+// makes a copy of source (minus the links) under parent, allocated with alloc (the new
+// tree's). copying always calls this on the tree being copied from, since the new tree's
+// own override isn't live yet inside the base class constructor. trees with their own
+// node type override it to copy their extra data
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const Allocator& alloc) const
+{
+    return makeNode<Node<Key, Value> >(alloc, source->getKey(), source->getValue(), parent);
+}
+
+// copies other's whole tree and returns the new root. with other's parallelism set up,
+// the top few levels get copied here and the subtrees under them go to the worker threads.
+// if an allocation throws, whatever got built is freed before passing it on
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::cloneTree(const BinarySearchTree<Key, Value, Allocator>& other) const
+{
+    if(other.root_ == nullptr) {
+        return nullptr;
+    }
+    unsigned threads = resolveThreadCount(other.threads_);
+    size_t pieces = parallelPieces(other.size_, threads, other.grain_);
+    if(pieces <= 1) {
+        return cloneSubtree(other, other.root_, nullptr);
+    }
+
+    // copy breadth first until enough whole subtrees are left over to hand out.
+    // frontier holds source nodes, attach holds the copies their copies hang off of
+    std::vector<Node<Key, Value>*> frontier;
+    std::vector<Node<Key, Value>*> attach;
+    Node<Key, Value>* copyRoot = nullptr;
+    size_t head = 0;
+    try {
+        copyRoot = other.cloneNode(other.root_, nullptr, alloc_);
+        copyRoot->setTombstone(other.root_->isTombstone());
+        frontier.push_back(other.root_);
+        attach.push_back(copyRoot);
+        head = 1;
+        for(size_t i = 0; i < 2; ++i) {
+            Node<Key, Value>* kid = (i == 0) ? other.root_->getLeft() : other.root_->getRight();
+            if(kid != nullptr) {
+                frontier.push_back(kid);
+                attach.push_back(copyRoot);
+            }
+        }
+
+        while(head < frontier.size() && frontier.size() - head < pieces) {
+            Node<Key, Value>* source = frontier[head];
+            Node<Key, Value>* copy = other.cloneNode(source, attach[head], alloc_);
+            copy->setTombstone(source->isTombstone());
+            if(source == source->getParent()->getLeft()) {
+                attach[head]->setLeft(copy);
+            }
+            else {
+                attach[head]->setRight(copy);
+            }
+            ++head;
+
+            if(source->getLeft() != nullptr) {
+                frontier.push_back(source->getLeft());
+                attach.push_back(copy);
+            }
+            if(source->getRight() != nullptr) {
+                frontier.push_back(source->getRight());
+                attach.push_back(copy);
+            }
+        }
+    }
+    catch(...) {
+        destroySubtree(copyRoot);
+        throw;
+    }
+
+    // every leftover subtree gets copied on its own, then hooked in here so nobody races on the links
+    std::vector<Node<Key, Value>*> copies(frontier.size() - head, nullptr);
+    std::atomic<bool> failed(false);
+    parallelFor(copies.size(), threads, [&](size_t i) {
+        if(failed.load(std::memory_order_relaxed)) {
+            return;
+        }
+        try {
+            copies[i] = cloneSubtree(other, frontier[head + i], attach[head + i]);
+        }
+        catch(...) {
+            failed.store(true);
+        }
+    });
+
+    for(size_t i = 0; i < copies.size(); ++i) {
+        if(copies[i] == nullptr) {
+            continue;
+        }
+        Node<Key, Value>* source = frontier[head + i];
+        if(source == source->getParent()->getLeft()) {
+            attach[head + i]->setLeft(copies[i]);
+        }
+        else {
+            attach[head + i]->setRight(copies[i]);
+        }
+    }
+    if(failed.load()) {
+        destroySubtree(copyRoot);
+        throw std::bad_alloc();
+    }
+    return copyRoot;
+}
+
+// copies the subtree at top (from other) under parent, pre-order with an explicit stack,
+// and returns the copy without hooking it into parent. frees its own work if it throws
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::cloneSubtree(const BinarySearchTree<Key, Value, Allocator>& other, Node<Key, Value>* top, Node<Key, Value>* parent) const
+{
+    // (node to copy, copy of its parent) pairs
+    std::vector<std::pair<Node<Key, Value>*, Node<Key, Value>*> > stack;
+    stack.push_back(std::make_pair(top, parent));
+    Node<Key, Value>* copyRoot = nullptr;
+
+    try {
+        while(!stack.empty()) {
+            Node<Key, Value>* source = stack.back().first;
+            Node<Key, Value>* copyParent = stack.back().second;
+            stack.pop_back();
+
+            Node<Key, Value>* copy = other.cloneNode(source, copyParent, alloc_);
+            copy->setTombstone(source->isTombstone());
+            if(source == top) {
+                copyRoot = copy;
+            }
+            else if(source == source->getParent()->getLeft()) {
+                copyParent->setLeft(copy);
+            }
+            else {
+                copyParent->setRight(copy);
+            }
+
+            if(source->getRight() != nullptr) {
+                stack.push_back(std::make_pair(source->getRight(), copy));
+            }
+            if(source->getLeft() != nullptr) {
+                stack.push_back(std::make_pair(source->getLeft(), copy));
+            }
+        }
+    }
+    catch(...) {
+        if(copyRoot != nullptr) {
+            copyRoot->setParent(nullptr);
+        }
+        destroySubtree(copyRoot);
+        throw;
+    }
+    return copyRoot;
+}
+
+// frees every node in the tree and leaves root_ null (size_ is only used as a guide).
+// with parallelism set up, the top few levels get freed here and the subtrees under
+// them are handed out to worker threads
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::destroyAll()
+{
+    Node<Key, Value>* top = root_;
+    root_ = nullptr;
+    min_ = nullptr;
+    max_ = nullptr;
+    if(top == nullptr) {
+        return;
+    }
+    unsigned threads = resolveThreadCount(threads_);
+    size_t pieces = parallelPieces(size_, threads, grain_);
+    if(pieces <= 1) {
+        destroySubtree(top);
+        return;
+    }
+
+    std::vector<Node<Key, Value>*> frontier;
+    frontier.push_back(top);
+    size_t head = 0;
+    while(head < frontier.size() && frontier.size() - head < pieces) {
+        Node<Key, Value>* node = frontier[head++];
+        if(node->getLeft() != nullptr) {
+            frontier.push_back(node->getLeft());
+        }
+        if(node->getRight() != nullptr) {
+            frontier.push_back(node->getRight());
+        }
+        freeNode(node);
+    }
+
+    parallelFor(frontier.size() - head, threads, [&](size_t i) {
+        destroySubtree(frontier[head + i]);
+    });
+}
+
+// how many subtrees to split nodes worth of work into: about 4 per thread so
+// uneven subtrees even out, but none (on a balanced tree) smaller than grain.
+// 1 means just do it on this thread
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::parallelPieces(size_t nodes, unsigned threads, size_t grain)
+{
+    if(threads <= 1 || nodes / 2 < grain) {
+        return 1;
+    }
+    size_t pieces = nodes / grain;
+    size_t most = (size_t)threads * 4;
+    return (pieces < most) ? pieces : most;
+}
+
+// moves everything other owns over to this tree (which must not own anything)
+// and leaves other empty but usable
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::takeFrom(BinarySearchTree<Key, Value, Allocator>& other)
+{
+    root_ = other.root_;
+    size_ = other.size_;
+    maxSize_ = other.maxSize_;
+    scapegoat_ = other.scapegoat_;
+    scapegoatAlpha_ = other.scapegoatAlpha_;
+    latency_ = other.latency_;
+    fingerSearch_ = other.fingerSearch_;
+    hashIndex_ = other.hashIndex_;
+    lazyDelete_ = other.lazyDelete_;
+    maxDeadRatio_ = other.maxDeadRatio_;
+    tombstones_ = other.tombstones_;
+    finger_ = other.finger_;
+    min_ = other.min_;
+    max_ = other.max_;
+    threads_ = other.threads_;
+    grain_ = other.grain_;
+#ifdef BST_STATS
+    stats_ = other.stats_;
+    other.stats_ = TreeStats();
+#endif
+
+    other.root_ = NULL;
+    other.size_ = 0;
+    other.maxSize_ = 0;
+    other.latency_ = NULL;
+    other.hashIndex_ = NULL;
+    other.tombstones_ = 0;
+    other.finger_ = NULL;
+    other.min_ = NULL;
+    other.max_ = NULL;
+}
+
+/**
+* Makes a new node for insert. Trees with their own node type override this
+* so the shared insert/rebuild code never has to know what it's allocating.
+*/
+template<typename Key, typename Value, typename Allocator>
+Node<Key, Value>* BinarySearchTree<Key, Value, Allocator>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return makeNode<Node<Key, Value> >(alloc_, key, value, parent);
+}
+
+// builds an N (some node type) from args in memory from alloc, rounded up to whole
+// NodeBlocks. every node a tree owns comes from here and goes back through freeNode
+template<typename Key, typename Value, typename Allocator>
+template<typename N, typename... Args>
+N* BinarySearchTree<Key, Value, Allocator>::makeNode(const Allocator& alloc, Args&&... args)
+{
+    static_assert(alignof(N) <= alignof(NodeBlock), "node type needs more alignment than NodeBlock has");
+    BlockAllocator blocks(alloc);
+    size_t count = blocksFor(sizeof(N));
+    NodeBlock* memory = std::allocator_traits<BlockAllocator>::allocate(blocks, count);
+    try {
+        return ::new((void*)memory) N(std::forward<Args>(args)...);
+    }
+    catch(...) {
+        std::allocator_traits<BlockAllocator>::deallocate(blocks, memory, count);
+        throw;
+    }
+}
+
+// destroys node and gives its blocks back. not virtual on purpose: the node knows
+// its own size, so this still works from the base class destructor
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::freeNode(Node<Key, Value>* node) const
+{
+    BlockAllocator blocks(alloc_);
+    size_t count = blocksFor(node->footprint());
+    NodeBlock* memory = static_cast<NodeBlock*>(dynamic_cast<void*>(node));
+    node->~Node();
+    std::allocator_traits<BlockAllocator>::deallocate(blocks, memory, count);
+}
+
+template<typename Key, typename Value, typename Allocator>
+size_t BinarySearchTree<Key, Value, Allocator>::blocksFor(size_t bytes)
+{
+    return (bytes + sizeof(NodeBlock) - 1) / sizeof(NodeBlock);
+}
+
+// hook called at the end of every rotation, down is the node that just went
+// under its old child (down's parent is the one that came up). no-op here
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::afterRotate(Node<Key, Value>* down)
+{
+    (void)down;
+}
+
+// hook for per-node data that depends on the whole subtree (aggregates etc.):
+// node's subtree just gained or lost something, so it and every ancestor are
+// stale. the tree code calls this before rebalancing, so when rotations run
+// everything below them is up to date again. no-op here
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::subtreeChanged(Node<Key, Value>* node)
+{
+    (void)node;
+}
+
+// called once on the top node after a whole rebuild, for anything rebuiltNode
+// can't settle on its own (left subtrees don't have their parent yet when
+// rebuiltNode sees them, so a node can't tell it's the very top). no-op here
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::rebuiltTop(Node<Key, Value>* top)
+{
+    (void)top;
+}
+
+/**
+* Rotates node's right child up into node's place (node becomes its left child).
+* Keeps in-order the same, so any search tree can use it.
+*/
+template<class Key, class Value, class Allocator>
+void BinarySearchTree<Key, Value, Allocator>::rotateLeft(Node<Key, Value>* node){
+    if (node == nullptr || node->getRight() == nullptr){
+        return;
+    }
+    BST_STAT(++this->stats_.rotations);
+
+    Node<Key, Value>* node2 = node->getRight();
+    Node<Key, Value>* parent = node->getParent();
+
+    // jesus figuring this part out gave me a headache
+    // node2's left child now node's right child
+    node->setRight(node2->getLeft());
+    if(node2->getLeft() != nullptr){
+        node2->getLeft()->setParent(node);
+    }
+
+    // node now node2's left child
+    node2->setLeft(node);
+    node->setParent(node2);
+
+    // clean up parents to maintain tree order/connectivity
+    node2->setParent(parent);
+    if(parent == nullptr){
+        this->root_ = node2;
+    }
+    else if(parent->getLeft() == node){
+        parent->setLeft(node2);
+    }
+    else{
+        parent->setRight(node2);
+    }
+    afterRotate(node);
+}
+
+// just a repeat of rotateLeft but reversed left/right
+template<class Key, class Value, class Allocator>
+void BinarySearchTree<Key, Value, Allocator>::rotateRight(Node<Key, Value>* node){
+    if (node == nullptr || node->getLeft() == nullptr){
+        return;
+    }
+    BST_STAT(++this->stats_.rotations);
+
+    Node<Key, Value>* node2 = node->getLeft(); 
+    Node<Key, Value>* parent = node->getParent();
+
+    // mirrored copy of rotateLeft
+    // node2's right child now node's left child
+    node->setLeft(node2->getRight());
+    if(node2->getRight() != nullptr){
+        node2->getRight()->setParent(node);
+    }
+
+    // node now node2's right child
+    node2->setRight(node);
+    node->setParent(node2);
+
+    // clean up parents to maintain tree order/connectivity
+    node2->setParent(parent);
+    if(parent == nullptr){
+        this->root_ = node2;
+    }
+    else if(parent->getLeft() == node){
+        parent->setLeft(node2);
+    }
+    else{
+        parent->setRight(node2);
+    }
+    afterRotate(node);
+}
+
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value>* n2)
 {
     if((n1 == n2) || (n1 == NULL) || (n2 == NULL) ) {
         return;
     }
+    BST_STAT(++this->stats_.predecessorSwaps);
     Node<Key, Value>* n1p = n1->getParent();
     Node<Key, Value>* n1r = n1->getRight();
     Node<Key, Value>* n1lt = n1->getLeft();
@@ -867,6 +3083,7 @@ void BinarySearchTree<Key, Value>::nodeSwap( Node<Key,Value>* n1, Node<Key,Value
 
 // include print function (in its own file because it's fairly long)
 #include "print_bst.h"
+#include "dump_bst.h"
 
 /*
 ---------------------------------------------------
@@ -0,0 +1,163 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <cstdlib>
+#include "bufferedavlbst.h"
+#include "test-check.h"
+
+using namespace std;
+
+// gets at the store underneath, so the two ways a batch can go in
+// (zipped in whole or inserted one by one) can be run side by side
+struct BufferPeek : public BufferedAVLTree<int, int>
+{
+    explicit BufferPeek(size_t bufferSize) : BufferedAVLTree<int, int>(bufferSize) { }
+
+    struct Zipper : public Store
+    {
+        using Store::zipIn;
+        size_t nodes() const { return this->size_; }
+    };
+
+    typedef BufferedAVLTree<int, int>::Buffer Batch;
+};
+
+void testFlushOnCapacity()
+{
+    cout << "flush on capacity" << endl;
+    BufferedAVLTree<int, int> tree(64);
+    for(int i = 0; i < 63; ++i) {
+        tree.insert(make_pair(i * 2, i));
+    }
+    CHECK(tree.buffered() == 63 && tree.tree().empty() == false);
+    // tree() flushed, start again
+    for(int i = 0; i < 63; ++i) {
+        tree.insert(make_pair(i * 2 + 1, i));
+    }
+    CHECK(tree.buffered() == 63);
+    // overwriting a buffered key doesn't take up room
+    tree.insert(make_pair(1, 100));
+    CHECK(tree.buffered() == 63 && tree[1] == 100);
+    // the 64th write fills the buffer and flushes it
+    tree.insert(make_pair(1000, 0));
+    CHECK(tree.buffered() == 0);
+    CHECK(tree.tree().find(1000) != tree.tree().end() && tree[1] == 100);
+
+    // lookups see buffered writes without flushing
+    tree.insert(make_pair(2000, 5));
+    CHECK(tree[2000] == 5 && tree.buffered() == 1);
+    // overwriting a key that's already in the tree only touches the buffer
+    tree.insert(make_pair(4, -4));
+    CHECK(tree[4] == -4 && tree.buffered() == 2);
+    // find() on a buffered key flushes so it can hand back a tree iterator
+    CHECK(tree.find(2000) != tree.end() && tree.buffered() == 0);
+    CHECK(tree[4] == -4);
+
+    // a buffer of 0 gets bumped to 1, so every insert flushes
+    BufferedAVLTree<int, int> tiny(0);
+    tiny.insert(make_pair(1, 1));
+    CHECK(tiny.buffered() == 0 && tiny.find(1) != tiny.end());
+}
+
+void testRemove()
+{
+    cout << "remove" << endl;
+    BufferedAVLTree<int, int> tree(1000);
+    map<int, int> model;
+    for(int i = 0; i < 50; ++i) {
+        tree.insert(make_pair(i, i));
+        model[i] = i;
+    }
+    tree.flush();
+    for(int i = 50; i < 100; ++i) {
+        tree.insert(make_pair(i, i));
+        model[i] = i;
+    }
+    CHECK(tree.buffered() == 50);
+
+    // keys only in the buffer: some still in the unsorted tail, some in the sorted run
+    tree.remove(99);
+    tree.remove(60);
+    model.erase(99);
+    model.erase(60);
+    CHECK(tree.buffered() == 48);
+    // a key in the tree with a newer value buffered goes from both
+    tree.insert(make_pair(10, -10));
+    tree.remove(10);
+    model.erase(10);
+    // a key only in the tree, and one nowhere
+    tree.remove(20);
+    tree.remove(5000);
+    model.erase(20);
+    CHECK(tree.find(60) == tree.end() && tree.find(10) == tree.end());
+    CHECK(sameAs(tree, model) && tree.buffered() == 0);  // begin() flushed
+
+    tree.clear();
+    CHECK(tree.empty() && tree.buffered() == 0 && tree.begin() == tree.end());
+}
+
+// the same batch, zipped into one store and inserted one at a time into another
+void testZipVsInsert()
+{
+    cout << "zipIn vs per-insert" << endl;
+    srand(47);
+    for(int round = 0; round < 50; ++round) {
+        BufferPeek::Zipper zipped;
+        AVLTree<int, int> inserted;
+        map<int, int> model;
+        int start = rand() % 300;
+        for(int i = 0; i < start; ++i) {
+            int key = rand() % 1000;
+            zipped.insert(make_pair(key, i));
+            inserted.insert(make_pair(key, i));
+            model[key] = i;
+        }
+
+        // sorted and unique, like a flushed buffer, with some keys already there
+        map<int, int> batchKeys;
+        int batchSize = rand() % 200;
+        for(int i = 0; i < batchSize; ++i) {
+            batchKeys[rand() % 1000] = -i;
+        }
+        BufferPeek::Batch batch(batchKeys.begin(), batchKeys.end());
+        zipped.zipIn(batch);
+        for(size_t i = 0; i < batch.size(); ++i) {
+            inserted.insert(make_pair(batch[i].first, batch[i].second));
+            model[batch[i].first] = batch[i].second;
+        }
+
+        CHECK(zipped.validate() && zipped.nodes() == model.size());
+        AVLTree<int, int>::iterator a = zipped.begin();
+        AVLTree<int, int>::iterator b = inserted.begin();
+        bool same = true;
+        for(map<int, int>::iterator m = model.begin(); m != model.end(); ++m, ++a, ++b) {
+            same = same && a != zipped.end() && b != inserted.end() &&
+                   a->first == m->first && a->second == m->second &&
+                   b->first == m->first && b->second == m->second;
+        }
+        CHECK(same && a == zipped.end() && b == inserted.end());
+        if(!model.empty()) {
+            CHECK(zipped.front().first == model.begin()->first && zipped.back().first == model.rbegin()->first);
+        }
+    }
+
+    // and end to end, through both of absorb's choices
+    BufferedAVLTree<int, int> big(16);     // small batches into a big tree go in one by one
+    BufferedAVLTree<int, int> bulk(4096);  // big batches get zipped
+    map<int, int> model;
+    for(int i = 0; i < 5000; ++i) {
+        int key = rand() % 20000;
+        big.insert(make_pair(key, i));
+        bulk.insert(make_pair(key, i));
+        model[key] = i;
+    }
+    CHECK(sameAs(big, model) && sameAs(bulk, model));
+}
+
+int main()
+{
+    testFlushOnCapacity();
+    testRemove();
+    testZipVsInsert();
+    return checkResult();
+}
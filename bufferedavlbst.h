@@ -0,0 +1,364 @@
+#ifndef BUFFEREDAVLBST_H
+#define BUFFEREDAVLBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVL map with a write buffer in front of it. insert() and overwrites
+* land in the buffer (no tree descent, no rebalancing) and lookups check
+* the buffer first. When the buffer fills up it gets flushed into the tree
+* as one sorted batch: if the batch is big next to the tree, the tree is
+* flattened, zipped with the batch and rebuilt in O(n + batch); otherwise
+* the batch goes in one insert at a time in key order, so consecutive
+* descents follow mostly the same, already cached, path.
+* The buffer is a sorted run plus a short unsorted tail (about the square
+* root of the buffer size) that new keys get appended to and that gets
+* sorted into the run when it fills, so an insert never shifts the whole
+* buffer and a lookup is a short scan plus a binary search.
+* Anything that needs real tree nodes (iterators, find, lowerBound, tree())
+* flushes first. Those count as const since the contents don't change, but
+* like finger search it means a tree can't be shared between threads even
+* for reading.
+*/
+template <class Key, class Value>
+class BufferedAVLTree
+{
+public:
+    typedef typename BinarySearchTree<Key, Value>::iterator iterator;
+
+    explicit BufferedAVLTree(size_t bufferSize = 65536);
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    bool validate() const;
+    void flush() const;
+    size_t buffered() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    iterator lowerBound(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+    const AVLTree<Key, Value>& tree() const;
+
+protected:
+    typedef std::vector<std::pair<Key, Value> > Buffer;
+
+    // the tree itself, with a way to take a sorted batch in
+    class Store : public AVLTree<Key, Value>
+    {
+    public:
+        void absorb(const Buffer& batch);
+
+    protected:
+        void zipIn(const Buffer& batch);
+    };
+
+    std::pair<Key, Value>* buffered(const Key& key) const;
+    void sortTail() const;
+
+    mutable Store tree_;
+    mutable Buffer run_;    // sorted by key
+    mutable Buffer tail_;   // newest keys, unsorted, none of them in run_
+    size_t capacity_;
+    size_t tailCapacity_;
+};
+
+/**
+* bufferSize is how many pending writes to hold before flushing (at least 1).
+*/
+template<class Key, class Value>
+BufferedAVLTree<Key, Value>::BufferedAVLTree(size_t bufferSize) :
+    capacity_((bufferSize == 0) ? 1 : bufferSize)
+{
+    tailCapacity_ = (size_t)std::sqrt((double)capacity_);
+    if(tailCapacity_ < 8) {
+        tailCapacity_ = 8;
+    }
+    run_.reserve(capacity_);
+    tail_.reserve(tailCapacity_);
+}
+
+/**
+* Adds the item, or overwrites the value if the key is already there
+* (buffered or not). Flushes once the buffer is full.
+*/
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    std::pair<Key, Value>* item = buffered(keyValuePair.first);
+    if(item != nullptr) {
+        item->second = keyValuePair.second;
+        return;
+    }
+    tail_.push_back(std::pair<Key, Value>(keyValuePair.first, keyValuePair.second));
+    if(run_.size() + tail_.size() >= capacity_) {
+        flush();
+    }
+    else if(tail_.size() >= tailCapacity_) {
+        sortTail();
+    }
+}
+
+/**
+* Removes the key from the buffer and the tree, wherever it is.
+*/
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::remove(const Key& key)
+{
+    std::pair<Key, Value>* item = buffered(key);
+    if(item != nullptr) {
+        if(item >= tail_.data() && item < tail_.data() + tail_.size()) {
+            // order doesn't matter in the tail
+            std::swap(*item, tail_.back());
+            tail_.pop_back();
+        }
+        else {
+            run_.erase(run_.begin() + (item - run_.data()));
+        }
+    }
+    tree_.remove(key);
+}
+
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::clear()
+{
+    run_.clear();
+    tail_.clear();
+    tree_.clear();
+}
+
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::empty() const
+{
+    return run_.empty() && tail_.empty() && tree_.empty();
+}
+
+/**
+* Checks the tree (see BinarySearchTree::validate) after a flush.
+*/
+template<class Key, class Value>
+bool BufferedAVLTree<Key, Value>::validate() const
+{
+    flush();
+    return tree_.validate();
+}
+
+/**
+* Moves everything in the buffer into the tree now.
+*/
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::flush() const
+{
+    sortTail();
+    if(run_.empty()) {
+        return;
+    }
+    tree_.absorb(run_);
+    run_.clear();
+}
+
+/**
+* How many writes are waiting in the buffer.
+*/
+template<class Key, class Value>
+size_t BufferedAVLTree<Key, Value>::buffered() const
+{
+    return run_.size() + tail_.size();
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::begin() const
+{
+    flush();
+    return tree_.begin();
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::end() const
+{
+    return tree_.end();
+}
+
+/**
+* Finds key. Only flushes if key is sitting in the buffer, since the
+* iterator has to point at a tree node.
+*/
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::find(const Key& key) const
+{
+    if(buffered(key) != nullptr) {
+        flush();
+    }
+    return tree_.find(key);
+}
+
+template<class Key, class Value>
+typename BufferedAVLTree<Key, Value>::iterator BufferedAVLTree<Key, Value>::lowerBound(const Key& key) const
+{
+    flush();
+    return tree_.lowerBound(key);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key, buffered or not. A reference
+ * into the buffer only lasts until the next insert/remove/flush.
+ */
+template<class Key, class Value>
+Value& BufferedAVLTree<Key, Value>::operator[](const Key& key)
+{
+    std::pair<Key, Value>* item = buffered(key);
+    if(item != nullptr) {
+        return item->second;
+    }
+    return tree_[key];
+}
+
+template<class Key, class Value>
+Value const & BufferedAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    std::pair<Key, Value>* item = buffered(key);
+    if(item != nullptr) {
+        return item->second;
+    }
+    return static_cast<const AVLTree<Key, Value>&>(tree_)[key];
+}
+
+/**
+* The tree underneath, flushed, for everything this class doesn't wrap
+* (bulk exports, stats, printing...).
+*/
+template<class Key, class Value>
+const AVLTree<Key, Value>& BufferedAVLTree<Key, Value>::tree() const
+{
+    flush();
+    return tree_;
+}
+
+// key's entry in the buffer (tail first, it's short), or NULL
+template<class Key, class Value>
+std::pair<Key, Value>* BufferedAVLTree<Key, Value>::buffered(const Key& key) const
+{
+    for(size_t i = 0; i < tail_.size(); ++i) {
+        if(tail_[i].first == key) {
+            return &tail_[i];
+        }
+    }
+    typename Buffer::iterator slot = std::lower_bound(run_.begin(), run_.end(), key,
+        [](const std::pair<Key, Value>& item, const Key& k) { return item.first < k; });
+    if(slot != run_.end() && slot->first == key) {
+        return &(*slot);
+    }
+    return nullptr;
+}
+
+// sorts the tail and merges it into the run (no duplicates to worry about, insert already checked)
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::sortTail() const
+{
+    if(tail_.empty()) {
+        return;
+    }
+    auto byKey = [](const std::pair<Key, Value>& a, const std::pair<Key, Value>& b) { return a.first < b.first; };
+    std::sort(tail_.begin(), tail_.end(), byKey);
+    size_t middle = run_.size();
+    run_.insert(run_.end(), tail_.begin(), tail_.end());
+    std::inplace_merge(run_.begin(), run_.begin() + middle, run_.end(), byKey);
+    tail_.clear();
+}
+
+// a batch about as big as n / log n or bigger costs less to zip in whole
+// (O(n + batch)) than to insert one at a time (O(batch log n))
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::Store::absorb(const Buffer& batch)
+{
+    double perInsert = std::log2((double)this->size_ + 1.0) + 1.0;
+    if(batch.size() * perInsert >= this->size_) {
+        zipIn(batch);
+        return;
+    }
+    for(size_t i = 0; i < batch.size(); ++i) {
+        AVLTree<Key, Value>::insert(std::pair<const Key, Value>(batch[i].first, batch[i].second));
+    }
+}
+
+// flattens the tree to a vine, merges the batch into it (overwriting values
+// on equal keys, new nodes for the rest) and rebuilds it balanced. if a new
+// node can't be allocated the tree still gets rebuilt from what's there
+template<class Key, class Value>
+void BufferedAVLTree<Key, Value>::Store::zipIn(const Buffer& batch)
+{
+    size_t count;
+    Node<Key, Value>* vine = this->flattenToVine(this->root_, count);
+    Node<Key, Value>* head = nullptr;
+    Node<Key, Value>* tail = nullptr;
+    size_t i = 0;
+    count = 0;
+    std::exception_ptr error;
+    while(vine != nullptr || i < batch.size()) {
+        Node<Key, Value>* next;
+        if(i == batch.size() || error || (vine != nullptr && vine->getKey() < batch[i].first)) {
+            if(vine == nullptr) {
+                break;
+            }
+            next = vine;
+            vine = vine->getRight();
+        }
+        else if(vine == nullptr || batch[i].first < vine->getKey()) {
+            try {
+                next = this->createNode(batch[i].first, batch[i].second, nullptr);
+            }
+            catch(...) {
+                error = std::current_exception();
+                continue;
+            }
+            ++i;
+        }
+        else {
+            vine->setValue(batch[i].second);
+            next = vine;
+            vine = vine->getRight();
+            ++i;
+        }
+
+        if(tail == nullptr) {
+            head = next;
+        }
+        else {
+            tail->setRight(next);
+        }
+        tail = next;
+        ++count;
+    }
+    if(tail != nullptr) {
+        tail->setRight(nullptr);
+    }
+
+    int height;
+    this->root_ = this->buildFromVine(head, count, nullptr, height);
+    this->rebuiltTop(this->root_);
+    this->size_ = count;
+    if(count > this->maxSize_) {
+        this->maxSize_ = count;
+    }
+    this->finger_ = nullptr;
+    this->findExtremes();
+
+    if(error) {
+        std::rethrow_exception(error);
+    }
+}
+
+#endif
@@ -0,0 +1,222 @@
+#include <ostream>
+#include <streambuf>
+#include <vector>
+
+#ifndef DUMP_BST_H
+#define DUMP_BST_H
+
+// Streaming tree dump, for looking at the shape of big trees offline.
+// Unlike prettyPrintBST there's no depth cap and nothing gets collected up
+// front: nodes are written as the walk finishes them (post-order, so each
+// one's height is known), with an explicit stack that only ever holds one
+// root-to-node path. O(n) time, O(height) memory.
+//
+// DOT (feed it to graphviz):
+//     digraph bst {
+//     n0 [label="5\nd=0 h=3 b=1"];
+//     n1 [label="3\nd=1 h=2 b=1"];
+//     n0 -> n1 [label="L"];
+//     ...
+//     }
+//
+// JSON, one node per line so it can be read back a line at a time too:
+//     {"nodes": [
+//     {"id": 1, "parent": 0, "side": "L", "key": "3", "value": "c", "depth": 1, "height": 2, "balance": 1, "size": 2},
+//     ...
+//     ], "size": 6, "height": 3}
+//
+// Node ids are pre-order numbers (root = 0). Balance is left height minus
+// right height, measured, not read off the node, so broken trees show up
+// as they really are. Tombstones (lazy delete mode) get marked dead.
+// With maxDepth >= 0, nodes deeper than that aren't written one by one:
+// each cut off subtree becomes a single summary entry ("hidden": its size,
+// plus its height) hanging off its parent, which is the cheap way to
+// sample a tree too big to draw.
+
+// stream buffer that hands everything on to another stream with quotes,
+// backslashes and control characters escaped, which is good enough for both
+// DOT and JSON strings. keys/values get printed through it with
+// ppbstPrintItem (print_bst.h), so nothing is built up in between
+class DumpEscaper : public std::streambuf
+{
+public:
+    explicit DumpEscaper(std::ostream & os) : os_(os) { }
+
+protected:
+    virtual int overflow(int ch)
+    {
+        static const char hex[] = "0123456789abcdef";
+        if(traits_type::eq_int_type(ch, traits_type::eof()))
+        {
+            return traits_type::not_eof(ch);
+        }
+        unsigned char c = (unsigned char)ch;
+        if(c == '"' || c == '\\')
+        {
+            os_ << '\\' << (char)c;
+        }
+        else if(c == '\n')
+        {
+            os_ << "\\n";
+        }
+        else if(c < 0x20)
+        {
+            os_ << "\\u00" << hex[c >> 4] << hex[c & 0xf];
+        }
+        else
+        {
+            os_ << (char)c;
+        }
+        return ch;
+    }
+
+    std::ostream & os_;
+};
+
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::dump(std::ostream & os, DumpFormat format, int maxDepth) const
+{
+    bool json = (format == DUMP_JSON);
+    os << (json ? "{\"nodes\": [\n" : "digraph bst {\n");
+
+    // state 0 = haven't gone left yet, 1 = left is done, 2 = right is done too
+    struct Frame {
+        Node<Key, Value>* node;
+        size_t id;
+        int depth;
+        int leftHeight;
+        size_t size;    // nodes finished under this one so far
+        int state;
+    };
+    std::vector<Frame> stack;
+    if(root_ != nullptr)
+    {
+        Frame first = { root_, 0, 0, 0, 1, 0 };
+        stack.push_back(first);
+    }
+
+    DumpEscaper escaper(os);
+    std::ostream escaped(&escaper);
+    escaped.copyfmt(os);
+    size_t nextId = 1;
+    bool firstEntry = true;
+    int childHeight = 0;    // height handed back by whichever subtree just finished
+    int treeHeight = 0;
+    size_t treeSize = 0;
+
+    while(!stack.empty())
+    {
+        Frame & top = stack.back();
+        if(top.state < 2)
+        {
+            if(top.state == 1)
+            {
+                top.leftHeight = childHeight;
+            }
+            Node<Key, Value>* kid = (top.state == 0) ? top.node->getLeft() : top.node->getRight();
+            ++top.state;
+            if(kid != nullptr)
+            {
+                Frame next = { kid, 0, top.depth + 1, 0, 1, 0 };
+                // cut off nodes only get counted, only the summaries need an id
+                if(maxDepth < 0 || next.depth <= maxDepth + 1)
+                {
+                    next.id = nextId++;
+                }
+                stack.push_back(next);
+                continue;
+            }
+            childHeight = 0;
+            continue;
+        }
+
+        // both kids are done, so this node's subtree is complete
+        Frame done = top;
+        stack.pop_back();
+        int rightHeight = childHeight;
+        int height = 1 + ((done.leftHeight > rightHeight) ? done.leftHeight : rightHeight);
+        const Frame* parent = stack.empty() ? nullptr : &stack.back();
+        const char* side = (parent != nullptr && parent->node->getLeft() == done.node) ? "L" : "R";
+        bool shown = (maxDepth < 0 || done.depth <= maxDepth);
+        bool summary = !shown && done.depth == maxDepth + 1;
+
+        if(shown || summary)
+        {
+            if(json)
+            {
+                os << (firstEntry ? "" : ",\n") << "{\"id\": " << done.id << ", \"parent\": ";
+                if(parent == nullptr)
+                {
+                    os << "null, \"side\": null";
+                }
+                else
+                {
+                    os << parent->id << ", \"side\": \"" << side << "\"";
+                }
+                if(summary)
+                {
+                    os << ", \"hidden\": " << done.size << ", \"height\": " << height << "}";
+                }
+                else
+                {
+                    os << ", \"key\": \"";
+                    ppbstPrintItem(escaped, done.node->getKey());
+                    os << "\", \"value\": \"";
+                    ppbstPrintItem(escaped, done.node->getValue());
+                    os << "\", \"depth\": " << done.depth << ", \"height\": " << height
+                       << ", \"balance\": " << (done.leftHeight - rightHeight)
+                       << ", \"size\": " << done.size;
+                    if(done.node->isTombstone())
+                    {
+                        os << ", \"dead\": true";
+                    }
+                    os << "}";
+                }
+                firstEntry = false;
+            }
+            else if(summary)
+            {
+                os << "n" << done.id << " [shape=ellipse, label=\"" << done.size
+                   << " nodes\\nh=" << height << "\"];\n";
+                os << "n" << parent->id << " -> n" << done.id << " [label=\"" << side << "\"];\n";
+            }
+            else
+            {
+                os << "n" << done.id << " [label=\"";
+                ppbstPrintItem(escaped, done.node->getKey());
+                os << "\\nd=" << done.depth << " h=" << height << " b=" << (done.leftHeight - rightHeight) << "\"";
+                if(done.node->isTombstone())
+                {
+                    os << ", style=dashed";
+                }
+                os << "];\n";
+                if(parent != nullptr)
+                {
+                    os << "n" << parent->id << " -> n" << done.id << " [label=\"" << side << "\"];\n";
+                }
+            }
+        }
+
+        childHeight = height;
+        if(parent != nullptr)
+        {
+            stack.back().size += done.size;
+        }
+        else
+        {
+            treeHeight = height;
+            treeSize = done.size;
+        }
+    }
+
+    if(json)
+    {
+        os << (firstEntry ? "" : "\n") << "], \"size\": " << treeSize << ", \"height\": " << treeHeight << "}\n";
+    }
+    else
+    {
+        os << "}\n";
+    }
+}
+
+#endif
@@ -0,0 +1,257 @@
+#ifndef HASHINDEX_H
+#define HASHINDEX_H
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <new>
+#include <utility>
+
+/**
+* How HashIndex hashes a Key by default: std::hash when the key has one,
+* pairs of hashable things too. Anything else still compiles (so trees of
+* any key type can carry the index code) but says supported = false.
+*/
+template<typename Key, typename Enable = void>
+struct IndexHash
+{
+    static const bool supported = false;
+    size_t operator()(const Key&) const { return 0; }
+};
+
+template<typename Key>
+struct IndexHash<Key, decltype((void)std::hash<Key>()(std::declval<const Key&>()))>
+{
+    static const bool supported = true;
+    size_t operator()(const Key& key) const { return std::hash<Key>()(key); }
+};
+
+template<typename A, typename B>
+struct IndexHash<std::pair<A, B>, void>
+{
+    static const bool supported = IndexHash<A>::supported && IndexHash<B>::supported;
+    size_t operator()(const std::pair<A, B>& key) const
+    {
+        size_t h = IndexHash<A>()(key.first);
+        return h ^ (IndexHash<B>()(key.second) + 0x9E3779B9 + (h << 6) + (h >> 2));
+    }
+};
+
+/**
+* An open addressing hash table from Key to Entry*, where the key is read
+* off the entry itself (entry->getKey()), so the table never copies keys.
+* Linear probing over a power of two number of slots, each slot keeping the
+* full hash next to the pointer so most mismatches never touch the entry.
+* Deleting shifts the following run back instead of leaving tombstones, so
+* lookups don't slow down after lots of removes. Grows past 70% full.
+*/
+template<typename Key, typename Entry, typename Hash = IndexHash<Key> >
+class HashIndex
+{
+public:
+    HashIndex();
+    ~HashIndex();
+
+    Entry* find(const Key& key) const;
+    void insert(Entry* entry);
+    void erase(const Key& key);
+    void clear();
+    void reserve(size_t count);
+    size_t size() const;
+    size_t capacity() const;
+    size_t bytes() const;
+
+    HashIndex(const HashIndex&) = delete;
+    HashIndex& operator=(const HashIndex&) = delete;
+
+private:
+    struct Slot
+    {
+        size_t hash;
+        Entry* entry;   // NULL when empty
+    };
+
+    static size_t hashOf(const Key& key);
+    void rehash(size_t capacity);
+
+    Slot* slots_;
+    size_t mask_;   // capacity - 1
+    size_t size_;
+};
+
+template<typename Key, typename Entry, typename Hash>
+HashIndex<Key, Entry, Hash>::HashIndex() : slots_(NULL), mask_(0), size_(0)
+{
+
+}
+
+template<typename Key, typename Entry, typename Hash>
+HashIndex<Key, Entry, Hash>::~HashIndex()
+{
+    delete [] slots_;
+}
+
+// std::hash is the identity for integers on most libraries, which piles sequential
+// keys into neighbouring slots. a multiply spreads them over the high bits we use
+template<typename Key, typename Entry, typename Hash>
+size_t HashIndex<Key, Entry, Hash>::hashOf(const Key& key)
+{
+    uint64_t h = (uint64_t)Hash()(key) * 0x9E3779B97F4A7C15ull;
+    return (size_t)(h ^ (h >> 32));
+}
+
+/**
+* The entry with this key, or NULL.
+*/
+template<typename Key, typename Entry, typename Hash>
+Entry* HashIndex<Key, Entry, Hash>::find(const Key& key) const
+{
+    if(size_ == 0) {
+        return NULL;
+    }
+    size_t hash = hashOf(key);
+    for(size_t i = hash & mask_; slots_[i].entry != NULL; i = (i + 1) & mask_) {
+        if(slots_[i].hash == hash && slots_[i].entry->getKey() == key) {
+            return slots_[i].entry;
+        }
+    }
+    return NULL;
+}
+
+/**
+* Adds entry, replacing whatever entry had the same key.
+*/
+template<typename Key, typename Entry, typename Hash>
+void HashIndex<Key, Entry, Hash>::insert(Entry* entry)
+{
+    if(slots_ == NULL || (size_ + 1) * 10 > (mask_ + 1) * 7) {
+        rehash(slots_ == NULL ? 16 : (mask_ + 1) * 2);
+    }
+    size_t hash = hashOf(entry->getKey());
+    size_t i = hash & mask_;
+    for(; slots_[i].entry != NULL; i = (i + 1) & mask_) {
+        if(slots_[i].hash == hash && slots_[i].entry->getKey() == entry->getKey()) {
+            slots_[i].entry = entry;
+            return;
+        }
+    }
+    slots_[i].hash = hash;
+    slots_[i].entry = entry;
+    ++size_;
+}
+
+/**
+* Drops the entry with this key if there is one. Anything after it in the
+* same run that could sit earlier gets moved up into the gap.
+*/
+template<typename Key, typename Entry, typename Hash>
+void HashIndex<Key, Entry, Hash>::erase(const Key& key)
+{
+    if(size_ == 0) {
+        return;
+    }
+    size_t hash = hashOf(key);
+    size_t gap = hash & mask_;
+    while(true) {
+        if(slots_[gap].entry == NULL) {
+            return;
+        }
+        if(slots_[gap].hash == hash && slots_[gap].entry->getKey() == key) {
+            break;
+        }
+        gap = (gap + 1) & mask_;
+    }
+
+    for(size_t i = (gap + 1) & mask_; slots_[i].entry != NULL; i = (i + 1) & mask_) {
+        // slot i can move to gap if its home isn't in (gap, i], going around the end
+        size_t home = slots_[i].hash & mask_;
+        bool between = (gap <= i) ? (gap < home && home <= i) : (gap < home || home <= i);
+        if(!between) {
+            slots_[gap] = slots_[i];
+            gap = i;
+        }
+    }
+    slots_[gap].entry = NULL;
+    --size_;
+}
+
+/**
+* Empties the table (keeps the slots for reuse).
+*/
+template<typename Key, typename Entry, typename Hash>
+void HashIndex<Key, Entry, Hash>::clear()
+{
+    if(slots_ != NULL) {
+        for(size_t i = 0; i <= mask_; ++i) {
+            slots_[i].entry = NULL;
+        }
+    }
+    size_ = 0;
+}
+
+/**
+* Makes room for count entries up front, so filling it doesn't rehash.
+*/
+template<typename Key, typename Entry, typename Hash>
+void HashIndex<Key, Entry, Hash>::reserve(size_t count)
+{
+    size_t capacity = 16;
+    while(count * 10 > capacity * 7) {
+        capacity *= 2;
+    }
+    if(slots_ == NULL || capacity > mask_ + 1) {
+        rehash(capacity);
+    }
+}
+
+template<typename Key, typename Entry, typename Hash>
+size_t HashIndex<Key, Entry, Hash>::size() const
+{
+    return size_;
+}
+
+/**
+* How many slots there are (0 until the first insert or reserve).
+*/
+template<typename Key, typename Entry, typename Hash>
+size_t HashIndex<Key, Entry, Hash>::capacity() const
+{
+    return (slots_ == NULL) ? 0 : mask_ + 1;
+}
+
+/**
+* How much memory the slots take.
+*/
+template<typename Key, typename Entry, typename Hash>
+size_t HashIndex<Key, Entry, Hash>::bytes() const
+{
+    return capacity() * sizeof(Slot);
+}
+
+// moves everything into a new table of capacity slots (a power of two)
+template<typename Key, typename Entry, typename Hash>
+void HashIndex<Key, Entry, Hash>::rehash(size_t capacity)
+{
+    Slot* fresh = new Slot[capacity];
+    for(size_t i = 0; i < capacity; ++i) {
+        fresh[i].entry = NULL;
+    }
+    size_t freshMask = capacity - 1;
+    if(slots_ != NULL) {
+        for(size_t i = 0; i <= mask_; ++i) {
+            if(slots_[i].entry == NULL) {
+                continue;
+            }
+            size_t j = slots_[i].hash & freshMask;
+            while(fresh[j].entry != NULL) {
+                j = (j + 1) & freshMask;
+            }
+            fresh[j] = slots_[i];
+        }
+    }
+    delete [] slots_;
+    slots_ = fresh;
+    mask_ = freshMask;
+}
+
+#endif
@@ -0,0 +1,155 @@
+#include <iostream>
+#include <map>
+#include <vector>
+#include <stdexcept>
+#include <cstdlib>
+#include "intervaltree.h"
+#include "test-check.h"
+
+using namespace std;
+
+typedef IntervalTree<int, int> Tree;
+typedef map<pair<int,int>, int> Model;
+
+// the intervals overlapping [lo, hi] as overlapping() reports them
+vector<pair<int,int> > found(const Tree& tree, int lo, int hi)
+{
+    vector<Tree::iterator> hits;
+    tree.overlapping(lo, hi, hits);
+    vector<pair<int,int> > out;
+    for(size_t i = 0; i < hits.size(); ++i) {
+        out.push_back(hits[i]->first);
+    }
+    return out;
+}
+
+// the same by brute force, in (start, end) order
+vector<pair<int,int> > expected(const Model& model, int lo, int hi)
+{
+    vector<pair<int,int> > out;
+    for(Model::const_iterator it = model.begin(); it != model.end(); ++it) {
+        if(it->first.first <= hi && lo <= it->first.second) {
+            out.push_back(it->first);
+        }
+    }
+    return out;
+}
+
+void testEdges()
+{
+    cout << "overlap edge cases" << endl;
+    Tree tree;
+    CHECK(found(tree, 0, 100).empty());
+    CHECK(!tree.overlapsAny(0, 100));
+
+    tree.insert(10, 20, 1);
+    tree.insert(10, 15, 2);     // same start, different end
+    tree.insert(10, 10, 3);     // a single point
+    tree.insert(30, 40, 4);
+
+    // touching counts at both ends, closed intervals
+    vector<pair<int,int> > hits = found(tree, 20, 25);
+    CHECK(hits.size() == 1 && hits[0] == make_pair(10, 20));
+    CHECK(tree.overlapsAny(20, 25));
+    hits = found(tree, 25, 30);
+    CHECK(hits.size() == 1 && hits[0] == make_pair(30, 40));
+    CHECK(tree.overlapsAny(25, 30));
+    CHECK(found(tree, 40, 40).size() == 1);
+
+    // a gap between intervals overlaps nothing
+    CHECK(found(tree, 21, 29).empty());
+    CHECK(!tree.overlapsAny(21, 29));
+    CHECK(!tree.overlapsAny(41, 100));
+    CHECK(!tree.overlapsAny(-100, 9));
+
+    // all three sharing a start come back, in (start, end) order
+    vector<pair<int,int> > atTen = found(tree, 10, 10);
+    CHECK(atTen.size() == 3 && atTen[0] == make_pair(10, 10) && atTen[1] == make_pair(10, 15) && atTen[2] == make_pair(10, 20));
+    vector<Tree::iterator> stab;
+    tree.stabbing(16, stab);
+    CHECK(stab.size() == 1 && stab[0]->second == 1);
+
+    // inserting the same interval again just overwrites its value
+    tree.insert(10, 15, 7);
+    CHECK(tree[make_pair(10, 15)] == 7);
+    CHECK(found(tree, 10, 10).size() == 3);
+
+    // end before start is rejected and leaves the tree as it was
+    bool threw = false;
+    try {
+        tree.insert(5, 4, 0);
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(tree.find(make_pair(5, 4)) == tree.end() && tree.validate());
+
+    // same through the (interval, value) pair insert everything else uses
+    threw = false;
+    try {
+        tree.insert(make_pair(make_pair(5, 3), 1));
+    }
+    catch(std::invalid_argument&) {
+        threw = true;
+    }
+    CHECK(threw);
+    CHECK(tree.find(make_pair(5, 3)) == tree.end() && tree.validate());
+    CHECK(found(tree, 0, 9).empty() && !tree.overlapsAny(0, 9));
+
+    // a single point through the pair insert is fine
+    tree.insert(make_pair(make_pair(3, 3), 8));
+    hits = found(tree, 0, 9);
+    CHECK(hits.size() == 1 && hits[0] == make_pair(3, 3) && tree.validate());
+}
+
+// random intervals against a brute force scan, with removes and lazy
+// deletes mixed in so the max end has to follow the tree around
+void testRandom(bool lazy)
+{
+    cout << "random overlap queries" << (lazy ? " (lazy delete)" : "") << endl;
+    srand(lazy ? 37 : 36);
+    Tree tree;
+    Model model;
+    if(lazy) {
+        tree.setLazyDelete(true);
+    }
+    for(int step = 0; step < 2000; ++step) {
+        int start = rand() % 1000;
+        int end = start + rand() % 60;
+        if(rand() % 4 == 0 && !model.empty()) {
+            Model::iterator victim = model.lower_bound(make_pair(start, 0));
+            if(victim == model.end()) {
+                victim = model.begin();
+            }
+            tree.remove(victim->first);
+            model.erase(victim);
+        }
+        else {
+            tree.insert(start, end, step);
+            model[make_pair(start, end)] = step;
+        }
+        if(step % 20 == 0) {
+            int lo = rand() % 1100 - 50;
+            int hi = lo + rand() % 50;
+            CHECK(found(tree, lo, hi) == expected(model, lo, hi));
+            CHECK(tree.overlapsAny(lo, hi) == !expected(model, lo, hi).empty());
+        }
+    }
+    CHECK(tree.validate());
+
+    tree.eraseRange(make_pair(200, 0), make_pair(400, 0));
+    model.erase(model.lower_bound(make_pair(200, 0)), model.lower_bound(make_pair(400, 0)));
+    for(int lo = -20; lo < 1100; lo += 37) {
+        CHECK(found(tree, lo, lo + 15) == expected(model, lo, lo + 15));
+        CHECK(tree.overlapsAny(lo, lo + 15) == !expected(model, lo, lo + 15).empty());
+    }
+}
+
+int main()
+{
+    testEdges();
+    testRandom(false);
+    testRandom(true);
+    return checkResult();
+}
@@ -0,0 +1,157 @@
+#ifndef INTERVALTREE_H
+#define INTERVALTREE_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "augavlbst.h"
+
+/**
+* The interval tree augmentation: biggest end point anywhere in the subtree.
+*/
+template<typename Point>
+struct MaxEndMonoid
+{
+    typedef Point type;
+    static type identity() { return std::numeric_limits<Point>::lowest(); }
+    template<typename Value>
+    static type lift(const std::pair<Point, Point>& interval, const Value&) { return interval.second; }
+    static type combine(const type& a, const type& b) { return (a < b) ? b : a; }
+};
+
+/**
+* Closed intervals [start, end] with a Value each, kept in an AVL tree keyed
+* by (start, end) so several intervals can share a start. Every node also
+* knows the largest end in its subtree, which is what lets the overlap
+* queries skip whole subtrees that can't have a match.
+* Everything from AVLTree (find, remove, eraseRange, iterators...) works on
+* the (start, end) keys.
+*/
+template <class Point, class Value>
+class IntervalTree : public AugmentedAVLTree<std::pair<Point, Point>, Value, MaxEndMonoid<Point> >
+{
+public:
+    typedef std::pair<Point, Point> Interval;
+    typedef typename BinarySearchTree<Interval, Value>::iterator iterator;
+
+    virtual void insert(const std::pair<const Interval, Value>& new_item);
+    void insert(const Point& start, const Point& end, const Value& value);
+
+    void overlapping(const Point& lo, const Point& hi, std::vector<iterator>& out) const;
+    void stabbing(const Point& point, std::vector<iterator>& out) const;
+    bool overlapsAny(const Point& lo, const Point& hi) const;
+
+protected:
+    typedef AugmentedAVLTree<Interval, Value, MaxEndMonoid<Point> > Base;
+    typedef typename Base::AugNode AugNode;
+
+    virtual bool checkNode(Node<Interval, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const;
+};
+
+/**
+* The pair form goes through the same check, so a backwards interval can't
+* get in this way either (the max ends would stop meaning anything).
+* Throws std::invalid_argument if end < start.
+*/
+template<class Point, class Value>
+void IntervalTree<Point, Value>::insert(const std::pair<const Interval, Value>& new_item)
+{
+    if(new_item.first.second < new_item.first.first) {
+        throw std::invalid_argument("interval end is before its start");
+    }
+    Base::insert(new_item);
+}
+
+/**
+* Adds [start, end] (overwriting the value if that exact interval is there).
+* Throws std::invalid_argument if end < start.
+*/
+template<class Point, class Value>
+void IntervalTree<Point, Value>::insert(const Point& start, const Point& end, const Value& value)
+{
+    insert(std::make_pair(Interval(start, end), value));
+}
+
+/**
+* Appends an iterator to every interval that overlaps [lo, hi] (touching
+* counts) to out, in (start, end) order. A subtree gets skipped when its max
+* end is < lo, and the walk stops at the first start > hi. Every subtree it
+* goes into holds a match except along the path to hi, so it's O(log n + k)
+* when the matches are bunched together and O(log n + k log(n/k)) at worst.
+*/
+template<class Point, class Value>
+void IntervalTree<Point, Value>::overlapping(const Point& lo, const Point& hi, std::vector<iterator>& out) const
+{
+    // in-order walk with an explicit stack, only going where a match is still possible
+    std::vector<AugNode*> stack;
+    AugNode* curr = static_cast<AugNode*>(this->root_);
+    while(curr != nullptr || !stack.empty()) {
+        while(curr != nullptr && !(curr->getAggregate() < lo)) {
+            stack.push_back(curr);
+            curr = curr->getLeft();
+        }
+        if(stack.empty()) {
+            break;
+        }
+        curr = stack.back();
+        stack.pop_back();
+
+        // starts only go up from here, so once one is past hi we're done
+        if(hi < curr->getKey().first) {
+            break;
+        }
+        if(!(curr->getKey().second < lo) && !curr->isTombstone()) {
+            out.push_back(this->iteratorAt(curr));
+        }
+        curr = curr->getRight();
+    }
+}
+
+/**
+* Every interval containing point.
+*/
+template<class Point, class Value>
+void IntervalTree<Point, Value>::stabbing(const Point& point, std::vector<iterator>& out) const
+{
+    overlapping(point, point, out);
+}
+
+/**
+* True if anything overlaps [lo, hi]. O(log n), it stops at the first hit.
+*/
+template<class Point, class Value>
+bool IntervalTree<Point, Value>::overlapsAny(const Point& lo, const Point& hi) const
+{
+    AugNode* curr = static_cast<AugNode*>(this->root_);
+    while(curr != nullptr && !(curr->getAggregate() < lo)) {
+        if(!(hi < curr->getKey().first) && !(curr->getKey().second < lo) && !curr->isTombstone()) {
+            return true;
+        }
+        // if the left side reaches lo, anything left that misses must start after hi,
+        // in which case curr (and everything right of it) does too
+        AugNode* left = curr->getLeft();
+        if(left != nullptr && !(left->getAggregate() < lo)) {
+            curr = left;
+        }
+        else {
+            curr = curr->getRight();
+        }
+    }
+    return false;
+}
+
+// on top of the AVL checks, no interval ends before it starts
+template<class Point, class Value>
+bool IntervalTree<Point, Value>::checkNode(Node<Interval, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const
+{
+    if(node->getKey().second < node->getKey().first) {
+        return false;
+    }
+    return Base::checkNode(node, leftHeight, rightHeight, leftRank, rightRank);
+}
+
+#endif
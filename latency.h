@@ -0,0 +1,299 @@
+#ifndef LATENCY_H
+#define LATENCY_H
+
+#include <chrono>
+#include <cstdint>
+#include <cstddef>
+#include <iostream>
+
+/**
+* A log-linear (HDR style) histogram of latencies in nanoseconds.
+* Values under 16 get their own bucket, after that every power of two
+* is split into 16 sub-buckets, so a reported value is within ~6% of
+* what was actually recorded. Recording is O(1) and never allocates.
+*/
+class LatencyHistogram
+{
+public:
+    LatencyHistogram();
+
+    void record(uint64_t ns);
+    void reset();
+
+    uint64_t count() const;
+    uint64_t min() const;
+    uint64_t max() const;
+    double mean() const;
+    uint64_t percentile(double p) const; // p in [0, 100]
+
+    void print(std::ostream& os, const char* name) const;
+
+private:
+    static const size_t SUB_BUCKETS = 16;
+    static const size_t NUM_BUCKETS = 64 * SUB_BUCKETS;
+
+    static size_t bucketFor(uint64_t ns);
+    static uint64_t bucketTop(size_t bucket);
+
+    uint64_t buckets_[NUM_BUCKETS];
+    uint64_t count_;
+    uint64_t min_;
+    uint64_t max_;
+    uint64_t sum_;
+};
+
+inline LatencyHistogram::LatencyHistogram()
+{
+    reset();
+}
+
+inline void LatencyHistogram::reset()
+{
+    for(size_t i = 0; i < NUM_BUCKETS; ++i) {
+        buckets_[i] = 0;
+    }
+    count_ = 0;
+    min_ = UINT64_MAX;
+    max_ = 0;
+    sum_ = 0;
+}
+
+// which bucket a value lands in (exact below 16, then 16 slices per power of two)
+inline size_t LatencyHistogram::bucketFor(uint64_t ns)
+{
+    if(ns < SUB_BUCKETS) {
+        return (size_t)ns;
+    }
+
+    int topBit;
+#if defined(__GNUC__)
+    topBit = 63 - __builtin_clzll(ns);
+#else
+    topBit = 0;
+    for(uint64_t v = ns; v > 1; v >>= 1) {
+        ++topBit;
+    }
+#endif
+    // topBit >= 4 here, keep the 4 bits under the top one as the sub bucket
+    size_t sub = (size_t)((ns >> (topBit - 4)) & (SUB_BUCKETS - 1));
+    return (size_t)(topBit - 3) * SUB_BUCKETS + sub;
+}
+
+// largest value that still maps to the given bucket
+inline uint64_t LatencyHistogram::bucketTop(size_t bucket)
+{
+    if(bucket < SUB_BUCKETS) {
+        return bucket;
+    }
+    int topBit = (int)(bucket / SUB_BUCKETS) + 3;
+    uint64_t sub = bucket % SUB_BUCKETS;
+    uint64_t width = (uint64_t)1 << (topBit - 4);
+    return ((SUB_BUCKETS + sub) << (topBit - 4)) + (width - 1);
+}
+
+inline void LatencyHistogram::record(uint64_t ns)
+{
+    ++buckets_[bucketFor(ns)];
+    ++count_;
+    sum_ += ns;
+    if(ns < min_) {
+        min_ = ns;
+    }
+    if(ns > max_) {
+        max_ = ns;
+    }
+}
+
+inline uint64_t LatencyHistogram::count() const
+{
+    return count_;
+}
+
+inline uint64_t LatencyHistogram::min() const
+{
+    return (count_ == 0) ? 0 : min_;
+}
+
+inline uint64_t LatencyHistogram::max() const
+{
+    return max_;
+}
+
+inline double LatencyHistogram::mean() const
+{
+    return (count_ == 0) ? 0.0 : (double)sum_ / count_;
+}
+
+/**
+* Returns the smallest recorded value v such that p percent of the
+* samples are <= v (up to bucket precision).
+*/
+inline uint64_t LatencyHistogram::percentile(double p) const
+{
+    if(count_ == 0) {
+        return 0;
+    }
+    if(p < 0.0) {
+        p = 0.0;
+    }
+    if(p > 100.0) {
+        p = 100.0;
+    }
+
+    // rank of the sample we want, at least 1 so p=0 gives the min
+    uint64_t rank = (uint64_t)((p / 100.0) * count_ + 0.5);
+    if(rank == 0) {
+        rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for(size_t i = 0; i < NUM_BUCKETS; ++i) {
+        seen += buckets_[i];
+        if(seen >= rank) {
+            uint64_t top = bucketTop(i);
+            return (top > max_) ? max_ : top; // don't report more than we ever saw
+        }
+    }
+    return max_;
+}
+
+inline void LatencyHistogram::print(std::ostream& os, const char* name) const
+{
+    os << name << ": count=" << count_;
+    if(count_ != 0) {
+        os << " min=" << min() << "ns"
+           << " mean=" << (uint64_t)mean() << "ns"
+           << " p50=" << percentile(50.0) << "ns"
+           << " p90=" << percentile(90.0) << "ns"
+           << " p99=" << percentile(99.0) << "ns"
+           << " p99.9=" << percentile(99.9) << "ns"
+           << " max=" << max_ << "ns";
+    }
+    os << std::endl;
+}
+
+/**
+* The tree operations we keep a histogram for.
+*/
+enum TreeOp
+{
+    OP_INSERT,
+    OP_REMOVE,
+    OP_FIND,
+    OP_INDEX,   // operator[]
+    OP_CLEAR,
+    OP_COUNT
+};
+
+/**
+* One histogram per tree operation plus the sampling state.
+* Only every sampleEvery-th call is timed, the rest just bump a counter
+* (clear() is always timed).
+* Not thread safe, same as the trees it's attached to.
+*/
+class LatencyTracker
+{
+public:
+    explicit LatencyTracker(uint32_t sampleEvery);
+
+    const LatencyHistogram& histogram(TreeOp op) const;
+    uint32_t sampleEvery() const;
+    void reset();
+    void print(std::ostream& os) const;
+
+private:
+    friend class LatencyProbe;
+
+    uint32_t sampleEvery_;
+    uint32_t tick_;
+    int depth_; // > 0 while an outer operation is being timed (clear calls remove, etc.)
+    LatencyHistogram hist_[OP_COUNT];
+};
+
+inline LatencyTracker::LatencyTracker(uint32_t sampleEvery) :
+    sampleEvery_(sampleEvery == 0 ? 1 : sampleEvery), tick_(0), depth_(0)
+{
+
+}
+
+inline const LatencyHistogram& LatencyTracker::histogram(TreeOp op) const
+{
+    return hist_[op];
+}
+
+inline uint32_t LatencyTracker::sampleEvery() const
+{
+    return sampleEvery_;
+}
+
+inline void LatencyTracker::reset()
+{
+    for(int i = 0; i < OP_COUNT; ++i) {
+        hist_[i].reset();
+    }
+    tick_ = 0;
+}
+
+inline void LatencyTracker::print(std::ostream& os) const
+{
+    static const char* names[OP_COUNT] = { "insert", "remove", "find", "operator[]", "clear" };
+    os << "latency (1 in " << sampleEvery_ << " calls sampled):" << std::endl;
+    for(int i = 0; i < OP_COUNT; ++i) {
+        os << "  ";
+        hist_[i].print(os, names[i]);
+    }
+}
+
+/**
+* Times one tree operation from construction to destruction.
+* Does nothing when tracker is null, and only the outermost probe
+* records so clear() doesn't also show up as a pile of removes.
+*/
+class LatencyProbe
+{
+public:
+    LatencyProbe(LatencyTracker* tracker, TreeOp op);
+    ~LatencyProbe();
+
+private:
+    LatencyProbe(const LatencyProbe&);
+    LatencyProbe& operator=(const LatencyProbe&);
+
+    LatencyTracker* tracker_;
+    TreeOp op_;
+    bool timing_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+inline LatencyProbe::LatencyProbe(LatencyTracker* tracker, TreeOp op) :
+    tracker_(tracker), op_(op), timing_(false)
+{
+    if(tracker_ == nullptr) {
+        return;
+    }
+    if(tracker_->depth_++ != 0) {
+        return;
+    }
+    // clear() is rare and is exactly the kind of spike we're after, so never skip it
+    if(op_ == OP_CLEAR || ++tracker_->tick_ >= tracker_->sampleEvery_) {
+        if(op_ != OP_CLEAR) {
+            tracker_->tick_ = 0;
+        }
+        timing_ = true;
+        start_ = std::chrono::steady_clock::now();
+    }
+}
+
+inline LatencyProbe::~LatencyProbe()
+{
+    if(tracker_ == nullptr) {
+        return;
+    }
+    if(timing_) {
+        std::chrono::steady_clock::duration elapsed = std::chrono::steady_clock::now() - start_;
+        tracker_->hist_[op_].record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+    }
+    --tracker_->depth_;
+}
+
+#endif
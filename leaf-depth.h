@@ -0,0 +1,188 @@
+#ifndef LEAF_DEPTH_H
+#define LEAF_DEPTH_H
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+#include <vector>
+#include "parallel.h"
+
+/*
+  One leaf-depth checker for every tree in here: the plain struct Node
+  from equal-paths.h (left/right members) and the Node/AVLNode classes
+  from bst.h (getLeft/getRight). Everything is iterative so a tree that's
+  basically a linked list won't blow the call stack, and it bails on the
+  first leaf that doesn't match.
+*/
+
+// child accessors, getLeft()/getRight() wins if the node has them, otherwise use left/right
+template<typename N>
+auto leafDepthLeft(N* node, int) -> decltype(node->getLeft())
+{
+    return node->getLeft();
+}
+
+template<typename N>
+auto leafDepthLeft(N* node, long) -> decltype(node->left)
+{
+    return node->left;
+}
+
+template<typename N>
+auto leafDepthRight(N* node, int) -> decltype(node->getRight())
+{
+    return node->getRight();
+}
+
+template<typename N>
+auto leafDepthRight(N* node, long) -> decltype(node->right)
+{
+    return node->right;
+}
+
+/**
+* The depth every leaf has to match when there's only one thread looking.
+* The first leaf we see decides it.
+*/
+struct LeafDepthTarget
+{
+    LeafDepthTarget() : depth(-1) { }
+
+    bool match(int leafDepth)
+    {
+        if(depth == -1) {
+            depth = leafDepth;
+        }
+        return depth == leafDepth;
+    }
+    bool stopped() const { return false; }
+
+    int depth;
+};
+
+/**
+* Same thing but shared between threads, and once anybody finds a
+* mismatch everybody else stops too.
+*/
+struct SharedLeafDepthTarget
+{
+    SharedLeafDepthTarget() : depth(-1), failed(false) { }
+
+    bool match(int leafDepth)
+    {
+        int expected = -1;
+        if(!depth.compare_exchange_strong(expected, leafDepth) && expected != leafDepth) {
+            failed.store(true, std::memory_order_relaxed);
+            return false;
+        }
+        return true;
+    }
+    bool stopped() const { return failed.load(std::memory_order_relaxed); }
+
+    std::atomic<int> depth;
+    std::atomic<bool> failed;
+};
+
+/**
+* Walks the subtree at root (which sits at depth rootDepth in the full tree)
+* and checks every leaf against target. Returns false on the first mismatch.
+*/
+template<typename N, typename Target>
+bool leafDepthsMatch(N* root, int rootDepth, Target& target)
+{
+    if(root == nullptr) {
+        return true;
+    }
+
+    std::vector<std::pair<N*, int> > stack;
+    stack.push_back(std::make_pair(root, rootDepth));
+    size_t visited = 0;
+
+    while(!stack.empty()) {
+        N* node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        // every so often see if another thread already found a mismatch
+        if((++visited & 1023) == 0 && target.stopped()) {
+            return false;
+        }
+
+        N* left = leafDepthLeft(node, 0);
+        N* right = leafDepthRight(node, 0);
+        if(left == nullptr && right == nullptr) {
+            if(!target.match(depth)) {
+                return false;
+            }
+            continue;
+        }
+        if(right != nullptr) {
+            stack.push_back(std::make_pair(right, depth + 1));
+        }
+        if(left != nullptr) {
+            stack.push_back(std::make_pair(left, depth + 1));
+        }
+    }
+    return true;
+}
+
+/**
+* Returns true if every leaf is the same distance from root (an empty tree counts).
+*/
+template<typename N>
+bool equalLeafDepths(N* root)
+{
+    LeafDepthTarget target;
+    return leafDepthsMatch(root, 0, target);
+}
+
+/**
+* Same as above, but splits the tree into subtrees near the top and checks
+* those on up to `threads` threads (0 means one per core). Only worth it on
+* really big trees, a couple million nodes and up.
+*/
+template<typename N>
+bool equalLeafDepths(N* root, unsigned threads)
+{
+    threads = resolveThreadCount(threads);
+    if(root == nullptr || threads <= 1) {
+        return equalLeafDepths(root);
+    }
+
+    SharedLeafDepthTarget target;
+
+    // peel off the top levels breadth first until there are a few subtrees per thread,
+    // any leaves we run into up here get checked right away
+    std::vector<std::pair<N*, int> > frontier;
+    frontier.push_back(std::make_pair(root, 0));
+    size_t head = 0;
+    while(head < frontier.size() && frontier.size() - head < (size_t)threads * 4) {
+        N* node = frontier[head].first;
+        int depth = frontier[head].second;
+        ++head;
+
+        N* left = leafDepthLeft(node, 0);
+        N* right = leafDepthRight(node, 0);
+        if(left == nullptr && right == nullptr) {
+            if(!target.match(depth)) {
+                return false;
+            }
+            continue;
+        }
+        if(left != nullptr) {
+            frontier.push_back(std::make_pair(left, depth + 1));
+        }
+        if(right != nullptr) {
+            frontier.push_back(std::make_pair(right, depth + 1));
+        }
+    }
+
+    parallelFor(frontier.size() - head, threads, [&](size_t i) {
+        if(!target.stopped()) {
+            leafDepthsMatch(frontier[head + i].first, frontier[head + i].second, target);
+        }
+    });
+    return !target.stopped();
+}
+
+#endif
@@ -0,0 +1,76 @@
+#ifndef PARALLEL_H
+#define PARALLEL_H
+
+#include <atomic>
+#include <cstddef>
+#include <thread>
+#include <vector>
+
+/**
+* How many threads to use when the caller asks for "all of them" (0).
+*/
+inline unsigned resolveThreadCount(unsigned threads)
+{
+    if(threads != 0) {
+        return threads;
+    }
+    unsigned hw = std::thread::hardware_concurrency();
+    return (hw == 0) ? 1 : hw;
+}
+
+/**
+* One task's result when several threads each fill in their own. The
+* padding keeps neighbouring slots off each other's cache line, so threads
+* don't keep stealing the line back and forth, and unlike a
+* std::vector<bool> element every slot is a real, separate T.
+*/
+template<typename T>
+struct PaddedSlot
+{
+    static const size_t CACHE_LINE = 64;
+
+    explicit PaddedSlot(const T& init) : value(init) { }
+
+    T value;
+    char pad[CACHE_LINE];
+};
+
+/**
+* Runs fn(i) for every i in [0, count) on up to `threads` threads, the
+* calling thread being one of them. Indices are handed out one at a time
+* so a few big tasks don't leave the other threads sitting idle.
+* fn must not throw, there's nobody on the worker threads to catch it.
+*/
+template<typename Fn>
+void parallelFor(size_t count, unsigned threads, Fn fn)
+{
+    threads = resolveThreadCount(threads);
+    if(threads > count) {
+        threads = (unsigned)count;
+    }
+    if(threads <= 1) {
+        for(size_t i = 0; i < count; ++i) {
+            fn(i);
+        }
+        return;
+    }
+
+    std::atomic<size_t> next(0);
+    auto work = [&]() {
+        size_t i;
+        while((i = next.fetch_add(1)) < count) {
+            fn(i);
+        }
+    };
+
+    std::vector<std::thread> pool;
+    for(unsigned t = 1; t < threads; ++t) {
+        pool.push_back(std::thread(work));
+    }
+    work();
+    for(size_t t = 0; t < pool.size(); ++t) {
+        pool[t].join();
+    }
+}
+
+#endif
@@ -11,14 +11,15 @@
 // Version 1.2
 
 // maximum depth of tree to actually print.
+// (BinarySearchTree::dump in dump_bst.h writes whole trees of any size.)
 #define PPBST_MAX_HEIGHT 6
 
 // Returns the node's distance from the given root.
 // 1 means that it is the root.
 // Returns -1 (not found) if the distance is more than PPBST_MAX_HEIGHT,
 // or -2 if the tree is inconsistent.
-template<typename Key, typename Value>
-int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
+template<typename Key, typename Value, typename Allocator>
+int getNodeDepth(BinarySearchTree<Key, Value, Allocator> const & tree, Node<Key, Value> * root, Node<Key, Value> * node)
 {
     int dist = 1;
 
@@ -42,25 +43,45 @@ int getNodeDepth(BinarySearchTree<Key, Value> const & tree, Node<Key, Value> * r
 }
 
 // Returns the height of the subtree at root.
-// Uses recursion, not height values, so it is bulletproof
+// Walks the nodes, not height values, so it is bulletproof
 // against incorrect heights.
-// Stops recursing after PPBST_MAX_HEIGHT calls.
+// Uses its own stack rather than recursion and never looks
+// more than PPBST_MAX_HEIGHT levels down, so bad or very
+// deep trees can't loop forever or blow the call stack.
 template<typename Key, typename Value>
-int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
+int getSubtreeHeight(Node<Key, Value> * root)
 {
-    if(root == nullptr)
+    int height = 0;
+    std::vector<std::pair<Node<Key, Value> *, int> > stack;
+    if(root != nullptr)
     {
-        return 0;
+        stack.push_back(std::make_pair(root, 1));
     }
 
-    if(recursionDepth > PPBST_MAX_HEIGHT)
+    while(!stack.empty())
     {
-        // bail out to prevent infinite loops on bad trees
-        return 0;
+        Node<Key, Value> * node = stack.back().first;
+        int depth = stack.back().second;
+        stack.pop_back();
+
+        height = std::max(height, depth);
+        if(depth >= PPBST_MAX_HEIGHT + 1)
+        {
+            // bail out to prevent infinite loops on bad trees
+            continue;
+        }
+
+        if(node->getLeft() != nullptr)
+        {
+            stack.push_back(std::make_pair(node->getLeft(), depth + 1));
+        }
+        if(node->getRight() != nullptr)
+        {
+            stack.push_back(std::make_pair(node->getRight(), depth + 1));
+        }
     }
 
-    return std::max(getSubtreeHeight(root->getLeft(), recursionDepth + 1),
-                    getSubtreeHeight(root->getRight(), recursionDepth + 1)) + 1;
+    return height;
 }
 
 /* Function to prettily print a BST out to the terminal.
@@ -92,8 +113,26 @@ int getSubtreeHeight(Node<Key, Value> * root, int recursionDepth = 1)
 
     */
 
-template<typename Key, typename Value>
-void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
+// Prints one key or value. std::pair (IntervalTree's keys) has no operator<<,
+// so it gets its own overload.
+template<typename T>
+void ppbstPrintItem(std::ostream & os, T const & item)
+{
+    os << item;
+}
+
+template<typename A, typename B>
+void ppbstPrintItem(std::ostream & os, std::pair<A, B> const & item)
+{
+    os << '[';
+    ppbstPrintItem(os, item.first);
+    os << ", ";
+    ppbstPrintItem(os, item.second);
+    os << ']';
+}
+
+template<typename Key, typename Value, typename Allocator>
+void BinarySearchTree<Key, Value, Allocator>::printRoot (Node<Key, Value>* root) const
 {
     // special case for empty trees:
     if(root == nullptr)
@@ -130,7 +169,7 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
     std::map<Key, uint8_t> valuePlaceholders;
 
     uint8_t nextPlaceHolderVal = 1;
-    for(typename BinarySearchTree<Key, Value>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
+    for(typename BinarySearchTree<Key, Value, Allocator>::iterator treeIter = this->begin(); treeIter != this->end(); ++treeIter)
     {
 
         if(getNodeDepth(*this, root, treeIter.current_) != -1)
@@ -271,16 +310,18 @@ void BinarySearchTree<Key, Value>::printRoot (Node<Key, Value>* root) const
 
             // print element with original cout flags
             std::cout.flags(origCoutState);
-            std::cout << '(' << placeholdersIter->first << ", ";
+            std::cout << '(';
+            ppbstPrintItem(std::cout, placeholdersIter->first);
+            std::cout << ", ";
 
-            typename BinarySearchTree<Key, Value>::iterator elementIter = this->find(placeholdersIter->first);
+            typename BinarySearchTree<Key, Value, Allocator>::iterator elementIter = this->find(placeholdersIter->first);
             if(elementIter == this->end())
             {
                 std::cout << "<error: lookup failed>";
             }
             else
             {
-                std::cout << elementIter->second;
+                ppbstPrintItem(std::cout, elementIter->second);
             }
 
             std::cout << ')' << std::endl;
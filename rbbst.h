@@ -0,0 +1,489 @@
+#ifndef RBBST_H
+#define RBBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <algorithm>
+#include "bst.h"
+
+enum RBColor { RB_RED, RB_BLACK };
+
+/**
+* A node for a red-black tree, which is a normal node plus a color.
+* Missing children (nullptr) count as black.
+*/
+template <typename Key, typename Value>
+class RBNode : public Node<Key, Value>
+{
+public:
+    // Constructor/destructor. New nodes start out red.
+    RBNode(const Key& key, const Value& value, RBNode<Key, Value>* parent);
+    virtual ~RBNode();
+
+    // Getter/setter for the node's color.
+    RBColor getColor() const;
+    void setColor(RBColor color);
+    bool isRed() const;
+    virtual size_t footprint() const override;
+
+    // Getters for parent, left, and right. Same deal as AVLNode, these are
+    // redefined so they hand back RBNodes.
+    virtual RBNode<Key, Value>* getParent() const override;
+    virtual RBNode<Key, Value>* getLeft() const override;
+    virtual RBNode<Key, Value>* getRight() const override;
+
+protected:
+    RBColor color_;
+};
+
+/*
+  -------------------------------------------------
+  Begin implementations for the RBNode class.
+  -------------------------------------------------
+*/
+
+/**
+* An explicit constructor to initialize the elements by calling the base class constructor
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::RBNode(const Key& key, const Value& value, RBNode<Key, Value> *parent) :
+    Node<Key, Value>(key, value, parent), color_(RB_RED)
+{
+
+}
+
+/**
+* A destructor which does nothing.
+*/
+template<class Key, class Value>
+RBNode<Key, Value>::~RBNode()
+{
+
+}
+
+/**
+* A getter for the color of a RBNode.
+*/
+template<class Key, class Value>
+RBColor RBNode<Key, Value>::getColor() const
+{
+    return color_;
+}
+
+/**
+* A setter for the color of a RBNode.
+*/
+template<class Key, class Value>
+void RBNode<Key, Value>::setColor(RBColor color)
+{
+    color_ = color;
+}
+
+/**
+* Shorthand for getColor() == RB_RED.
+*/
+template<class Key, class Value>
+bool RBNode<Key, Value>::isRed() const
+{
+    return color_ == RB_RED;
+}
+
+/**
+* sizeof an RBNode (see Node::footprint).
+*/
+template<class Key, class Value>
+size_t RBNode<Key, Value>::footprint() const
+{
+    return sizeof(*this);
+}
+
+/**
+* An overridden function for getting the parent since a static_cast is necessary to make sure
+* that our node is a RBNode.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getParent() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->parent_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getLeft() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->left_);
+}
+
+/**
+* Overridden for the same reasons as above.
+*/
+template<class Key, class Value>
+RBNode<Key, Value> *RBNode<Key, Value>::getRight() const
+{
+    return static_cast<RBNode<Key, Value>*>(this->right_);
+}
+
+
+/*
+  -----------------------------------------------
+  End implementations for the RBNode class.
+  -----------------------------------------------
+*/
+
+/**
+* A red-black tree. Compared to AVLTree it's a bit taller (up to 2 log n
+* instead of ~1.44 log n) but a remove does at most 3 rotations and the
+* recoloring is O(1) amortized, where an AVL remove can rotate all the way
+* up to the root. Same iterator/find/operator[] as every other tree here.
+*/
+template <class Key, class Value>
+class RBTree : public BinarySearchTree<Key, Value>
+{
+public:
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+protected:
+    virtual RBNode<Key, Value>* createNode(const Key& key, const Value& value, Node<Key, Value>* parent);
+    virtual RBNode<Key, Value>* cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const std::allocator<std::pair<const Key, Value> >& alloc) const;
+    virtual void removeNode(Node<Key, Value>* node);
+    virtual void nodeSwap( RBNode<Key,Value>* n1, RBNode<Key,Value>* n2);
+    virtual bool checkNode(Node<Key, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const;
+    virtual int nodeRank(Node<Key, Value>* node) const;
+    virtual void rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight);
+    virtual void rebuiltTop(Node<Key, Value>* top);
+
+    void insertFixup(RBNode<Key, Value>* node);
+    void removeFixup(RBNode<Key, Value>* node, RBNode<Key, Value>* parent, bool isLeft);
+    static bool isRed(RBNode<Key, Value>* node);
+};
+
+// every node an RBTree makes is an RBNode (red until insertFixup says otherwise)
+template<class Key, class Value>
+RBNode<Key, Value>* RBTree<Key, Value>::createNode(const Key& key, const Value& value, Node<Key, Value>* parent)
+{
+    return this->template makeNode<RBNode<Key, Value> >(this->alloc_, key, value, static_cast<RBNode<Key, Value>*>(parent));
+}
+
+// copies keep their color
+template<class Key, class Value>
+RBNode<Key, Value>* RBTree<Key, Value>::cloneNode(const Node<Key, Value>* source, Node<Key, Value>* parent, const std::allocator<std::pair<const Key, Value> >& alloc) const
+{
+    RBNode<Key, Value>* copy = this->template makeNode<RBNode<Key, Value> >(alloc, source->getKey(), source->getValue(), static_cast<RBNode<Key, Value>*>(parent));
+    copy->setColor(static_cast<const RBNode<Key, Value>*>(source)->getColor());
+    return copy;
+}
+
+/*
+ * Same as the other trees: if key is already in the tree, overwrite the value.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    LatencyProbe probe(this->latency_, OP_INSERT);
+    BST_STAT(++this->stats_.inserts);
+
+    // empty tree, new node is the root and the root is always black
+    if(this->root_ == NULL) {
+        RBNode<Key, Value>* node = createNode(new_item.first, new_item.second, NULL);
+        node->setColor(RB_BLACK);
+        this->root_ = node;
+        ++this->size_;
+        this->indexNode(node);
+        return;
+    }
+
+    RBNode<Key, Value>* curr = static_cast<RBNode<Key, Value>*>(this->searchStart(new_item.first));
+
+    while (true) {
+        BST_STAT(++this->stats_.insertComparisons);
+
+        if (new_item.first == curr->getKey()) {
+            curr->setValue(new_item.second);
+            this->reviveNode(curr);
+            this->moveFinger(curr);
+            return;
+        }
+        else if (new_item.first < curr->getKey()) {
+            if (curr->getLeft() == nullptr) {
+                RBNode<Key, Value>* node = createNode(new_item.first, new_item.second, curr);
+                curr->setLeft(node);
+                ++this->size_;
+                this->moveFinger(node);
+                this->indexNode(node);
+                insertFixup(node);
+                return;
+            }
+            curr = curr->getLeft();
+        }
+        else {
+            if (curr->getRight() == nullptr) {
+                RBNode<Key, Value>* node = createNode(new_item.first, new_item.second, curr);
+                curr->setRight(node);
+                ++this->size_;
+                this->moveFinger(node);
+                this->indexNode(node);
+                insertFixup(node);
+                return;
+            }
+            curr = curr->getRight();
+        }
+    }
+}
+
+/*
+ * Same removal as the others (swap with the predecessor until there's at most
+ * one kid), then fix up the colors if we pulled out a black node.
+ */
+template<class Key, class Value>
+void RBTree<Key, Value>::removeNode(Node<Key, Value>* node)
+{
+    RBNode<Key, Value>* nodeToRemove = static_cast<RBNode<Key, Value>*>(node);
+    BST_STAT(++this->stats_.removes);
+
+    // colors stay with the positions (nodeSwap swaps them), so the tree's coloring doesn't change here
+    while (nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr) {
+        RBNode<Key, Value>* pred = static_cast<RBNode<Key, Value>*>(this->predecessor(nodeToRemove));
+        nodeSwap(nodeToRemove, pred);
+    }
+
+    RBNode<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? nodeToRemove->getLeft() : nodeToRemove->getRight();
+    RBNode<Key, Value>* parent = nodeToRemove->getParent();
+    bool wasLeft = (parent != nullptr && parent->getLeft() == nodeToRemove);
+
+    if (parent == nullptr) {
+        this->root_ = child;
+    }
+    else if (wasLeft) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+    if (child != nullptr) {
+        child->setParent(parent);
+    }
+
+    bool removedBlack = !nodeToRemove->isRed();
+    this->freeNode(nodeToRemove);
+    --this->size_;
+
+    // taking out a red node never breaks anything. a black one with a red kid
+    // is fixed by painting the kid black, otherwise that side is now one black short
+    if (removedBlack) {
+        if (isRed(child)) {
+            child->setColor(RB_BLACK);
+        }
+        else {
+            removeFixup(child, parent, wasLeft);
+        }
+    }
+}
+
+// null children count as black
+template<class Key, class Value>
+bool RBTree<Key, Value>::isRed(RBNode<Key, Value>* node)
+{
+    return node != nullptr && node->isRed();
+}
+
+// node was just added as a red leaf, push any red-red problem up the tree,
+// recoloring while the uncle is red and rotating (at most twice) once it isn't
+template<class Key, class Value>
+void RBTree<Key, Value>::insertFixup(RBNode<Key, Value>* node)
+{
+    while (isRed(node->getParent())) {
+        RBNode<Key, Value>* parent = node->getParent();
+        RBNode<Key, Value>* grandparent = parent->getParent(); // exists since a red parent can't be the root
+
+        if (parent == grandparent->getLeft()) {
+            RBNode<Key, Value>* uncle = grandparent->getRight();
+            if (isRed(uncle)) {
+                parent->setColor(RB_BLACK);
+                uncle->setColor(RB_BLACK);
+                grandparent->setColor(RB_RED);
+                node = grandparent;
+                continue;
+            }
+            // zig-zag, straighten it out first
+            if (node == parent->getRight()) {
+                this->rotateLeft(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setColor(RB_BLACK);
+            grandparent->setColor(RB_RED);
+            this->rotateRight(grandparent);
+        }
+        // mirror image
+        else {
+            RBNode<Key, Value>* uncle = grandparent->getLeft();
+            if (isRed(uncle)) {
+                parent->setColor(RB_BLACK);
+                uncle->setColor(RB_BLACK);
+                grandparent->setColor(RB_RED);
+                node = grandparent;
+                continue;
+            }
+            if (node == parent->getLeft()) {
+                this->rotateRight(parent);
+                node = parent;
+                parent = node->getParent();
+            }
+            parent->setColor(RB_BLACK);
+            grandparent->setColor(RB_RED);
+            this->rotateLeft(grandparent);
+        }
+    }
+    static_cast<RBNode<Key, Value>*>(this->root_)->setColor(RB_BLACK);
+}
+
+// the subtree at node (possibly empty, hence parent/isLeft) is one black short.
+// recoloring can walk up the tree but every rotation case finishes, so it's at most 3 rotations
+template<class Key, class Value>
+void RBTree<Key, Value>::removeFixup(RBNode<Key, Value>* node, RBNode<Key, Value>* parent, bool isLeft)
+{
+    while (parent != nullptr && !isRed(node)) {
+        if (isLeft) {
+            RBNode<Key, Value>* sibling = parent->getRight();
+            // red sibling, rotate so we get a black one
+            if (isRed(sibling)) {
+                sibling->setColor(RB_BLACK);
+                parent->setColor(RB_RED);
+                this->rotateLeft(parent);
+                sibling = parent->getRight();
+            }
+            // sibling's kids are both black, take a black off the sibling side and move up
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setColor(RB_RED);
+                node = parent;
+                parent = node->getParent();
+                isLeft = (parent != nullptr && node == parent->getLeft());
+                continue;
+            }
+            // get the red nephew onto the far side, then one rotation fixes everything
+            if (!isRed(sibling->getRight())) {
+                sibling->getLeft()->setColor(RB_BLACK);
+                sibling->setColor(RB_RED);
+                this->rotateRight(sibling);
+                sibling = parent->getRight();
+            }
+            sibling->setColor(parent->getColor());
+            parent->setColor(RB_BLACK);
+            sibling->getRight()->setColor(RB_BLACK);
+            this->rotateLeft(parent);
+            node = static_cast<RBNode<Key, Value>*>(this->root_);
+            break;
+        }
+        // mirror image
+        else {
+            RBNode<Key, Value>* sibling = parent->getLeft();
+            if (isRed(sibling)) {
+                sibling->setColor(RB_BLACK);
+                parent->setColor(RB_RED);
+                this->rotateRight(parent);
+                sibling = parent->getLeft();
+            }
+            if (!isRed(sibling->getLeft()) && !isRed(sibling->getRight())) {
+                sibling->setColor(RB_RED);
+                node = parent;
+                parent = node->getParent();
+                isLeft = (parent != nullptr && node == parent->getLeft());
+                continue;
+            }
+            if (!isRed(sibling->getLeft())) {
+                sibling->getRight()->setColor(RB_BLACK);
+                sibling->setColor(RB_RED);
+                this->rotateLeft(sibling);
+                sibling = parent->getLeft();
+            }
+            sibling->setColor(parent->getColor());
+            parent->setColor(RB_BLACK);
+            sibling->getLeft()->setColor(RB_BLACK);
+            this->rotateRight(parent);
+            node = static_cast<RBNode<Key, Value>*>(this->root_);
+            break;
+        }
+    }
+    if (node != nullptr) {
+        node->setColor(RB_BLACK);
+    }
+}
+
+// validate() hook: no red node has a red kid, and both sides have the same black height
+template<class Key, class Value>
+bool RBTree<Key, Value>::checkNode(Node<Key, Value>* node, int leftHeight, int rightHeight, int leftRank, int rightRank) const
+{
+    (void)leftHeight;
+    (void)rightHeight;
+    RBNode<Key, Value>* rb = static_cast<RBNode<Key, Value>*>(node);
+    if (leftRank != rightRank) {
+        return false;
+    }
+    if (rb->isRed() && (isRed(rb->getLeft()) || isRed(rb->getRight()))) {
+        return false;
+    }
+    // the root has to be black too
+    return rb->getParent() != nullptr || !rb->isRed();
+}
+
+// colors a tree that a rebuild (merge) just made perfectly balanced. every
+// null in it is at depth D or D + 1, so a node whose shortest path down is as
+// long as its parent's sits over a perfect subtree and gets to be red; the rest
+// are black. nodes come bottom up, and each one uses its own color to tell its
+// parent "my subtree is perfect" (black) or not (red) until the parent has
+// colored it for real
+template<class Key, class Value>
+void RBTree<Key, Value>::rebuiltNode(Node<Key, Value>* node, int leftHeight, int rightHeight)
+{
+    RBNode<Key, Value>* rb = static_cast<RBNode<Key, Value>*>(node);
+    RBNode<Key, Value>* left = rb->getLeft();
+    RBNode<Key, Value>* right = rb->getRight();
+    bool leftPerfect = (left == nullptr || !left->isRed());
+    bool rightPerfect = (right == nullptr || !right->isRed());
+
+    // shortest path down from each kid
+    int leftShort = leftPerfect ? leftHeight : leftHeight - 1;
+    int rightShort = rightPerfect ? rightHeight : rightHeight - 1;
+    int shortest = 1 + std::min(leftShort, rightShort);
+
+    if(left != nullptr) {
+        left->setColor(leftShort == shortest ? RB_RED : RB_BLACK);
+    }
+    if(right != nullptr) {
+        right->setColor(rightShort == shortest ? RB_RED : RB_BLACK);
+    }
+
+    bool perfect = leftPerfect && rightPerfect && leftHeight == rightHeight;
+    rb->setColor(perfect ? RB_BLACK : RB_RED);
+}
+
+// the top never gets colored by a parent, and the root is always black
+template<class Key, class Value>
+void RBTree<Key, Value>::rebuiltTop(Node<Key, Value>* top)
+{
+    if(top != nullptr && top->getParent() == nullptr) {
+        static_cast<RBNode<Key, Value>*>(top)->setColor(RB_BLACK);
+    }
+}
+
+// only black nodes count towards the black height
+template<class Key, class Value>
+int RBTree<Key, Value>::nodeRank(Node<Key, Value>* node) const
+{
+    return static_cast<RBNode<Key, Value>*>(node)->isRed() ? 0 : 1;
+}
+
+template<class Key, class Value>
+void RBTree<Key, Value>::nodeSwap( RBNode<Key,Value>* n1, RBNode<Key,Value>* n2)
+{
+    BinarySearchTree<Key, Value>::nodeSwap(n1, n2);
+    RBColor tempColor = n1->getColor();
+    n1->setColor(n2->getColor());
+    n2->setColor(tempColor);
+}
+
+
+#endif
@@ -0,0 +1,281 @@
+#ifndef SPLAYBST_H
+#define SPLAYBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <stdexcept>
+#include "bst.h"
+
+/**
+* How much a SplayTree restructures on access.
+* SPLAY_FULL is the classic splay (accessed node goes all the way to the root),
+* SPLAY_SEMI only does one rotation per zig-zig step so the node ends up about
+* halfway up (less pointer writing, still adapts to the working set),
+* SPLAY_NONE never restructures on lookups, so it's safe for concurrent readers
+* (inserts and removes still splay fully, writers need the tree to themselves anyway).
+* That holds as long as nothing else on the tree records lookups: finger
+* search, latency tracking and -DBST_STATS counters all write on every find.
+*/
+enum SplayMode { SPLAY_FULL, SPLAY_SEMI, SPLAY_NONE };
+
+/**
+* A splay tree on plain nodes (no extra per-node data at all). Every find,
+* insert and non-const operator[] pulls the node it touched up towards the
+* root, so hot keys stay near the top and amortized access cost follows the
+* working set. The const find/operator[] inherited from BinarySearchTree
+* never restructure, use those (or SPLAY_NONE) for read-only sharing.
+*/
+template <class Key, class Value>
+class SplayTree : public BinarySearchTree<Key, Value>
+{
+public:
+    SplayTree();
+
+    virtual void insert(const std::pair<const Key, Value> &new_item);
+
+    // non-const lookups splay, the const ones from the base class don't
+    using BinarySearchTree<Key, Value>::find;
+    using BinarySearchTree<Key, Value>::operator[];
+    typename BinarySearchTree<Key, Value>::iterator find(const Key& key);
+    Value& operator[](const Key& key);
+
+    void setSplayMode(SplayMode mode);
+    SplayMode getSplayMode() const;
+
+protected:
+    virtual void removeNode(Node<Key, Value>* nodeToRemove);
+    void splay(Node<Key, Value>* node);
+    void rotateUp(Node<Key, Value>* node);
+    Node<Key, Value>* splayFind(const Key& key);
+
+    SplayMode mode_;
+};
+
+/**
+* Default constructor, full splaying.
+*/
+template<class Key, class Value>
+SplayTree<Key, Value>::SplayTree() : mode_(SPLAY_FULL)
+{
+
+}
+
+/**
+* Changes how much lookups restructure from here on.
+*/
+template<class Key, class Value>
+void SplayTree<Key, Value>::setSplayMode(SplayMode mode)
+{
+    mode_ = mode;
+}
+
+/**
+* A getter for the current splay mode.
+*/
+template<class Key, class Value>
+SplayMode SplayTree<Key, Value>::getSplayMode() const
+{
+    return mode_;
+}
+
+/*
+ * Normal BST insert (overwriting the value if the key is there), then
+ * splays whichever node got inserted or updated.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::insert(const std::pair<const Key, Value> &new_item)
+{
+    LatencyProbe probe(this->latency_, OP_INSERT);
+    BST_STAT(++this->stats_.inserts);
+
+    if(this->root_ == NULL) {
+        this->root_ = this->createNode(new_item.first, new_item.second, NULL);
+        ++this->size_;
+        this->indexNode(this->root_);
+        return;
+    }
+
+    Node<Key, Value>* curr = this->root_;
+    while(true) {
+        BST_STAT(++this->stats_.insertComparisons);
+
+        if(new_item.first == curr->getKey()) {
+            curr->setValue(new_item.second);
+            this->reviveNode(curr);
+            break;
+        }
+        else if(new_item.first < curr->getKey()) {
+            if(curr->getLeft() == NULL) {
+                Node<Key, Value>* node = this->createNode(new_item.first, new_item.second, curr);
+                curr->setLeft(node);
+                ++this->size_;
+                this->indexNode(node);
+                curr = node;
+                break;
+            }
+            curr = curr->getLeft();
+        }
+        else {
+            if(curr->getRight() == NULL) {
+                Node<Key, Value>* node = this->createNode(new_item.first, new_item.second, curr);
+                curr->setRight(node);
+                ++this->size_;
+                this->indexNode(node);
+                curr = node;
+                break;
+            }
+            curr = curr->getRight();
+        }
+    }
+    splay(curr);
+}
+
+/*
+ * Same removal as the other trees (swap with the predecessor until there's at
+ * most one kid, then splice it out), then splays the removed node's parent.
+ */
+template<class Key, class Value>
+void SplayTree<Key, Value>::removeNode(Node<Key, Value>* nodeToRemove)
+{
+    BST_STAT(++this->stats_.removes);
+
+    while(nodeToRemove->getLeft() != nullptr && nodeToRemove->getRight() != nullptr) {
+        this->nodeSwap(nodeToRemove, this->predecessor(nodeToRemove));
+    }
+
+    Node<Key, Value>* child = (nodeToRemove->getLeft() != nullptr) ? nodeToRemove->getLeft() : nodeToRemove->getRight();
+    Node<Key, Value>* parent = nodeToRemove->getParent();
+
+    if(parent == nullptr) {
+        this->root_ = child;
+    }
+    else if(parent->getLeft() == nodeToRemove) {
+        parent->setLeft(child);
+    }
+    else {
+        parent->setRight(child);
+    }
+    if(child != nullptr) {
+        child->setParent(parent);
+    }
+
+    this->freeNode(nodeToRemove);
+    --this->size_;
+
+    if(parent != nullptr) {
+        splay(parent);
+    }
+}
+
+/**
+* Like BinarySearchTree::find, but splays the node it finds (or the last
+* node it looked at if the key isn't there).
+*/
+template<class Key, class Value>
+typename BinarySearchTree<Key, Value>::iterator SplayTree<Key, Value>::find(const Key& key)
+{
+    LatencyProbe probe(this->latency_, OP_FIND);
+    return this->iteratorAt(splayFind(key));
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key, after splaying its node
+ */
+template<class Key, class Value>
+Value& SplayTree<Key, Value>::operator[](const Key& key)
+{
+    LatencyProbe probe(this->latency_, OP_INDEX);
+    Node<Key, Value>* curr = splayFind(key);
+    if(curr == NULL) throw std::out_of_range("Invalid key");
+    return curr->getValue();
+}
+
+// looks key up, splays whatever the search ended on, and returns the node or NULL
+template<class Key, class Value>
+Node<Key, Value>* SplayTree<Key, Value>::splayFind(const Key& key)
+{
+    BST_STAT(++this->stats_.lookups);
+
+    // with the hash index on, a hit goes straight to its node (a miss still descends so it can splay)
+    if(this->hashIndex_ != NULL) {
+        Node<Key, Value>* hit = this->hashIndex_->find(key);
+        if(hit != nullptr) {
+            if(mode_ != SPLAY_NONE) {
+                splay(hit);
+            }
+            return hit;
+        }
+    }
+
+    Node<Key, Value>* curr = this->root_;
+    Node<Key, Value>* last = nullptr;
+    while(curr != nullptr) {
+        BST_STAT(++this->stats_.lookupComparisons);
+        last = curr;
+        if(key == curr->getKey()) {
+            break;
+        }
+        curr = (key < curr->getKey()) ? curr->getLeft() : curr->getRight();
+    }
+
+    // splaying on a miss too keeps repeated misses cheap
+    if(last != nullptr && mode_ != SPLAY_NONE) {
+        splay(last);
+    }
+    return (curr != nullptr && curr->isTombstone()) ? nullptr : curr;
+}
+
+// rotates node up over its parent, whichever side it's on
+template<class Key, class Value>
+void SplayTree<Key, Value>::rotateUp(Node<Key, Value>* node)
+{
+    Node<Key, Value>* parent = node->getParent();
+    if(parent->getLeft() == node) {
+        this->rotateRight(parent);
+    }
+    else {
+        this->rotateLeft(parent);
+    }
+}
+
+// moves node up the tree according to mode_ (bottom up, so no extra memory).
+// SPLAY_NONE only matters to lookups, anything that gets here splays fully
+template<class Key, class Value>
+void SplayTree<Key, Value>::splay(Node<Key, Value>* node)
+{
+    while(node->getParent() != nullptr) {
+        Node<Key, Value>* parent = node->getParent();
+        Node<Key, Value>* grandparent = parent->getParent();
+
+        // zig, parent is the root
+        if(grandparent == nullptr) {
+            rotateUp(node);
+            break;
+        }
+
+        bool nodeIsLeft = (parent->getLeft() == node);
+        bool parentIsLeft = (grandparent->getLeft() == parent);
+
+        // zig-zig, rotate the parent first then the node
+        if(nodeIsLeft == parentIsLeft) {
+            rotateUp(parent);
+            if(mode_ == SPLAY_SEMI) {
+                // semi-splay stops here and carries on from the parent, which
+                // leaves node about halfway up instead of at the root
+                node = parent;
+                continue;
+            }
+            rotateUp(node);
+        }
+        // zig-zag, rotate the node up twice
+        else {
+            rotateUp(node);
+            rotateUp(node);
+        }
+    }
+}
+
+
+#endif
@@ -0,0 +1,157 @@
+#include <iostream>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <cstdlib>
+#include "splitavlbst.h"
+#include "test-check.h"
+
+using namespace std;
+
+// exposes the value pool so slot reuse can be checked
+template<class Value>
+struct PoolPeek : public SplitAVLTree<int, Value>
+{
+    size_t slots() const { return this->values_.size(); }
+    size_t freeSlots() const { return this->freeSlots_.size(); }
+};
+
+void testSlotReuse()
+{
+    cout << "slot reuse" << endl;
+    PoolPeek<string> tree;
+    for(int i = 0; i < 100; ++i) {
+        tree.insert(make_pair(i, to_string(i)));
+    }
+    CHECK(tree.slots() == 100 && tree.freeSlots() == 0 && tree.size() == 100);
+
+    // overwriting keeps the key in its slot
+    tree.insert(make_pair(5, string("five")));
+    CHECK(tree.slots() == 100 && tree[5] == "five" && tree.size() == 100);
+
+    // removing frees slots (missing keys do nothing), inserting takes them back first
+    for(int i = 0; i < 100; i += 10) {
+        tree.remove(i);
+    }
+    tree.remove(1000);
+    CHECK(tree.slots() == 100 && tree.freeSlots() == 10 && tree.size() == 90);
+    for(int i = 200; i < 210; ++i) {
+        tree.insert(make_pair(i, to_string(i)));
+    }
+    CHECK(tree.slots() == 100 && tree.freeSlots() == 0);
+    for(int i = 200; i < 210; ++i) {
+        CHECK(tree[i] == to_string(i));
+    }
+    CHECK(tree.find(10) == tree.end() && tree.find(11) != tree.end());
+    tree.insert(make_pair(300, string("new")));
+    CHECK(tree.slots() == 101);
+
+    // a removed value gets let go of right away, not when its slot is reused
+    PoolPeek<shared_ptr<int> > owners;
+    shared_ptr<int> held = make_shared<int>(7);
+    owners.insert(make_pair(1, held));
+    CHECK(held.use_count() == 2);
+    owners.remove(1);
+    CHECK(held.use_count() == 1);
+    CHECK(owners.empty() && owners.freeSlots() == 1);
+}
+
+void testStableReferences()
+{
+    cout << "references across inserts/removes" << endl;
+    SplitAVLTree<int, string> tree;
+    tree.insert(make_pair(500, string("kept")));
+    string* kept = &tree[500];
+    SplitAVLTree<int, string>::iterator at = tree.find(500);
+
+    // plenty of growth (new deque blocks) and rotations, the value doesn't move
+    map<int, string> model;
+    model[500] = "kept";
+    srand(40);
+    for(int i = 0; i < 20000; ++i) {
+        int key = rand() % 5000;
+        if(key == 500) {
+            continue;
+        }
+        if(rand() % 4 == 0) {
+            tree.remove(key);
+            model.erase(key);
+        }
+        else {
+            tree.insert(make_pair(key, to_string(i)));
+            model[key] = to_string(i);
+        }
+    }
+    CHECK(&tree[500] == kept && *kept == "kept");
+    CHECK(&at.value() == kept && at.key() == 500);
+    *kept = "changed";
+    CHECK(tree[500] == "changed");
+    model[500] = "changed";
+    CHECK(sameAs(tree, model));
+
+    // writing through an iterator changes the stored value
+    for(SplitAVLTree<int, string>::iterator it = tree.begin(); it != tree.end(); ++it) {
+        (*it).second += "!";
+        model[it.key()] += "!";
+    }
+    CHECK(sameAs(tree, model));
+
+    tree.clear();
+    CHECK(tree.empty() && tree.begin() == tree.end());
+    tree.insert(make_pair(1, string("a")));
+    CHECK(tree[1] == "a" && tree.validate());
+}
+
+// copying it throws once armed, to fail the slot fill after the key is in the index
+struct Touchy
+{
+    static bool armed;
+    int value;
+    Touchy(int value = 0) : value(value) { }
+    Touchy(const Touchy& other) : value(other.value)
+    {
+        if(armed) {
+            throw std::runtime_error("no copies");
+        }
+    }
+    Touchy& operator=(const Touchy& other) = default;
+};
+bool Touchy::armed = false;
+
+// a new key whose value can't be stored comes back out of the index
+void testFailedInsert()
+{
+    cout << "insert that can't store its value" << endl;
+    PoolPeek<Touchy> tree;
+    for(int i = 0; i < 20; ++i) {
+        tree.insert(make_pair(i, Touchy(i)));
+    }
+    pair<const int, Touchy> item(100, Touchy(100));
+    Touchy::armed = true;
+    bool threw = false;
+    try {
+        tree.insert(item);
+    }
+    catch(std::runtime_error&) {
+        threw = true;
+    }
+    Touchy::armed = false;
+    CHECK(threw && tree.find(100) == tree.end() && tree.size() == 20 && tree.validate());
+    CHECK(tree.slots() == 20);
+
+    // overwrites only assign, so they still go through while copies throw
+    pair<const int, Touchy> update(3, Touchy(-3));
+    Touchy::armed = true;
+    tree.insert(update);
+    Touchy::armed = false;
+    CHECK(tree[3].value == -3 && tree.size() == 20 && tree.slots() == 20);
+}
+
+int main()
+{
+    testSlotReuse();
+    testStableReferences();
+    testFailedInsert();
+    return checkResult();
+}
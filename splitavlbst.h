@@ -0,0 +1,275 @@
+#ifndef SPLITAVLBST_H
+#define SPLITAVLBST_H
+
+#include <iostream>
+#include <exception>
+#include <cstdlib>
+#include <cstdint>
+#include <deque>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+#include "avlbst.h"
+
+/**
+* An AVL map with a hot/cold layout: the tree nodes only hold the key, the
+* links, the balance and a 32 bit slot number, and the values live out of
+* line in a separate pool. A lookup only ever touches the small nodes, so
+* it costs the same no matter how big Value is; the value itself is loaded
+* once, at the end. Worth it when Value is a lot bigger than Key and
+* lookups outnumber full scans.
+* It's an AVLTree<Key, uint32_t> underneath, so all the balancing is the
+* same code. Values must be default constructible (freed slots get reset
+* to Value() and reused). References to values stay valid until their key
+* is removed, the pool never moves anything.
+*/
+template <class Key, class Value>
+class SplitAVLTree
+{
+public:
+    /**
+    * Iterates in key order like the other trees, but since the key and the
+    * value aren't next to each other, * gives a pair of references instead
+    * of a reference to a pair.
+    */
+    class iterator
+    {
+    public:
+        typedef std::pair<const Key&, Value&> reference;
+
+        iterator();
+
+        reference operator*() const;
+        const Key& key() const;
+        Value& value() const;
+
+        bool operator==(const iterator& rhs) const;
+        bool operator!=(const iterator& rhs) const;
+
+        iterator& operator++();
+
+    protected:
+        friend class SplitAVLTree<Key, Value>;
+        iterator(typename AVLTree<Key, uint32_t>::iterator at, std::deque<Value>* values);
+
+        typename AVLTree<Key, uint32_t>::iterator at_;
+        std::deque<Value>* values_;
+    };
+
+    void insert(const std::pair<const Key, Value>& keyValuePair);
+    void remove(const Key& key);
+    void clear();
+    bool empty() const;
+    size_t size() const;
+    bool validate() const;
+
+    iterator begin() const;
+    iterator end() const;
+    iterator find(const Key& key) const;
+    Value& operator[](const Key& key);
+    Value const & operator[](const Key& key) const;
+
+protected:
+    // the index is an AVLTree with its insert walk let out, so insert can
+    // find a key or add it in one descent
+    class SlotIndex : public AVLTree<Key, uint32_t>
+    {
+    public:
+        using AVLTree<Key, uint32_t>::insertNode;
+    };
+
+    uint32_t takeSlot(const Value& value);
+
+    SlotIndex index_;                   // the hot part, key -> slot in values_
+    mutable std::deque<Value> values_;  // the cold part (a deque so growing never moves a value)
+    std::vector<uint32_t> freeSlots_;   // slots of removed keys, reused first
+};
+
+/*
+---------------------------------------------------------
+Begin implementations for the SplitAVLTree::iterator class.
+---------------------------------------------------------
+*/
+
+template<class Key, class Value>
+SplitAVLTree<Key, Value>::iterator::iterator() : at_(), values_(NULL)
+{
+
+}
+
+template<class Key, class Value>
+SplitAVLTree<Key, Value>::iterator::iterator(typename AVLTree<Key, uint32_t>::iterator at, std::deque<Value>* values) :
+    at_(at), values_(values)
+{
+
+}
+
+template<class Key, class Value>
+typename SplitAVLTree<Key, Value>::iterator::reference SplitAVLTree<Key, Value>::iterator::operator*() const
+{
+    return reference(at_->first, (*values_)[at_->second]);
+}
+
+template<class Key, class Value>
+const Key& SplitAVLTree<Key, Value>::iterator::key() const
+{
+    return at_->first;
+}
+
+template<class Key, class Value>
+Value& SplitAVLTree<Key, Value>::iterator::value() const
+{
+    return (*values_)[at_->second];
+}
+
+template<class Key, class Value>
+bool SplitAVLTree<Key, Value>::iterator::operator==(const iterator& rhs) const
+{
+    return at_ == rhs.at_;
+}
+
+template<class Key, class Value>
+bool SplitAVLTree<Key, Value>::iterator::operator!=(const iterator& rhs) const
+{
+    return at_ != rhs.at_;
+}
+
+template<class Key, class Value>
+typename SplitAVLTree<Key, Value>::iterator& SplitAVLTree<Key, Value>::iterator::operator++()
+{
+    ++at_;
+    return *this;
+}
+
+/*
+-------------------------------------------------------
+End implementations for the SplitAVLTree::iterator class.
+-------------------------------------------------------
+*/
+
+/**
+* Adds the item, or overwrites the value if the key is already there.
+* One walk down the index either way: a new key goes in with a placeholder
+* slot that gets filled in after.
+*/
+template<class Key, class Value>
+void SplitAVLTree<Key, Value>::insert(const std::pair<const Key, Value>& keyValuePair)
+{
+    bool added;
+    AVLNode<Key, uint32_t>* node = index_.insertNode(std::pair<const Key, uint32_t>(keyValuePair.first, 0), false, added);
+    if(!added) {
+        values_[node->getValue()] = keyValuePair.second;
+        return;
+    }
+
+    try {
+        node->setValue(takeSlot(keyValuePair.second));
+    }
+    catch(...) {
+        index_.remove(keyValuePair.first);
+        throw;
+    }
+}
+
+/**
+* Removes the key if it's there. Its slot gets reset and reused by a later insert.
+*/
+template<class Key, class Value>
+void SplitAVLTree<Key, Value>::remove(const Key& key)
+{
+    typename AVLTree<Key, uint32_t>::iterator it = index_.find(key);
+    if(it == index_.end()) {
+        return;
+    }
+    uint32_t slot = it->second;
+    index_.erase(it);
+
+    // let go of whatever the old value was holding on to
+    values_[slot] = Value();
+    freeSlots_.push_back(slot);
+}
+
+template<class Key, class Value>
+void SplitAVLTree<Key, Value>::clear()
+{
+    index_.clear();
+    values_.clear();
+    freeSlots_.clear();
+}
+
+template<class Key, class Value>
+bool SplitAVLTree<Key, Value>::empty() const
+{
+    return index_.empty();
+}
+
+template<class Key, class Value>
+size_t SplitAVLTree<Key, Value>::size() const
+{
+    return index_.size();
+}
+
+/**
+* Checks the index tree (see BinarySearchTree::validate).
+*/
+template<class Key, class Value>
+bool SplitAVLTree<Key, Value>::validate() const
+{
+    return index_.validate();
+}
+
+template<class Key, class Value>
+typename SplitAVLTree<Key, Value>::iterator SplitAVLTree<Key, Value>::begin() const
+{
+    return iterator(index_.begin(), &values_);
+}
+
+template<class Key, class Value>
+typename SplitAVLTree<Key, Value>::iterator SplitAVLTree<Key, Value>::end() const
+{
+    return iterator(index_.end(), &values_);
+}
+
+/**
+* Finds key by only walking the hot nodes.
+*/
+template<class Key, class Value>
+typename SplitAVLTree<Key, Value>::iterator SplitAVLTree<Key, Value>::find(const Key& key) const
+{
+    return iterator(index_.find(key), &values_);
+}
+
+/**
+ * @precondition The key exists in the map
+ * Returns the value associated with the key
+ */
+template<class Key, class Value>
+Value& SplitAVLTree<Key, Value>::operator[](const Key& key)
+{
+    return values_[index_[key]];
+}
+
+template<class Key, class Value>
+Value const & SplitAVLTree<Key, Value>::operator[](const Key& key) const
+{
+    return values_[index_[key]];
+}
+
+// puts value in a free slot (or a new one at the end) and returns the slot number
+template<class Key, class Value>
+uint32_t SplitAVLTree<Key, Value>::takeSlot(const Value& value)
+{
+    if(!freeSlots_.empty()) {
+        uint32_t slot = freeSlots_.back();
+        values_[slot] = value;
+        freeSlots_.pop_back();
+        return slot;
+    }
+    if(values_.size() >= UINT32_MAX) {
+        throw std::length_error("SplitAVLTree is out of value slots");
+    }
+    values_.push_back(value);
+    return (uint32_t)(values_.size() - 1);
+}
+
+#endif
@@ -0,0 +1,47 @@
+#include <iostream>
+
+#ifndef TEST_CHECK_H
+#define TEST_CHECK_H
+
+// Tiny self check helpers shared by the *-test drivers. CHECK prints what
+// failed and where and keeps going, checkResult() reports the total and
+// gives main its exit code (nonzero if anything failed). sameAs() compares
+// a tree against a std::map model.
+
+static int checkFailures = 0;
+
+#define CHECK(cond) do { \
+    if(!(cond)) { \
+        std::cout << "FAILED " << __FILE__ << ":" << __LINE__ << ": " << #cond << std::endl; \
+        ++checkFailures; \
+    } \
+} while(0)
+
+inline int checkResult()
+{
+    if(checkFailures != 0) {
+        std::cout << checkFailures << " check(s) FAILED" << std::endl;
+        return 1;
+    }
+    std::cout << "All checks passed" << std::endl;
+    return 0;
+}
+
+// tree holds exactly what model (a std::map, or anything iterating over
+// pairs the same way) does, in order, and passes tree.validate()
+template<class Tree, class Model>
+bool sameAs(const Tree& tree, const Model& model)
+{
+    if(!tree.validate()) {
+        return false;
+    }
+    typename Tree::iterator it = tree.begin();
+    for(typename Model::const_iterator m = model.begin(); m != model.end(); ++m, ++it) {
+        if(it == tree.end() || !((*it).first == m->first) || !((*it).second == m->second)) {
+            return false;
+        }
+    }
+    return it == tree.end();
+}
+
+#endif